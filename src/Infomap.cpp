@@ -93,6 +93,12 @@ std::vector<ParsedOption> getConfig(Config& conf, const std::string& flags, bool
 	api.addOptionArgument(conf.skipAdjustBipartiteFlow, "skip-adjust-bipartite-flow",
 			"Skip distributing all flow from the bipartite nodes (first column) to the ordinary nodes (second column).", true);
 
+	api.addOptionArgument(conf.bipartiteHyperedges, "bipartite-hyperedges",
+			"Optimize undirected bipartite networks on the ordinary nodes only, with the flow between them through the feature nodes, and place each feature node in the module of its strongest links. Falls back to the bipartite network if the feature nodes would give more than four pairwise links per bipartite link.", true);
+
+	api.addOptionArgument(conf.bipartiteTwoPhase, "bipartite-two-phase",
+			"Optimize bipartite networks by moving only the ordinary nodes in the core loop, and place each feature node in its strongest connected module afterwards.", true);
+
 	api.addOptionArgument(conf.withMemory, "overlapping",
 			"Let nodes be part of different and overlapping modules. Applies to ordinary networks by first representing the memoryless dynamics with memory nodes.");
 
@@ -205,6 +211,18 @@ std::vector<ParsedOption> getConfig(Config& conf, const std::string& flags, bool
 	api.addOptionArgument(conf.selfTeleportationProbability, 'y', "self-link-teleportation-probability",
 			"Additional probability of teleporting to itself. Effectively increasing the code rate, generating more and smaller modules.", "f", true);
 
+	api.addOptionArgument(conf.flowTolerance, "flow-tolerance",
+			"Stop the power iteration for the flow when the sum of absolute changes in node flow is below this value.", "f", true);
+
+	api.addOptionArgument(conf.maxFlowIterations, "max-flow-iterations",
+			"The maximum number of power iterations for the flow, or 0 for 200 (300 for memory networks).", "n", true);
+
+	api.addOptionArgument(conf.flowSolver, "flow-solver",
+			"The solver for the directed flow: 'power' iteration, 'gauss-seidel' sweeps or power iteration with 'aitken' extrapolation.", "s", true);
+
+	api.addOptionArgument(conf.flowCacheDirectory, "flow-cache",
+			"Cache the flow network in this directory and reuse it on later runs with the same input and flow options.", "p", true);
+
 	api.addOptionArgument(conf.markovTime, "markov-time",
 			"Scale link flow with this value to change the cost of moving between modules. Higher for less modules.", "f", true);
 
@@ -248,6 +266,12 @@ std::vector<ParsedOption> getConfig(Config& conf, const std::string& flags, bool
 	api.addOptionArgument(conf.numTrials, 'N', "num-trials",
 			"The number of outer-most loops to run before picking the best solution.", "n");
 
+	api.addOptionArgument(conf.maxSeconds, "max-seconds",
+			"Stop optimizing after this many seconds of wall time and keep the best solution found so far.", "f", false);
+
+	api.addOptionArgument(conf.parallelTrials, "parallel-trials",
+			"Run the trials concurrently on separate copies of the network, one per thread. Each trial is seeded from its index, so the result can differ from the serial trials with the same seed.");
+
 	api.addOptionArgument(conf.minimumCodelengthImprovement, 'm', "min-improvement",
 			"Minimum codelength threshold for accepting a new solution.", "f", true);
 
@@ -287,6 +311,15 @@ std::vector<ParsedOption> getConfig(Config& conf, const std::string& flags, bool
 	api.addOptionArgument(conf.innerParallelization, "inner-parallelization",
 			"Parallelize the innermost loop for greater speed. Note that this may give some accuracy tradeoff.");
 
+	api.addOptionArgument(conf.deterministicInnerParallelization, "deterministic-inner-parallelization",
+			"Parallelize the innermost loop in conflict-free batches applied in a fixed order, to get the same result for any number of threads.");
+
+	api.addOptionArgument(conf.dirtyNodeQueue, "dirty-node-queue",
+			"Only revisit nodes whose neighbourhood changed in the core loop, until none is left, instead of sweeping over all nodes.", true);
+
+	api.addOptionArgument(conf.graftSubModules, "graft-sub-modules",
+			"Graft the sub-modules found in the recursive search into the main tree and release each sub-Infomap instance right away, to bound the peak memory on deep hierarchies.", true);
+
 	api.addOptionArgument(conf.resetConfigBeforeRecursion, "reset-options-before-recursion",
 			"Reset options tuning the speed and accuracy before the recursive part.", true);
 
@@ -314,6 +347,9 @@ std::vector<ParsedOption> getConfig(Config& conf, const std::string& flags, bool
 	api.addOptionArgument(conf.silent, "silent",
 			"No output on the console.");
 
+	api.addOptionArgument(conf.benchmark, "benchmark",
+			"Log elapsed time, codelength and peak memory at each stage to a .tsv file in the output directory.", true);
+
 	api.parseArgs(flags);
 
 	conf.parsedArgs = flags;
@@ -348,7 +384,7 @@ void initBenchmark(const Config& conf, const std::string& flags)
 	std::ostringstream logInfo;
 	logInfo << "#benchmark for '" << flags << "'";
 	Logger::benchmark(logInfo.str(), 0, 0, 0, 0, true);
-	Logger::benchmark("elapsedSeconds\ttag\tcodelength\tnumTopModules\tnumNonTrivialTopModules\ttreeDepth",
+	Logger::benchmark("elapsedSeconds\ttag\tcodelength\tnumTopModules\tnumNonTrivialTopModules\ttreeDepth\tpeakMemoryMB",
 			0, 0, 0, 0, true);
 	// (todo: fix problem with initializing same static file from different functions to simplify above)
 	Log() << "(Writing benchmark log to '" << logFilename << "'...)\n";
@@ -0,0 +1,152 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#include "Adjacency.h"
+#include "Node.h"
+#include <algorithm>
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+void Adjacency::build(const std::vector<NodeBase*>& nodes)
+{
+	unsigned int numNodes = nodes.size();
+	m_outOffsets.assign(numNodes + 1, 0);
+	m_inOffsets.assign(numNodes + 1, 0);
+	m_selfLinkFlow.assign(numNodes, -1.0);
+
+	unsigned int numOutLinks = 0;
+	unsigned int numInLinks = 0;
+	for (unsigned int i = 0; i < numNodes; ++i)
+	{
+		NodeBase& node = *nodes[i];
+		for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), endIt(node.end_outEdge());
+				edgeIt != endIt; ++edgeIt)
+		{
+			if (!(*edgeIt)->isSelfPointing())
+				++numOutLinks;
+		}
+		for (NodeBase::edge_iterator edgeIt(node.begin_inEdge()), endIt(node.end_inEdge());
+				edgeIt != endIt; ++edgeIt)
+		{
+			if (!(*edgeIt)->isSelfPointing())
+				++numInLinks;
+		}
+		m_outOffsets[i + 1] = numOutLinks;
+		m_inOffsets[i + 1] = numInLinks;
+	}
+
+	m_outNeighbours.resize(numOutLinks);
+	m_outFlow.resize(numOutLinks);
+	m_inNeighbours.resize(numInLinks);
+	m_inFlow.resize(numInLinks);
+
+	// Keep the edge order of each node to get the same module links as from the edges
+	unsigned int outLink = 0;
+	unsigned int inLink = 0;
+	for (unsigned int i = 0; i < numNodes; ++i)
+	{
+		NodeBase& node = *nodes[i];
+		for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), endIt(node.end_outEdge());
+				edgeIt != endIt; ++edgeIt)
+		{
+			NodeBase::EdgeType& edge = **edgeIt;
+			if (edge.isSelfPointing())
+			{
+				m_selfLinkFlow[i] = std::max(m_selfLinkFlow[i], 0.0) + edge.data.flow;
+				continue;
+			}
+			m_outNeighbours[outLink] = edge.target.index;
+			m_outFlow[outLink] = edge.data.flow;
+			++outLink;
+		}
+		for (NodeBase::edge_iterator edgeIt(node.begin_inEdge()), endIt(node.end_inEdge());
+				edgeIt != endIt; ++edgeIt)
+		{
+			NodeBase::EdgeType& edge = **edgeIt;
+			if (edge.isSelfPointing())
+				continue;
+			m_inNeighbours[inLink] = edge.source.index;
+			m_inFlow[inLink] = edge.data.flow;
+			++inLink;
+		}
+	}
+}
+
+void Adjacency::beginLinks(unsigned int numNodes, unsigned int maxNumLinks)
+{
+	m_outOffsets.assign(numNodes + 1, 0);
+	m_inOffsets.assign(numNodes + 1, 0);
+	m_selfLinkFlow.assign(numNodes, -1.0);
+	m_outNeighbours.clear();
+	m_outFlow.clear();
+	m_outNeighbours.reserve(maxNumLinks);
+	m_outFlow.reserve(maxNumLinks);
+	m_lastSource = 0;
+}
+
+void Adjacency::endLinks()
+{
+	unsigned int numNodes = m_selfLinkFlow.size();
+	unsigned int numLinks = m_outNeighbours.size();
+	for (; m_lastSource < numNodes; ++m_lastSource)
+		m_outOffsets[m_lastSource + 1] = numLinks;
+	for (unsigned int i = 0; i < numNodes; ++i)
+		m_inOffsets[i + 1] += m_inOffsets[i];
+
+	m_inNeighbours.resize(numLinks);
+	m_inFlow.resize(numLinks);
+
+	// Placing the out-links in source order keeps the in-links of each node in the order added edges would have
+	std::vector<unsigned int> inLink(m_inOffsets.begin(), m_inOffsets.end() - 1);
+	for (unsigned int source = 0; source < numNodes; ++source)
+	{
+		for (unsigned int out = m_outOffsets[source], endOut = m_outOffsets[source + 1]; out != endOut; ++out)
+		{
+			unsigned int in = inLink[m_outNeighbours[out]]++;
+			m_inNeighbours[in] = source;
+			m_inFlow[in] = m_outFlow[out];
+		}
+	}
+}
+
+void Adjacency::clear()
+{
+	std::vector<unsigned int>().swap(m_outOffsets);
+	std::vector<unsigned int>().swap(m_outNeighbours);
+	std::vector<double>().swap(m_outFlow);
+	std::vector<unsigned int>().swap(m_inOffsets);
+	std::vector<unsigned int>().swap(m_inNeighbours);
+	std::vector<double>().swap(m_inFlow);
+	std::vector<double>().swap(m_selfLinkFlow);
+}
+
+#ifdef NS_INFOMAP
+}
+#endif
@@ -0,0 +1,148 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#ifndef ADJACENCY_H_
+#define ADJACENCY_H_
+
+#include <algorithm>
+#include <vector>
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+class NodeBase;
+
+/**
+ * Compressed sparse row (CSR) adjacency of a set of nodes, with the neighbour
+ * positions and link flows stored contiguously for the out- and in-links of
+ * each node. Self-links are left out of the link lists and only recorded per node.
+ *
+ * Used by the core loop to read the links of the active network without
+ * dereferencing the Edge objects owned by the nodes, and as the only link storage
+ * of the leaf nodes of the full first-order network and of sub-network views, which
+ * then have no Edge objects at all (see TreeData::isLeafLinkView). A link takes
+ * about 24 bytes here against about 60 bytes as an Edge object with its pointers
+ * in the edge lists of both nodes.
+ *
+ * @note Memory networks and the variable markov time keep the Edge objects on the
+ * leaf nodes, and the modules always have Edge objects from the consolidation.
+ */
+class Adjacency
+{
+public:
+	Adjacency() : m_lastSource(0) {}
+
+	/**
+	 * Build the adjacency from the edges of the nodes.
+	 * @note The index of each node and its neighbours must hold its position in nodes.
+	 */
+	void build(const std::vector<NodeBase*>& nodes);
+
+	/**
+	 * Start building the adjacency directly from links added with addLink, without
+	 * collecting them first. The out-links are stored as they come, and the in-links
+	 * are placed by endLinks() in the same order as the equivalent edges.
+	 * @param maxNumLinks An upper bound of the number of links, to allocate the out-links once.
+	 */
+	void beginLinks(unsigned int numNodes, unsigned int maxNumLinks);
+
+	/**
+	 * Add a link between node positions.
+	 * @note The links must be added in order of source.
+	 */
+	void addLink(unsigned int source, unsigned int target, double flow)
+	{
+		if (source == target)
+		{
+			m_selfLinkFlow[source] = std::max(m_selfLinkFlow[source], 0.0) + flow;
+			return;
+		}
+		for (; m_lastSource < source; ++m_lastSource)
+			m_outOffsets[m_lastSource + 1] = m_outNeighbours.size();
+		m_outNeighbours.push_back(target);
+		m_outFlow.push_back(flow);
+		++m_inOffsets[target + 1];
+	}
+
+	void endLinks();
+
+	void clear();
+
+	bool empty() const { return m_outOffsets.empty(); }
+
+	unsigned int numNodes() const { return m_outOffsets.empty() ? 0 : m_outOffsets.size() - 1; }
+
+	unsigned int beginOut(unsigned int node) const { return m_outOffsets[node]; }
+	unsigned int endOut(unsigned int node) const { return m_outOffsets[node + 1]; }
+	unsigned int outNeighbour(unsigned int link) const { return m_outNeighbours[link]; }
+	double outFlow(unsigned int link) const { return m_outFlow[link]; }
+
+	unsigned int beginIn(unsigned int node) const { return m_inOffsets[node]; }
+	unsigned int endIn(unsigned int node) const { return m_inOffsets[node + 1]; }
+	unsigned int inNeighbour(unsigned int link) const { return m_inNeighbours[link]; }
+	double inFlow(unsigned int link) const { return m_inFlow[link]; }
+
+	bool hasSelfLink(unsigned int node) const { return m_selfLinkFlow[node] >= 0.0; }
+	double selfLinkFlow(unsigned int node) const { return hasSelfLink(node) ? m_selfLinkFlow[node] : 0.0; }
+
+	/**
+	 * Number of links to other nodes, not counting self-links.
+	 */
+	unsigned int degree(unsigned int node) const
+	{ return endOut(node) - beginOut(node) + endIn(node) - beginIn(node); }
+
+	/**
+	 * True if the node has no out-links, counting self-links as for NodeBase::isDangling().
+	 */
+	bool isDangling(unsigned int node) const
+	{ return beginOut(node) == endOut(node) && !hasSelfLink(node); }
+
+	/**
+	 * True if the node has no links other than possibly a self-link, the same
+	 * condition as the isolated node check on the edges in the core loop.
+	 */
+	bool isIsolated(unsigned int node, bool includeSelfLinks) const
+	{ return degree(node) == 0 && (!hasSelfLink(node) || includeSelfLinks); }
+
+private:
+	std::vector<unsigned int> m_outOffsets;
+	std::vector<unsigned int> m_outNeighbours;
+	std::vector<double> m_outFlow;
+	std::vector<unsigned int> m_inOffsets;
+	std::vector<unsigned int> m_inNeighbours;
+	std::vector<double> m_inFlow;
+	std::vector<double> m_selfLinkFlow; // Negative if no self-link
+	unsigned int m_lastSource; // Source of the last added link while building from links
+};
+
+#ifdef NS_INFOMAP
+}
+#endif
+
+#endif /* ADJACENCY_H_ */
@@ -29,6 +29,7 @@
 #define EDGE_H_
 
 #include <ostream>
+#include "../utils/SlabPool.h"
 
 #ifdef NS_INFOMAP
 namespace infomap
@@ -72,6 +73,26 @@ public:
 	 	data(edge.data)
 	{}
 
+	/**
+	 * Edges are allocated without a pool header, as they are always
+	 * deleted by their source node with destroy().
+	 */
+	static void* operator new(std::size_t size, SlabPool& pool)
+	{
+		return pool.allocateBlock(size);
+	}
+
+	static void operator delete(void* pointer, SlabPool& pool)
+	{
+		pool.deallocateBlock(pointer, sizeof(Edge));
+	}
+
+	static void destroy(Edge* edge, SlabPool& pool)
+	{
+		edge->~Edge();
+		pool.deallocateBlock(edge, sizeof(Edge));
+	}
+
 	node_type& other(node_type& node)
 	{
 		return (node == source) ? target : source;
@@ -91,6 +112,9 @@ public:
 	node_type& source;
 	node_type& target;
 	EdgeData data;
+
+private:
+	static void operator delete(void* pointer); // Not implemented, use destroy()
 };
 
 #ifdef NS_INFOMAP
@@ -0,0 +1,257 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#include "FlowCache.h"
+#include <cstdio>
+#include <iomanip>
+#include <ios>
+#include <sstream>
+#include "../io/SafeFile.h"
+#include "../utils/FileURI.h"
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+namespace
+{
+	const char MAGIC[] = "Infomap flow cache";
+	const unsigned int FORMAT_VERSION = 2;
+
+	/**
+	 * A 64-bit FNV-1a hash.
+	 */
+	class Hash
+	{
+	public:
+		Hash() : m_value(14695981039346656037ULL) {}
+
+		void add(const char* data, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				m_value ^= static_cast<unsigned char>(data[i]);
+				m_value *= 1099511628211ULL;
+			}
+		}
+
+		template<typename T>
+		Hash& operator<<(const T& value)
+		{
+			add(reinterpret_cast<const char*>(&value), sizeof(value));
+			return *this;
+		}
+
+		Hash& operator<<(const std::string& value)
+		{
+			*this << static_cast<unsigned int>(value.size());
+			add(value.data(), value.size());
+			return *this;
+		}
+
+		void addFile(const std::string& filename)
+		{
+			SafeInFile input(filename.c_str(), std::ios::in | std::ios::binary);
+			std::vector<char> buffer(1 << 20);
+			while (input)
+			{
+				input.read(&buffer[0], buffer.size());
+				add(&buffer[0], input.gcount());
+			}
+		}
+
+		unsigned long long value() const { return m_value; }
+
+	private:
+		unsigned long long m_value;
+	};
+
+	template<typename T>
+	void writeVector(std::ostream& out, const std::vector<T>& values)
+	{
+		unsigned int size = values.size();
+		out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		if (size > 0)
+			out.write(reinterpret_cast<const char*>(&values[0]), size * sizeof(T));
+	}
+
+	template<typename T>
+	bool readVector(std::istream& in, std::vector<T>& values)
+	{
+		unsigned int size = 0;
+		in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		if (!in)
+			return false;
+		values.resize(size);
+		if (size > 0)
+			in.read(reinterpret_cast<char*>(&values[0]), size * sizeof(T));
+		return !in.fail();
+	}
+}
+
+FlowCache::FlowCache(const Config& config) :
+	m_key(0),
+	m_numNodes(0),
+	m_numBipartiteNodes(0)
+{
+	Hash hash;
+	hash << FORMAT_VERSION << sizeof(FlowNetwork::Link) << sizeof(StateNode);
+
+	// The input
+	hash.addFile(config.networkFile);
+	for (unsigned int i = 0; i < config.additionalInput.size(); ++i)
+		hash.addFile(config.additionalInput[i]);
+	hash << FileURI(config.networkFile, false).getExtension() << config.inputFormat <<
+			config.withMemory << config.nonBacktracking << config.bipartite << config.skipAdjustBipartiteFlow <<
+			config.bipartiteHyperedges <<
+			config.multiplexAddMissingNodes << config.zeroBasedNodeNumbers << config.includeSelfLinks <<
+			config.ignoreEdgeWeights << config.completeDanglingMemoryNodes << config.nodeLimit <<
+			config.weightThreshold << config.undirectedMultilayer << config.expandUndirectedToDirected <<
+			config.originallyUndirected;
+
+	// The flow
+	hash << config.directed << config.undirdir << config.outdirdir << config.rawdir <<
+			config.recordedTeleportation << config.teleportToNodes << config.teleportationProbability <<
+			config.selfTeleportationProbability << config.flowTolerance << config.getMaxFlowIterations() <<
+			config.flowSolver << config.multiplexRelaxRate << config.multiplexJSRelaxRate <<
+			config.multiplexJSRelaxLimit << config.multiplexRelaxLimit;
+	m_key = hash.value();
+
+	std::ostringstream filename;
+	filename << config.flowCacheDirectory;
+	if (*--config.flowCacheDirectory.end() != '/')
+		filename << "/";
+	filename << FileURI(config.networkFile, false).getName() << "_" << std::hex << std::setw(16) <<
+			std::setfill('0') << m_key << ".flowcache";
+	m_filename = filename.str();
+}
+
+bool FlowCache::read()
+{
+	std::ifstream input(m_filename.c_str(), std::ios::in | std::ios::binary);
+	if (!input)
+		return false;
+
+	char magic[sizeof(MAGIC)];
+	unsigned int version = 0;
+	unsigned long long key = 0;
+	input.read(magic, sizeof(magic));
+	input.read(reinterpret_cast<char*>(&version), sizeof(version));
+	input.read(reinterpret_cast<char*>(&key), sizeof(key));
+	if (!input || std::string(magic, sizeof(magic)) != std::string(MAGIC, sizeof(MAGIC)) ||
+			version != FORMAT_VERSION || key != m_key)
+		return false;
+
+	unsigned int numNodes = 0;
+	unsigned int numBipartiteNodes = 0;
+	input.read(reinterpret_cast<char*>(&numNodes), sizeof(numNodes));
+	input.read(reinterpret_cast<char*>(&numBipartiteNodes), sizeof(numBipartiteNodes));
+
+	// The node names as their lengths followed by their concatenated characters
+	std::vector<unsigned int> nameLengths;
+	std::vector<char> nameData;
+	std::vector<double> nodeFlow;
+	std::vector<double> nodeTeleportRates;
+	FlowNetwork::LinkVec flowLinks;
+	std::vector<StateNode> stateNodes;
+	FlowNetwork::FeatureLinks featureLinks;
+	if (!readVector(input, nameLengths) || !readVector(input, nameData) || !readVector(input, nodeFlow) ||
+			!readVector(input, nodeTeleportRates) || !readVector(input, flowLinks) || !readVector(input, stateNodes) ||
+			!readVector(input, featureLinks.offsets) || !readVector(input, featureLinks.nodes) ||
+			!readVector(input, featureLinks.flow))
+		return false;
+
+	std::vector<std::string> nodeNames(nameLengths.size());
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < nameLengths.size(); ++i)
+	{
+		if (offset + nameLengths[i] > nameData.size())
+			return false;
+		nodeNames[i].assign(nameData.begin() + offset, nameData.begin() + offset + nameLengths[i]);
+		offset += nameLengths[i];
+	}
+
+	m_numNodes = numNodes;
+	m_numBipartiteNodes = numBipartiteNodes;
+	m_nodeNames.swap(nodeNames);
+	m_nodeFlow.swap(nodeFlow);
+	m_nodeTeleportRates.swap(nodeTeleportRates);
+	m_flowLinks.swap(flowLinks);
+	m_stateNodes.swap(stateNodes);
+	m_featureLinks.swap(featureLinks);
+	return true;
+}
+
+bool FlowCache::write(const std::vector<std::string>& nodeNames, unsigned int numNodes, unsigned int numBipartiteNodes,
+		const FlowNetwork& flowNetwork, const std::vector<StateNode>& stateNodes)
+{
+	std::string tmpFilename = m_filename + ".tmp";
+	try
+	{
+		std::vector<unsigned int> nameLengths(nodeNames.size());
+		std::vector<char> nameData;
+		for (unsigned int i = 0; i < nodeNames.size(); ++i)
+		{
+			nameLengths[i] = nodeNames[i].size();
+			nameData.insert(nameData.end(), nodeNames[i].begin(), nodeNames[i].end());
+		}
+
+		{
+			SafeOutFile output(tmpFilename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+			output.write(MAGIC, sizeof(MAGIC));
+			output.write(reinterpret_cast<const char*>(&FORMAT_VERSION), sizeof(FORMAT_VERSION));
+			output.write(reinterpret_cast<const char*>(&m_key), sizeof(m_key));
+			output.write(reinterpret_cast<const char*>(&numNodes), sizeof(numNodes));
+			output.write(reinterpret_cast<const char*>(&numBipartiteNodes), sizeof(numBipartiteNodes));
+			writeVector(output, nameLengths);
+			writeVector(output, nameData);
+			writeVector(output, flowNetwork.getNodeFlow());
+			writeVector(output, flowNetwork.getNodeTeleportRates());
+			writeVector(output, flowNetwork.getFlowLinks());
+			writeVector(output, stateNodes);
+			writeVector(output, flowNetwork.getFeatureLinks().offsets);
+			writeVector(output, flowNetwork.getFeatureLinks().nodes);
+			writeVector(output, flowNetwork.getFeatureLinks().flow);
+			if (output.fail())
+				throw FileOpenError(io::Str() << "Error writing the flow cache '" << tmpFilename << "'.");
+		}
+		if (std::rename(tmpFilename.c_str(), m_filename.c_str()) != 0)
+			throw FileOpenError(io::Str() << "Error moving the flow cache '" << tmpFilename << "' to '" << m_filename << "'.");
+	}
+	catch (std::exception& err)
+	{
+		std::remove(tmpFilename.c_str());
+		m_writeError = err.what();
+		return false;
+	}
+	return true;
+}
+
+#ifdef NS_INFOMAP
+}
+#endif
@@ -0,0 +1,100 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#ifndef FLOWCACHE_H_
+#define FLOWCACHE_H_
+
+#include <string>
+#include <vector>
+#include "FlowNetwork.h"
+#include "Node.h"
+#include "../io/Config.h"
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+/**
+ * A binary file cache of the flow network, keyed by the content of the input files
+ * and the options that the parsing and the flow calculation depend on, so that reruns
+ * with other search or output options can skip both.
+ *
+ * The markov time is applied on the cached flow, so it is not part of the key.
+ */
+class FlowCache
+{
+public:
+	FlowCache(const Config& config);
+
+	/**
+	 * Read the flow network cached for the input and the options.
+	 * @return true if found, else false and the cache is unchanged
+	 */
+	bool read();
+
+	/**
+	 * Write the flow network to the cache, through a temporary file, so that another
+	 * process never reads a partially written cache.
+	 * @param numNodes the number of (physical) nodes
+	 * @param stateNodes the state nodes for a memory network, else empty
+	 * @return true if written, else false with the reason in writeError()
+	 */
+	bool write(const std::vector<std::string>& nodeNames, unsigned int numNodes, unsigned int numBipartiteNodes,
+			const FlowNetwork& flowNetwork, const std::vector<StateNode>& stateNodes);
+
+	const std::string& filename() const { return m_filename; }
+	const std::string& writeError() const { return m_writeError; }
+
+	unsigned int numNodes() const { return m_numNodes; }
+	unsigned int numBipartiteNodes() const { return m_numBipartiteNodes; }
+	std::vector<std::string>& nodeNames() { return m_nodeNames; }
+	const std::vector<double>& nodeFlow() const { return m_nodeFlow; }
+	const std::vector<double>& nodeTeleportRates() const { return m_nodeTeleportRates; }
+	const FlowNetwork::LinkVec& flowLinks() const { return m_flowLinks; }
+	const std::vector<StateNode>& stateNodes() const { return m_stateNodes; }
+	FlowNetwork::FeatureLinks& featureLinks() { return m_featureLinks; }
+
+private:
+	std::string m_filename;
+	std::string m_writeError;
+	unsigned long long m_key;
+	unsigned int m_numNodes;
+	unsigned int m_numBipartiteNodes;
+	std::vector<std::string> m_nodeNames;
+	std::vector<double> m_nodeFlow;
+	std::vector<double> m_nodeTeleportRates;
+	FlowNetwork::LinkVec m_flowLinks;
+	std::vector<StateNode> m_stateNodes;
+	FlowNetwork::FeatureLinks m_featureLinks;
+};
+
+#ifdef NS_INFOMAP
+}
+#endif
+
+#endif /* FLOWCACHE_H_ */
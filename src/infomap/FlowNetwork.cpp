@@ -28,17 +28,94 @@
 #include "FlowNetwork.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include "../utils/Logger.h"
+#include "../io/convert.h"
 
 #ifdef NS_INFOMAP
 namespace infomap
 {
 #endif
 
+namespace
+{
+	// The parallel loops run over fixed blocks and sum within each block first, so that
+	// the sums, and thereby the flow, don't depend on the number of threads.
+	const unsigned int BLOCK_SIZE = 4096;
+
+	// The most pairwise links per bipartite link that the feature nodes are projected to,
+	// above which they are kept as nodes, see FlowNetwork::projectBipartiteFlow.
+	const unsigned long long MAX_PROJECTED_PAIRS_PER_LINK = 4;
+
+	int numBlocks(unsigned int size)
+	{
+		return static_cast<int>((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	}
+
+	struct LessSourceTarget
+	{
+		bool operator()(const FlowNetwork::Link& a, const FlowNetwork::Link& b) const
+		{
+			return a.source < b.source || (a.source == b.source && a.target < b.target);
+		}
+	};
+
+	double sumOfBlocks(const std::vector<double>& blockSums)
+	{
+		double sum = 0.0;
+		for (unsigned int i = 0; i < blockSums.size(); ++i)
+			sum += blockSums[i];
+		return sum;
+	}
+
+	/**
+	 * Extrapolate each node flow from the last three iterates with Aitken's delta-squared method,
+	 * where the iterates converge monotonically, and normalize the flow.
+	 */
+	void extrapolateAitken(std::vector<double>& nodeFlow, const std::vector<double>& nodeFlowPrev1,
+			const std::vector<double>& nodeFlowPrev2)
+	{
+		unsigned int numNodes = nodeFlow.size();
+		int numNodeBlocks = numBlocks(numNodes);
+		std::vector<double> blockSums(numNodeBlocks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int block = 0; block < numNodeBlocks; ++block)
+		{
+			unsigned int end = std::min(numNodes, (block + 1) * BLOCK_SIZE);
+			double sum = 0.0;
+			for (unsigned int i = block * BLOCK_SIZE; i < end; ++i)
+			{
+				double step = nodeFlow[i] - nodeFlowPrev1[i];
+				double prevStep = nodeFlowPrev1[i] - nodeFlowPrev2[i];
+				// Only where the steps shrink in the same direction
+				if (step * prevStep > 0.0 && std::abs(step) < std::abs(prevStep))
+				{
+					double flow = nodeFlow[i] - step * step / (step - prevStep);
+					if (flow > 0.0)
+						nodeFlow[i] = flow;
+				}
+				sum += nodeFlow[i];
+			}
+			blockSums[block] = sum;
+		}
+		double sum = sumOfBlocks(blockSums);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int i = 0; i < static_cast<int>(numNodes); ++i)
+			nodeFlow[i] /= sum;
+	}
+}
+
 void FlowNetwork::calculateFlow(const Network& network, const Config& config)
 {
 	Log() << "Calculating global flow... " << std::flush;
 
+	if (network.isBipartite() && config.bipartiteHyperedges && !config.isUndirected())
+		throw InputDomainError("The feature nodes of a bipartite network can only be taken as hyperedges with undirected flow.");
+
 	// Prepare data in sequence containers for fast access of individual elements
 	unsigned int numNodes = network.numNodes();
 	const std::vector<double>& nodeOutDegree = network.outDegree();
@@ -46,28 +123,23 @@ void FlowNetwork::calculateFlow(const Network& network, const Config& config)
 	m_nodeFlow.assign(numNodes, 0.0);
 	m_nodeTeleportRates.assign(numNodes, 0.0);
 
-	const LinkMap& linkMap = network.linkMap();
-	unsigned int numLinks = network.numLinks();
+	const Network::LinkVec& networkLinks = network.links();
+	unsigned int numLinks = networkLinks.size();
 	m_flowLinks.resize(numLinks);
 	double totalLinkWeight = network.totalLinkWeight();
 	double sumUndirLinkWeight = 2 * totalLinkWeight - network.totalSelfLinkWeight();
-	unsigned int linkIndex = 0;
 
-	for (LinkMap::const_iterator linkIt(linkMap.begin()); linkIt != linkMap.end(); ++linkIt)
+	for (unsigned int linkIndex = 0; linkIndex < numLinks; ++linkIndex)
 	{
-		unsigned int linkEnd1 = linkIt->first;
-		const std::map<unsigned int, double>& subLinks = linkIt->second;
-		for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt, ++linkIndex)
-		{
-			unsigned int linkEnd2 = subIt->first;
-			double linkWeight = subIt->second;
+		unsigned int linkEnd1 = networkLinks[linkIndex].n1;
+		unsigned int linkEnd2 = networkLinks[linkIndex].n2;
+		double linkWeight = networkLinks[linkIndex].weight;
 
-			m_nodeFlow[linkEnd1] += linkWeight / sumUndirLinkWeight;
-			m_flowLinks[linkIndex] = Link(linkEnd1, linkEnd2, linkWeight);
+		m_nodeFlow[linkEnd1] += linkWeight / sumUndirLinkWeight;
+		m_flowLinks[linkIndex] = Link(linkEnd1, linkEnd2, linkWeight);
 
-			if (linkEnd1 != linkEnd2 && !config.outdirdir)
-				m_nodeFlow[linkEnd2] += linkWeight / sumUndirLinkWeight;
-		}
+		if (linkEnd1 != linkEnd2 && !config.outdirdir)
+			m_nodeFlow[linkEnd2] += linkWeight / sumUndirLinkWeight;
 	}
 
 	if (config.rawdir)
@@ -173,53 +245,213 @@ void FlowNetwork::calculateFlow(const Network& network, const Config& config)
 	}
 
 	// Calculate PageRank
+	TransposedLinks inLinks(numNodes, m_flowLinks);
 	std::vector<double> nodeFlowTmp(numNodes, 0.0);
-	unsigned int numIterations = 0;
 	double alpha = config.teleportationProbability;
-	double beta = 1.0 - alpha;
-	double sqdiff = 1.0;
 	double danglingRank = 0.0;
-	do
+	double residual = 0.0;
+	unsigned int numIterations = solvePageRank(inLinks, danglings, config, m_nodeFlow, nodeFlowTmp,
+			danglingRank, alpha, residual);
+	updateFlowFromPageRank(inLinks, nodeFlowTmp, danglingRank, alpha, config);
+
+	Log() << "\n  -> PageRank calculation done in " << numIterations << " " << config.flowSolver <<
+			" iterations with residual " << residual << "." << std::endl;
+	finalize(network, config);
+}
+
+void FlowNetwork::updateFlowFromPageRank(const TransposedLinks& inLinks, const std::vector<double>& nodeFlowTmp,
+		double danglingRank, double alpha, const Config& config)
+{
+	unsigned int numNodes = m_nodeFlow.size();
+	unsigned int numLinks = m_flowLinks.size();
+	double beta = 1.0 - alpha;
+	double sumNodeRank = 1.0;
+
+	if (!config.recordedTeleportation)
 	{
-		// Calculate dangling rank
+		//Take one last power iteration excluding the teleportation (and normalize node flow to sum 1.0)
+		sumNodeRank = 1.0 - danglingRank;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int i = 0; i < static_cast<int>(numNodes); ++i)
+		{
+			double flow = 0.0;
+			for (unsigned int j = inLinks.offsets[i]; j < inLinks.offsets[i + 1]; ++j)
+				flow += inLinks.flow[j] * nodeFlowTmp[inLinks.sources[j]] / sumNodeRank;
+			m_nodeFlow[i] = flow;
+		}
+		beta = 1.0;
+	}
+
+	// Update the links with their global flow from the PageRank values. (Note: beta is set to 1 if unrec)
+	int numLinkBlocks = numBlocks(numLinks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int block = 0; block < numLinkBlocks; ++block)
+	{
+		unsigned int end = std::min(numLinks, (block + 1) * BLOCK_SIZE);
+		for (unsigned int i = block * BLOCK_SIZE; i < end; ++i)
+		{
+			Link& link = m_flowLinks[i];
+			link.flow *= beta * nodeFlowTmp[link.source] / sumNodeRank;
+		}
+	}
+}
+
+FlowNetwork::TransposedLinks::TransposedLinks(unsigned int numNodes, const LinkVec& links) :
+	offsets(numNodes + 1, 0),
+	sources(links.size()),
+	flow(links.size())
+{
+	for (LinkVec::const_iterator linkIt(links.begin()); linkIt != links.end(); ++linkIt)
+		++offsets[linkIt->target + 1];
+	for (unsigned int i = 0; i < numNodes; ++i)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<unsigned int> position(offsets.begin(), offsets.end() - 1);
+	for (LinkVec::const_iterator linkIt(links.begin()); linkIt != links.end(); ++linkIt)
+	{
+		unsigned int j = position[linkIt->target]++;
+		sources[j] = linkIt->source;
+		flow[j] = linkIt->flow;
+	}
+}
+
+unsigned int FlowNetwork::solvePageRank(const TransposedLinks& inLinks, const std::vector<unsigned int>& danglings,
+		const Config& config, std::vector<double>& nodeFlow, std::vector<double>& nodeFlowTmp,
+		double& danglingRank, double& alpha, double& residual)
+{
+	// To record the iterations saved by the other solvers, count the power iterations from the same start
+	unsigned int numPowerIterations = 0;
+	if (config.benchmark && config.flowSolver != "power")
+	{
+		std::vector<double> powerNodeFlow(nodeFlow);
+		std::vector<double> powerNodeFlowTmp(nodeFlowTmp);
+		double powerDanglingRank = danglingRank;
+		double powerAlpha = alpha;
+		double powerResidual = 0.0;
+		numPowerIterations = runPowerIteration(inLinks, danglings, config, powerNodeFlow, powerNodeFlowTmp,
+				powerDanglingRank, powerAlpha, powerResidual);
+	}
+
+	unsigned int numIterations = 0;
+	if (config.flowSolver == "power")
+		numIterations = runPowerIteration(inLinks, danglings, config, nodeFlow, nodeFlowTmp, danglingRank, alpha,
+				residual);
+	else
+	{
+		if (config.flowSolver == "aitken")
+			numIterations = runPowerIteration(inLinks, danglings, config, nodeFlow, nodeFlowTmp, danglingRank, alpha,
+					residual, 10);
+		else if (config.flowSolver == "gauss-seidel")
+			numIterations = runGaussSeidel(inLinks, danglings, config, nodeFlow, alpha, residual);
+		else
+			throw InputDomainError(io::Str() << "Unknown flow solver '" << config.flowSolver <<
+					"', should be 'power', 'gauss-seidel' or 'aitken'.");
+
+		// The flow has converged, so take it as the flow both before and after the last iteration
+		nodeFlowTmp = nodeFlow;
 		danglingRank = 0.0;
 		for (unsigned int i = 0; i < danglings.size(); ++i)
+			danglingRank += nodeFlow[danglings[i]];
+	}
+
+	if (config.benchmark)
+	{
+		if (config.flowSolver == "power")
+			numPowerIterations = numIterations;
+		Logger::benchmarkFields("flow", io::Str() << "solver=" << config.flowSolver << "\titerations=" << numIterations <<
+				"\tresidual=" << residual << "\tpowerIterations=" << numPowerIterations <<
+				"\tsavedIterations=" << static_cast<int>(numPowerIterations) - static_cast<int>(numIterations));
+	}
+	return numIterations;
+}
+
+unsigned int FlowNetwork::runPowerIteration(const TransposedLinks& inLinks, const std::vector<unsigned int>& danglings,
+		const Config& config, std::vector<double>& nodeFlow, std::vector<double>& nodeFlowTmp,
+		double& danglingRank, double& alpha, double& residual, unsigned int extrapolationInterval)
+{
+	unsigned int numNodes = nodeFlow.size();
+	int numNodeBlocks = numBlocks(numNodes);
+	int numDanglingBlocks = numBlocks(danglings.size());
+	std::vector<double> blockSums(std::max(numNodeBlocks, numDanglingBlocks));
+	std::vector<double> blockDiffs(numNodeBlocks);
+	// The two previous iterates, for the extrapolation
+	std::vector<double> nodeFlowPrev1, nodeFlowPrev2;
+	unsigned int minIterations = extrapolationInterval == 0 ? 50 : 0;
+	unsigned int numIterations = 0;
+	double beta = 1.0 - alpha;
+	double sqdiff = 1.0;
+	do
+	{
+		if (extrapolationInterval > 0)
 		{
-			danglingRank += m_nodeFlow[danglings[i]];
+			nodeFlowPrev2.swap(nodeFlowPrev1);
+			nodeFlowPrev1 = nodeFlow;
 		}
 
-		// Flow from teleportation
-		for (unsigned int i = 0; i < numNodes; ++i)
+		// Calculate dangling rank
+		blockSums.assign(numDanglingBlocks, 0.0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int block = 0; block < numDanglingBlocks; ++block)
 		{
-			nodeFlowTmp[i] = (alpha + beta*danglingRank) * m_nodeTeleportRates[i];
+			unsigned int end = std::min(static_cast<unsigned int>(danglings.size()), (block + 1) * BLOCK_SIZE);
+			double sum = 0.0;
+			for (unsigned int i = block * BLOCK_SIZE; i < end; ++i)
+				sum += nodeFlow[danglings[i]];
+			blockSums[block] = sum;
 		}
+		danglingRank = sumOfBlocks(blockSums);
 
-		// Flow from links
-		for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
+		// Flow from teleportation and links
+		double teleportFlow = alpha + beta*danglingRank;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int i = 0; i < static_cast<int>(numNodes); ++i)
 		{
-			Link& link = *linkIt;
-			nodeFlowTmp[link.target] += beta * link.flow * m_nodeFlow[link.source];
+			double flow = teleportFlow * m_nodeTeleportRates[i];
+			for (unsigned int j = inLinks.offsets[i]; j < inLinks.offsets[i + 1]; ++j)
+				flow += beta * inLinks.flow[j] * nodeFlow[inLinks.sources[j]];
+			nodeFlowTmp[i] = flow;
 		}
 
 		// Update node flow from the power iteration above and check if converged
-		double sum = 0.0;
-		double sqdiff_old = sqdiff;
-		sqdiff = 0.0;
-		for (unsigned int i = 0; i < numNodes; ++i)
+		blockSums.assign(numNodeBlocks, 0.0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int block = 0; block < numNodeBlocks; ++block)
 		{
-			sum += nodeFlowTmp[i];
-			sqdiff += std::abs(nodeFlowTmp[i] - m_nodeFlow[i]);
-			m_nodeFlow[i] = nodeFlowTmp[i];
+			unsigned int end = std::min(numNodes, (block + 1) * BLOCK_SIZE);
+			double sum = 0.0;
+			double diff = 0.0;
+			for (unsigned int i = block * BLOCK_SIZE; i < end; ++i)
+			{
+				sum += nodeFlowTmp[i];
+				diff += std::abs(nodeFlowTmp[i] - nodeFlow[i]);
+				nodeFlow[i] = nodeFlowTmp[i];
+			}
+			blockSums[block] = sum;
+			blockDiffs[block] = diff;
 		}
+		double sum = sumOfBlocks(blockSums);
+		double sqdiff_old = sqdiff;
+		sqdiff = sumOfBlocks(blockDiffs);
 
 		// Normalize if needed
 		if (std::abs(sum - 1.0) > 1.0e-10)
 		{
 			Log() << "(Normalizing ranks after " <<	numIterations << " power iterations with error " << (sum-1.0) << ") ";
-			for (unsigned int i = 0; i < numNodes; ++i)
-			{
-				m_nodeFlow[i] /= sum;
-			}
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+			for (int i = 0; i < static_cast<int>(numNodes); ++i)
+				nodeFlow[i] /= sum;
 		}
 
 		// Perturb the system if equilibrium
@@ -230,36 +462,77 @@ void FlowNetwork::calculateFlow(const Network& network, const Config& config)
 		}
 
 		numIterations++;
-	}  while((numIterations < 200) && (sqdiff > 1.0e-15 || numIterations < 50));
 
-	double sumNodeRank = 1.0;
+		if (extrapolationInterval > 0 && numIterations % extrapolationInterval == 0 && numIterations >= 3 &&
+				sqdiff > config.flowTolerance)
+			extrapolateAitken(nodeFlow, nodeFlowPrev1, nodeFlowPrev2);
 
-	if (!config.recordedTeleportation)
+		Log(3) << "\n    Iteration " << numIterations << ": residual " << sqdiff;
+	}  while((numIterations < config.getMaxFlowIterations()) && (sqdiff > config.flowTolerance ||
+			numIterations < minIterations));
+
+	residual = sqdiff;
+	return numIterations;
+}
+
+unsigned int FlowNetwork::runGaussSeidel(const TransposedLinks& inLinks, const std::vector<unsigned int>& danglings,
+		const Config& config, std::vector<double>& nodeFlow, double alpha, double& residual)
+{
+	unsigned int numNodes = nodeFlow.size();
+	int numNodeBlocks = numBlocks(numNodes);
+	std::vector<double> blockDiffs(numNodeBlocks);
+	std::vector<double> prevFlow;
+	double beta = 1.0 - alpha;
+	unsigned int numIterations = 0;
+	do
 	{
-		//Take one last power iteration excluding the teleportation (and normalize node flow to sum 1.0)
-		sumNodeRank = 1.0 - danglingRank;
-		m_nodeFlow.assign(numNodes, 0.0);
-		for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
+		prevFlow = nodeFlow;
+		double danglingRank = 0.0;
+		for (unsigned int i = 0; i < danglings.size(); ++i)
+			danglingRank += nodeFlow[danglings[i]];
+		double teleportFlow = alpha + beta*danglingRank;
+
+		// Sweep in place, so each node reads the flow of the nodes before it from this sweep
+		double sum = 0.0;
+		for (unsigned int i = 0; i < numNodes; ++i)
 		{
-			Link& link = *linkIt;
-			m_nodeFlow[link.target] += link.flow * nodeFlowTmp[link.source] / sumNodeRank;
+			double flow = teleportFlow * m_nodeTeleportRates[i];
+			for (unsigned int j = inLinks.offsets[i]; j < inLinks.offsets[i + 1]; ++j)
+				flow += beta * inLinks.flow[j] * nodeFlow[inLinks.sources[j]];
+			nodeFlow[i] = flow;
+			sum += flow;
 		}
-		beta = 1.0;
-	}
 
+		// Normalize if needed, as for the power iteration, and sum the change
+		double scale = std::abs(sum - 1.0) > 1.0e-10 ? 1.0 / sum : 1.0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int block = 0; block < numNodeBlocks; ++block)
+		{
+			unsigned int end = std::min(numNodes, (block + 1) * BLOCK_SIZE);
+			double diff = 0.0;
+			for (unsigned int i = block * BLOCK_SIZE; i < end; ++i)
+			{
+				nodeFlow[i] *= scale;
+				diff += std::abs(nodeFlow[i] - prevFlow[i]);
+			}
+			blockDiffs[block] = diff;
+		}
+		residual = sumOfBlocks(blockDiffs);
 
-	// Update the links with their global flow from the PageRank values. (Note: beta is set to 1 if unrec)
-	for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
-	{
-		linkIt->flow *= beta * nodeFlowTmp[linkIt->source] / sumNodeRank;
-	}
+		numIterations++;
+		Log(3) << "\n    Iteration " << numIterations << ": residual " << residual;
+	} while (numIterations < config.getMaxFlowIterations() && residual > config.flowTolerance);
 
-	Log() << "\n  -> PageRank calculation done in " << numIterations << " iterations." << std::endl;
-	finalize(network, config);
+	return numIterations;
 }
 
 void FlowNetwork::finalize(const Network& network, const Config& config, bool normalizeNodeFlow)
 {
+	if (network.isBipartite() && config.bipartiteHyperedges && projectBipartiteFlow(network))
+		return;
+
 	// TODO: Skip bipartite flow adjustment for directed / rawdir / .. ?
 	if (network.isBipartite() && !config.skipAdjustBipartiteFlow)
 	{
@@ -294,6 +567,102 @@ void FlowNetwork::finalize(const Network& network, const Config& config, bool no
 	}
 }
 
+bool FlowNetwork::projectBipartiteFlow(const Network& network)
+{
+	unsigned int numOrdinaryNodes = network.numNodes() - network.numBipartiteNodes();
+	unsigned int numFeatureNodes = network.numBipartiteNodes();
+
+	// Group the links on feature node, each link has one ordinary node and one feature node
+	FeatureLinks featureLinks;
+	featureLinks.offsets.assign(numFeatureNodes + 1, 0);
+	for (LinkVec::const_iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
+		++featureLinks.offsets[std::max(linkIt->source, linkIt->target) - numOrdinaryNodes + 1];
+	for (unsigned int i = 0; i < numFeatureNodes; ++i)
+		featureLinks.offsets[i + 1] += featureLinks.offsets[i];
+	featureLinks.nodes.resize(m_flowLinks.size());
+	featureLinks.flow.resize(m_flowLinks.size());
+
+	// Each feature node of degree d expands to d(d - 1) / 2 pairs, so a few feature nodes of
+	// high degree can make the projection far larger than the bipartite network.
+	unsigned long long numPairs = 0;
+	for (unsigned int i = 0; i < numFeatureNodes; ++i)
+	{
+		unsigned long long degree = featureLinks.offsets[i + 1] - featureLinks.offsets[i];
+		numPairs += degree * (degree - (degree > 0 ? 1 : 0)) / 2;
+	}
+	if (numPairs > MAX_PROJECTED_PAIRS_PER_LINK * m_flowLinks.size())
+	{
+		Log() << "  -> Warning: Projecting the feature nodes as hyperedges would give " << numPairs <<
+				" pairwise links from " << m_flowLinks.size() << " bipartite links. Keeping the feature nodes as nodes instead.\n";
+		return false;
+	}
+
+	std::vector<unsigned int> position(featureLinks.offsets.begin(), featureLinks.offsets.end() - 1);
+	std::vector<double> nodeFlow(numOrdinaryNodes, 0.0);
+	double sumFlow = 0.0;
+	for (LinkVec::const_iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
+	{
+		unsigned int node = std::min(linkIt->source, linkIt->target);
+		unsigned int j = position[std::max(linkIt->source, linkIt->target) - numOrdinaryNodes]++;
+		featureLinks.nodes[j] = node;
+		featureLinks.flow[j] = linkIt->flow;
+		nodeFlow[node] += linkIt->flow;
+		sumFlow += linkIt->flow;
+	}
+
+	// The flow between each pair of ordinary nodes of each feature node, in each direction.
+	// The flow back to the same node stays in the node flow as a self-link.
+	LinkVec pairLinks;
+	for (unsigned int i = 0; i < numFeatureNodes; ++i)
+	{
+		unsigned int begin = featureLinks.offsets[i];
+		unsigned int end = featureLinks.offsets[i + 1];
+		double featureFlow = 0.0;
+		for (unsigned int j = begin; j < end; ++j)
+			featureFlow += featureLinks.flow[j];
+		for (unsigned int j = begin; j < end; ++j)
+		{
+			for (unsigned int k = j + 1; k < end; ++k)
+			{
+				unsigned int source = featureLinks.nodes[j];
+				unsigned int target = featureLinks.nodes[k];
+				if (source == target)
+					continue;
+				if (target < source)
+					std::swap(source, target);
+				double flow = featureLinks.flow[j] * featureLinks.flow[k] / featureFlow / sumFlow;
+				pairLinks.push_back(Link(source, target, flow));
+			}
+		}
+	}
+
+	// Aggregate the pairs from different feature nodes
+	std::sort(pairLinks.begin(), pairLinks.end(), LessSourceTarget());
+	LinkVec flowLinks;
+	for (LinkVec::const_iterator linkIt(pairLinks.begin()); linkIt != pairLinks.end(); ++linkIt)
+	{
+		if (!flowLinks.empty() && flowLinks.back().source == linkIt->source && flowLinks.back().target == linkIt->target)
+		{
+			flowLinks.back().weight += linkIt->weight;
+			flowLinks.back().flow += linkIt->flow;
+		}
+		else
+			flowLinks.push_back(*linkIt);
+	}
+
+	for (unsigned int i = 0; i < numOrdinaryNodes; ++i)
+		nodeFlow[i] /= sumFlow;
+
+	Log() << "  -> Projected " << numFeatureNodes << " feature nodes to " << flowLinks.size() <<
+			" links between " << numOrdinaryNodes << " ordinary nodes." << std::endl;
+
+	m_nodeFlow.swap(nodeFlow);
+	m_nodeTeleportRates.resize(numOrdinaryNodes);
+	m_flowLinks.swap(flowLinks);
+	m_featureLinks.swap(featureLinks);
+	return true;
+}
+
 #ifdef NS_INFOMAP
 }
 #endif
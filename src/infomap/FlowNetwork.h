@@ -63,9 +63,28 @@ public:
 		double flow;
 	};
 
-	typedef Network::LinkMap										LinkMap;
 	typedef std::vector<Link>										LinkVec;
 
+	/**
+	 * The links of the feature nodes of a bipartite network, grouped on feature node,
+	 * kept when the feature nodes are projected out of the flow network.
+	 */
+	struct FeatureLinks
+	{
+		std::vector<unsigned int> offsets; // The links of feature node i are in [offsets[i], offsets[i + 1])
+		std::vector<unsigned int> nodes; // The ordinary node of each link
+		std::vector<double> flow;
+
+		unsigned int numFeatureNodes() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+		void swap(FeatureLinks& other)
+		{
+			offsets.swap(other.offsets);
+			nodes.swap(other.nodes);
+			flow.swap(other.flow);
+		}
+	};
+
 	FlowNetwork() {}
 	virtual ~FlowNetwork() {}
 
@@ -74,14 +93,80 @@ public:
 	const std::vector<double>& getNodeFlow() const { return m_nodeFlow; }
 	const std::vector<double>& getNodeTeleportRates() const { return m_nodeTeleportRates; }
 	const LinkVec& getFlowLinks() const { return m_flowLinks; }
+	FeatureLinks& getFeatureLinks() { return m_featureLinks; }
+	const FeatureLinks& getFeatureLinks() const { return m_featureLinks; }
 
 protected:
+	/**
+	 * The links grouped on target node, in the order of the link vector within each group,
+	 * so that each node can pull its incoming flow independently of the other nodes.
+	 */
+	struct TransposedLinks
+	{
+		TransposedLinks(unsigned int numNodes, const LinkVec& links);
+		std::vector<unsigned int> offsets; // The in-links of node i are in [offsets[i], offsets[i + 1])
+		std::vector<unsigned int> sources;
+		std::vector<double> flow; // The link flow per unit of source node flow
+	};
+
+	/**
+	 * Calculate the PageRank with teleportation using the configured flow solver, until the sum
+	 * of absolute changes in node flow is below the configured tolerance.
+	 * @param nodeFlow the initial node flow, set to the normalized flow after the last iteration
+	 * @param nodeFlowTmp set to the flow after the last iteration before normalization
+	 * @param danglingRank set to the flow on the dangling nodes before the last iteration
+	 * @param alpha the teleportation probability, perturbed if the power iteration cycles
+	 * @param residual set to the sum of absolute changes in the last iteration
+	 * With --benchmark, logs the iterations and the residual, and for other solvers than the
+	 * power iteration, the iterations saved compared to a power iteration from the same start.
+	 * @return the number of iterations
+	 */
+	unsigned int solvePageRank(const TransposedLinks& inLinks, const std::vector<unsigned int>& danglings,
+			const Config& config, std::vector<double>& nodeFlow, std::vector<double>& nodeFlowTmp,
+			double& danglingRank, double& alpha, double& residual);
+
+	/**
+	 * Run the power iteration, with the nodes updated in parallel. If the extrapolation interval
+	 * is non-zero, the flow is extrapolated with Aitken's delta-squared method from the last
+	 * three iterates at that interval.
+	 */
+	unsigned int runPowerIteration(const TransposedLinks& inLinks, const std::vector<unsigned int>& danglings,
+			const Config& config, std::vector<double>& nodeFlow, std::vector<double>& nodeFlowTmp,
+			double& danglingRank, double& alpha, double& residual, unsigned int extrapolationInterval = 0);
+
+	/**
+	 * Run Gauss-Seidel sweeps, where each node flow is updated in place from the already updated
+	 * flow of the nodes before it in the sweep. The sweep itself is serial, as each node depends
+	 * on the ones before it, so it trades parallelism for fewer iterations.
+	 */
+	unsigned int runGaussSeidel(const TransposedLinks& inLinks, const std::vector<unsigned int>& danglings,
+			const Config& config, std::vector<double>& nodeFlow, double alpha, double& residual);
+
+	/**
+	 * Set the node flow and the link flow from the converged PageRank, with one last
+	 * iteration without teleportation if the teleportation is unrecorded.
+	 * @param nodeFlowTmp the flow after the last iteration, as set by solvePageRank
+	 * @param danglingRank the flow on the dangling nodes before the last iteration
+	 */
+	void updateFlowFromPageRank(const TransposedLinks& inLinks, const std::vector<double>& nodeFlowTmp,
+			double danglingRank, double alpha, const Config& config);
 
 	void finalize(const Network& network, const Config& config, bool normalizeNodeFlow = false);
 
+	/**
+	 * Replace the undirected flow network of a bipartite network with the flow between the
+	 * ordinary nodes in two steps through the feature nodes. The flow of each feature node is
+	 * split on its ordinary nodes in proportion to their link flow. The feature nodes and
+	 * their links are removed and kept as feature links.
+	 * @return false, with the flow network unchanged, if the feature nodes have too many
+	 * pairs of ordinary nodes to project
+	 */
+	bool projectBipartiteFlow(const Network& network);
+
 	std::vector<double> m_nodeFlow;
 	std::vector<double> m_nodeTeleportRates;
 	LinkVec m_flowLinks;
+	FeatureLinks m_featureLinks;
 
 };
 
@@ -54,6 +54,8 @@
 #include <map>
 #include "Network.h"
 #include "FlowNetwork.h"
+#include "FlowCache.h"
+#include "Workspace.h"
 #include "../io/version.h"
 #include <functional>
 
@@ -78,7 +80,7 @@ void InfomapBase::run()
 	if (!initNetwork())
 		return;
 
-	run(m_ioNetwork);
+	run(ioNetwork());
 }
 
 void InfomapBase::run(Network& input, HierarchicalNetwork& output)
@@ -103,6 +105,7 @@ void InfomapBase::run(Network& input, HierarchicalNetwork& output)
 
 void InfomapBase::run(HierarchicalNetwork& output)
 {
+	Workspace::RunScope workspaceScope;
 	calcOneLevelCodelength();
 	calcEntropyRate();
 
@@ -120,116 +123,53 @@ void InfomapBase::run(HierarchicalNetwork& output)
 
 	Log() << "Initiating done in " << Stopwatch::getElapsedTimeSinceProgramStartInSec() << "s\n";
 
-	for (unsigned int iTrial = 0; iTrial < numTrials; ++iTrial)
-	{
-		Log() << "\nAttempt " << (iTrial+1) << "/" << numTrials <<	" at " << Date();
-		Log() << std::endl;
-		m_trialIndex = iTrial;
-		Stopwatch timer(true);
-
-		// First clear existing modular structure
-		while ((*m_treeData.begin_leaf())->parent != root())
-		{
-			root()->replaceChildrenWithGrandChildren();
-		}
-
-		hierarchicalCodelength = codelength = moduleCodelength = oneLevelCodelength;
-		indexCodelength = 0.0;
-
-		if (m_config.preClusterMultiplex && m_config.isMultiplexNetwork())
-			preClusterMultiplexNetwork();
-
-		if (m_config.clusterDataFile != "")
-			consolidateExternalClusterData();
+	std::vector<PerIterationStats> fullBipartiteStats;
+	if (m_config.benchmark && m_config.bipartiteTwoPhase && m_config.isBipartite())
+		runTrialsWithoutBipartiteTwoPhase(fullBipartiteStats);
 
-		if (!m_config.noInfomap)
-			runPartition();
-
-		if (oneLevelCodelength < hierarchicalCodelength - m_config.minimumCodelengthImprovement)
-		{
-			Log() << "Warning: No codelength improvement in modular solution over one-level solution!\n";
-		}
-		
-		double topPerplexity = 0.0;
-		double bottomPerplexity = 0.0;
-		for (NodeBase::sibling_iterator moduleIt(root()->begin_child()), endIt(root()->end_child());
-		moduleIt != endIt; ++moduleIt)
+	if (m_config.parallelTrials && numTrials > 1 && !m_config.isMemoryNetwork() &&
+			!(m_config.preClusterMultiplex && m_config.isMultiplexNetwork()) && m_config.clusterDataFile == "")
+	{
+		runTrialsInParallel(output);
+		numTrials = m_iterationStats.size();
+	}
+	else
+	{
+		for (unsigned int iTrial = 0; iTrial < numTrials; ++iTrial)
 		{
-			topPerplexity += -infomath::plogp(getNodeData(*moduleIt).flow);
-		}
-		topPerplexity = std::pow(2, topPerplexity);
-		for (InfomapIterator it(root(), 1); !it.isEnd(); ++it) {
-			if (it.isLeafModule()) {
-				bottomPerplexity += -infomath::plogp(getNodeData(*it).flow);
-			}
-		}
-		bottomPerplexity = std::pow(2, bottomPerplexity);
-		
-		// physicalId -> (moduleId -> flow)
-		std::map<unsigned int, std::map<unsigned int, double> > topModulesPerPhysicalNode;
-		std::map<unsigned int, std::map<unsigned int, double> > bottomModulesPerPhysicalNode;
-		double weightedDepth = 0.0;
-		for (InfomapIterator it(root(), 1); !it.isEnd(); ++it) {
-			if (it->isLeaf()) {
-				topModulesPerPhysicalNode[it->getPhysicalIndex()][it.moduleIndex()] += getNodeData(*it).flow;
-				weightedDepth += it.depth() * getNodeData(*it).flow;
-			}
-		}
-		for (InfomapIterator it(root(), -1); !it.isEnd(); ++it) {
-			if (it->isLeaf()) {
-				bottomModulesPerPhysicalNode[it->getPhysicalIndex()][it.moduleIndex()] += getNodeData(*it).flow;
+			if (iTrial > 0 && stopOnTimeBudget())
+			{
+				Log() << "\nTime budget of " << m_config.maxSeconds << "s exceeded after " << iTrial <<
+						(iTrial == 1 ? " trial.\n" : " trials.\n");
+				numTrials = iTrial;
+				m_iterationStats.resize(numTrials);
+				break;
 			}
-		}
-		double topOverlap = 0.0;
-		for (std::map<unsigned int, std::map<unsigned int, double> >::iterator it(topModulesPerPhysicalNode.begin()); it != topModulesPerPhysicalNode.end(); ++it) {
-			std::map<unsigned int, double>& moduleFlow = it->second;
-			double flow = std::accumulate(moduleFlow.begin(), moduleFlow.end(), 0.0, AddMapValues());
-			double topOverlapPerplexityPerNode = 0.0;
-			for (std::map<unsigned int, double>::iterator itModuleFlow(moduleFlow.begin()); itModuleFlow != moduleFlow.end(); ++itModuleFlow) {
-				topOverlapPerplexityPerNode += -infomath::plogp(itModuleFlow->second / flow);
+			runTrial(iTrial, m_iterationStats[iTrial]);
+
+			if (numTrials > 1 && m_config.printAllTrials) {
+				std::string outName = io::Str() << m_config.outName << "_" << (iTrial+1);
+				printNetworkData(outName);
 			}
-			topOverlapPerplexityPerNode = std::pow(2, topOverlapPerplexityPerNode);
-			topOverlap += flow * topOverlapPerplexityPerNode;
-		}
-		double bottomOverlap = 0.0;
-		for (std::map<unsigned int, std::map<unsigned int, double> >::iterator it(bottomModulesPerPhysicalNode.begin()); it != bottomModulesPerPhysicalNode.end(); ++it) {
-			std::map<unsigned int, double>& moduleFlow = it->second;
-			double flow = std::accumulate(moduleFlow.begin(), moduleFlow.end(), 0.0, AddMapValues());
-			double bottomOverlapPerplexityPerNode = 0.0;
-			for (std::map<unsigned int, double>::iterator itModuleFlow(moduleFlow.begin()); itModuleFlow != moduleFlow.end(); ++itModuleFlow) {
-				bottomOverlapPerplexityPerNode += -infomath::plogp(itModuleFlow->second / flow);
+
+			if (hierarchicalCodelength < bestHierarchicalCodelength)
+			{
+				bestHierarchicalCodelength = hierarchicalCodelength;
+				bestSolutionStatistics.str("");
+				printNetworkData(output);
+				bestNumLevels = printPerLevelCodelength(bestSolutionStatistics);
+				m_iterationStats[iTrial].isMinimum = true;
 			}
-			bottomOverlapPerplexityPerNode = std::pow(2, bottomOverlapPerplexityPerNode);
-			bottomOverlap += flow * bottomOverlapPerplexityPerNode;
-		}
-
-		m_iterationStats[iTrial].iterationIndex = iTrial;
-		m_iterationStats[iTrial].codelength = hierarchicalCodelength;
-		m_iterationStats[iTrial].maxDepth = maxDepth();
-		m_iterationStats[iTrial].weightedDepth = weightedDepth;
-		m_iterationStats[iTrial].numTopModules = numTopModules();
-		m_iterationStats[iTrial].numBottomModules = numBottomModules();
-		m_iterationStats[iTrial].topPerplexity = topPerplexity;
-		m_iterationStats[iTrial].bottomPerplexity = bottomPerplexity;
-		m_iterationStats[iTrial].topOverlap = topOverlap;
-		m_iterationStats[iTrial].bottomOverlap = bottomOverlap;
-		m_iterationStats[iTrial].seconds = timer.getElapsedTimeInSec();
-
-		if (numTrials > 1 && m_config.printAllTrials) {
-			std::string outName = io::Str() << m_config.outName << "_" << (iTrial+1);
-			printNetworkData(outName);
-		}
-		
-		if (hierarchicalCodelength < bestHierarchicalCodelength)
-		{
-			bestHierarchicalCodelength = hierarchicalCodelength;
-			bestSolutionStatistics.str("");
-			printNetworkData(output);
-			bestNumLevels = printPerLevelCodelength(bestSolutionStatistics);
-			m_iterationStats[iTrial].isMinimum = true;
+
+			if (m_config.benchmark)
+				Logger::benchmark(io::Str() << "trial" << (iTrial + 1), hierarchicalCodelength, numTopModules(),
+						numNonTrivialTopModules(), m_iterationStats[iTrial].maxDepth);
 		}
 	}
 
+	if (!fullBipartiteStats.empty())
+		benchmarkBipartiteTwoPhase(fullBipartiteStats, numTrials);
+
 	Log() << "\n\n";
 
 	unsigned int fieldWidth = 16;
@@ -513,11 +453,318 @@ void InfomapBase::run(HierarchicalNetwork& output)
 	Log() << "Best end modular solution in " << bestNumLevels << " levels";
 	if (bestHierarchicalCodelength > oneLevelCodelength)
 		Log() << " (warning: worse than one-level solution)";
+	if (m_featureLinks.numFeatureNodes() > 0)
+		Log() << " (projected on the ordinary nodes, not comparable with the bipartite codelength)";
 	Log() << ":" << std::endl;
 	Log() << bestSolutionStatistics.str() << std::endl;
 
 }
 
+void InfomapBase::runTrial(unsigned int iTrial, PerIterationStats& stats)
+{
+	Log() << "\nAttempt " << (iTrial+1) << "/" << m_config.numTrials <<	" at " << Date();
+	Log() << std::endl;
+	m_trialIndex = iTrial;
+	Stopwatch timer(true);
+
+	// First clear existing modular structure, which may have leaf nodes on different depths.
+	// Each call removes one level of modules, so repeat until there is nothing left to remove.
+	while (root()->replaceChildrenWithGrandChildren() > 0)
+		continue;
+
+	hierarchicalCodelength = codelength = moduleCodelength = oneLevelCodelength;
+	indexCodelength = 0.0;
+
+	if (m_config.preClusterMultiplex && m_config.isMultiplexNetwork())
+		preClusterMultiplexNetwork();
+
+	if (m_config.clusterDataFile != "")
+		consolidateExternalClusterData();
+
+	if (!m_config.noInfomap)
+		runPartition();
+
+	if (oneLevelCodelength < hierarchicalCodelength - m_config.minimumCodelengthImprovement)
+	{
+		Log() << "Warning: No codelength improvement in modular solution over one-level solution!\n";
+	}
+	
+	double topPerplexity = 0.0;
+	double bottomPerplexity = 0.0;
+	for (NodeBase::sibling_iterator moduleIt(root()->begin_child()), endIt(root()->end_child());
+	moduleIt != endIt; ++moduleIt)
+	{
+		topPerplexity += -infomath::plogp(getNodeData(*moduleIt).flow);
+	}
+	topPerplexity = std::pow(2, topPerplexity);
+	for (InfomapIterator it(root(), 1); !it.isEnd(); ++it) {
+		if (it.isLeafModule()) {
+			bottomPerplexity += -infomath::plogp(getNodeData(*it).flow);
+		}
+	}
+	bottomPerplexity = std::pow(2, bottomPerplexity);
+	
+	// physicalId -> (moduleId -> flow)
+	std::map<unsigned int, std::map<unsigned int, double> > topModulesPerPhysicalNode;
+	std::map<unsigned int, std::map<unsigned int, double> > bottomModulesPerPhysicalNode;
+	double weightedDepth = 0.0;
+	for (InfomapIterator it(root(), 1); !it.isEnd(); ++it) {
+		if (it->isLeaf()) {
+			topModulesPerPhysicalNode[it->getPhysicalIndex()][it.moduleIndex()] += getNodeData(*it).flow;
+			weightedDepth += it.depth() * getNodeData(*it).flow;
+		}
+	}
+	for (InfomapIterator it(root(), -1); !it.isEnd(); ++it) {
+		if (it->isLeaf()) {
+			bottomModulesPerPhysicalNode[it->getPhysicalIndex()][it.moduleIndex()] += getNodeData(*it).flow;
+		}
+	}
+	double topOverlap = 0.0;
+	for (std::map<unsigned int, std::map<unsigned int, double> >::iterator it(topModulesPerPhysicalNode.begin()); it != topModulesPerPhysicalNode.end(); ++it) {
+		std::map<unsigned int, double>& moduleFlow = it->second;
+		double flow = std::accumulate(moduleFlow.begin(), moduleFlow.end(), 0.0, AddMapValues());
+		double topOverlapPerplexityPerNode = 0.0;
+		for (std::map<unsigned int, double>::iterator itModuleFlow(moduleFlow.begin()); itModuleFlow != moduleFlow.end(); ++itModuleFlow) {
+			topOverlapPerplexityPerNode += -infomath::plogp(itModuleFlow->second / flow);
+		}
+		topOverlapPerplexityPerNode = std::pow(2, topOverlapPerplexityPerNode);
+		topOverlap += flow * topOverlapPerplexityPerNode;
+	}
+	double bottomOverlap = 0.0;
+	for (std::map<unsigned int, std::map<unsigned int, double> >::iterator it(bottomModulesPerPhysicalNode.begin()); it != bottomModulesPerPhysicalNode.end(); ++it) {
+		std::map<unsigned int, double>& moduleFlow = it->second;
+		double flow = std::accumulate(moduleFlow.begin(), moduleFlow.end(), 0.0, AddMapValues());
+		double bottomOverlapPerplexityPerNode = 0.0;
+		for (std::map<unsigned int, double>::iterator itModuleFlow(moduleFlow.begin()); itModuleFlow != moduleFlow.end(); ++itModuleFlow) {
+			bottomOverlapPerplexityPerNode += -infomath::plogp(itModuleFlow->second / flow);
+		}
+		bottomOverlapPerplexityPerNode = std::pow(2, bottomOverlapPerplexityPerNode);
+		bottomOverlap += flow * bottomOverlapPerplexityPerNode;
+	}
+
+	stats.iterationIndex = iTrial;
+	stats.codelength = hierarchicalCodelength;
+	stats.maxDepth = maxDepth();
+	stats.weightedDepth = weightedDepth;
+	stats.numTopModules = numTopModules();
+	stats.numBottomModules = numBottomModules();
+	stats.topPerplexity = topPerplexity;
+	stats.bottomPerplexity = bottomPerplexity;
+	stats.topOverlap = topOverlap;
+	stats.bottomOverlap = bottomOverlap;
+	stats.seconds = timer.getElapsedTimeInSec();
+}
+
+void InfomapBase::runTrialsWithoutBipartiteTwoPhase(std::vector<PerIterationStats>& stats)
+{
+	Log() << "\nRunning " << m_config.numTrials << (m_config.numTrials == 1 ? " trial" : " trials") <<
+			" without --bipartite-two-phase for the benchmark..." << std::flush;
+
+	Config fullConfig(m_config);
+	fullConfig.bipartiteTwoPhase = false;
+	fullConfig.noFileOutput = true;
+	fullConfig.benchmark = false;
+	std::auto_ptr<InfomapBase> full(getNewInfomapInstance(fullConfig));
+	full->initSubNetworkView(*this, *root());
+	full->root()->owner = 0;
+	full->oneLevelCodelength = full->root()->codelength = oneLevelCodelength;
+	full->m_iterationStats.resize(m_config.numTrials);
+	stats.resize(m_config.numTrials);
+	{
+		SilentLogScope silentLog;
+		for (unsigned int iTrial = 0; iTrial < m_config.numTrials; ++iTrial)
+		{
+			// Seed the trials as the benchmarked run does
+			if (m_config.parallelTrials)
+				full->seedTrialFromIndex(iTrial);
+			full->runTrial(iTrial, stats[iTrial]);
+		}
+	}
+	Log() << " done!\n";
+}
+
+void InfomapBase::benchmarkBipartiteTwoPhase(const std::vector<PerIterationStats>& fullStats, unsigned int numTrials)
+{
+	// Compare the trials run in both, summing the seconds of each trial so that running
+	// the trials in parallel doesn't count as speedup
+	numTrials = std::min(numTrials, static_cast<unsigned int>(fullStats.size()));
+	if (numTrials == 0)
+		return;
+	double seconds = 0.0;
+	double fullSeconds = 0.0;
+	double codelength = std::numeric_limits<double>::max();
+	double fullCodelength = std::numeric_limits<double>::max();
+	for (unsigned int i = 0; i < numTrials; ++i)
+	{
+		seconds += m_iterationStats[i].seconds;
+		fullSeconds += fullStats[i].seconds;
+		codelength = std::min(codelength, m_iterationStats[i].codelength);
+		fullCodelength = std::min(fullCodelength, fullStats[i].codelength);
+	}
+
+	Logger::benchmarkFields("bipartiteTwoPhase", io::Str() << "trials=" << numTrials <<
+			"\tseconds=" << seconds << "\tfullSeconds=" << fullSeconds <<
+			"\tspeedup=" << (seconds > 0.0 ? fullSeconds / seconds : 0.0) <<
+			"\tcodelength=" << io::toPrecision(codelength, 9, true) <<
+			"\tfullCodelength=" << io::toPrecision(fullCodelength, 9, true) <<
+			"\tcodelengthDiff=" << io::toPrecision(codelength - fullCodelength, 9, true));
+}
+
+void InfomapBase::seedTrialFromIndex(unsigned int iTrial)
+{
+	m_trialIndex = iTrial;
+	if (iTrial == 0)
+		m_rand.seed(m_config.seedToRandomNumberGenerator);
+	else
+		reseed(0);
+}
+
+void InfomapBase::runTrialsInParallel(HierarchicalNetwork& output)
+{
+	unsigned int numTrials = m_config.numTrials;
+	unsigned int numWorkers = 1;
+#ifdef _OPENMP
+	numWorkers = std::min(static_cast<unsigned int>(omp_get_max_threads()), numTrials);
+#endif
+
+	Log() << "\nRunning " << numTrials << " trials on " << numWorkers << " thread" <<
+			(numWorkers == 1 ? "" : "s") << "..." << std::endl;
+
+	// The leaf nodes are owned by the tree, so each worker partitions its own clone of the network.
+	// Intermediate output is disabled on the workers and the best solution is written from here.
+	Config workerConfig(m_config);
+	workerConfig.noFileOutput = true;
+	workerConfig.benchmark = false;
+	std::vector<InfomapBase*> workers(numWorkers);
+	for (unsigned int i = 0; i < numWorkers; ++i)
+	{
+		InfomapBase* worker = getNewInfomapInstance(workerConfig).release();
+		worker->initSubNetworkView(*this, *root());
+		worker->root()->owner = 0;
+		worker->m_nodeNames = m_nodeNames;
+		worker->m_featureLinks = m_featureLinks;
+		worker->oneLevelCodelength = worker->root()->codelength = oneLevelCodelength;
+		worker->m_iterationStats.resize(numTrials);
+		workers[i] = worker;
+	}
+
+	unsigned int bestTrial = 0;
+	std::vector<char> trialCompleted(numTrials, 0);
+	{
+		SilentLogScope silentLog;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(numWorkers)
+#endif
+		for (int i = 0; i < static_cast<int>(numTrials); ++i)
+		{
+			unsigned int iTrial = static_cast<unsigned int>(i);
+			if (iTrial > 0 && stopOnTimeBudget())
+				continue;
+			unsigned int workerIndex = 0;
+#ifdef _OPENMP
+			workerIndex = omp_get_thread_num();
+#endif
+			InfomapBase& worker = *workers[workerIndex];
+			worker.seedTrialFromIndex(iTrial);
+			worker.runTrial(iTrial, m_iterationStats[iTrial]);
+			trialCompleted[iTrial] = 1;
+
+#ifdef _OPENMP
+#pragma omp critical (bestTrial)
+#endif
+			{
+				if (m_config.printAllTrials) {
+					worker.mutableConfig().noFileOutput = m_config.noFileOutput;
+					std::string outName = io::Str() << m_config.outName << "_" << (iTrial+1);
+					worker.printNetworkData(outName);
+					worker.mutableConfig().noFileOutput = true;
+				}
+
+				// Break ties on the trial index to not depend on the order the trials finish in
+				if (worker.hierarchicalCodelength < bestHierarchicalCodelength ||
+						(worker.hierarchicalCodelength == bestHierarchicalCodelength && iTrial < bestTrial))
+				{
+					bestHierarchicalCodelength = worker.hierarchicalCodelength;
+					bestTrial = iTrial;
+					copyModularStructure(worker);
+					bestSolutionStatistics.str("");
+					printNetworkData(output);
+					bestNumLevels = printPerLevelCodelength(bestSolutionStatistics);
+				}
+
+				if (worker.bestIntermediateCodelength < bestIntermediateCodelength)
+				{
+					bestIntermediateCodelength = worker.bestIntermediateCodelength;
+					bestIntermediateStatistics.str(worker.bestIntermediateStatistics.str());
+				}
+
+				if (m_config.benchmark)
+					Logger::benchmark(io::Str() << "trial" << (iTrial + 1), worker.hierarchicalCodelength, worker.numTopModules(),
+							worker.numNonTrivialTopModules(), m_iterationStats[iTrial].maxDepth);
+			}
+		}
+	}
+
+	m_iterationStats[bestTrial].isMinimum = true;
+	hierarchicalCodelength = bestHierarchicalCodelength;
+	for (unsigned int i = 0; i < numWorkers; ++i)
+	{
+		if (workers[i]->m_sharedConfig.stoppedOnTimeBudget())
+			m_sharedConfig.setStoppedOnTimeBudget();
+	}
+
+	// Drop the trials that were skipped by the time budget
+	unsigned int numCompleted = 0;
+	for (unsigned int i = 0; i < numTrials; ++i)
+	{
+		if (trialCompleted[i])
+			m_iterationStats[numCompleted++] = m_iterationStats[i];
+	}
+	if (numCompleted < numTrials)
+	{
+		Log() << "\nTime budget of " << m_config.maxSeconds << "s exceeded after " << numCompleted <<
+				(numCompleted == 1 ? " trial.\n" : " trials.\n");
+		m_iterationStats.resize(numCompleted);
+	}
+
+	for (unsigned int i = 0; i < numWorkers; ++i)
+		delete workers[i];
+}
+
+void InfomapBase::copyModularStructure(InfomapBase& source)
+{
+	// Clear the existing modular structure, which may have leaf nodes on different depths,
+	// one level of modules per call
+	while (root()->replaceChildrenWithGrandChildren() > 0)
+		continue;
+	root()->releaseChildren();
+
+	// Create the modules along the source tree, including the sub-structure of its sub-Infomap instances
+	std::vector<NodeBase*> parents(1, root());
+	for (InfomapIterator it(source.root()); !it.isEnd(); ++it)
+	{
+		if (it.depth() == 0)
+			continue;
+		parents.resize(it.depth());
+		if (it->isLeaf())
+		{
+			parents.back()->addChild(&m_treeData.getLeafNode(it->originalIndex));
+		}
+		else
+		{
+			NodeBase* module = m_treeData.createNode("", 0.0, 0.0);
+			parents.back()->addChild(module);
+			parents.push_back(module);
+		}
+	}
+
+	aggregateFlowValuesFromLeafToRoot();
+	hierarchicalCodelength = codelength = calcCodelengthOnAllNodesInTree();
+	indexCodelength = root()->codelength;
+	moduleCodelength = hierarchicalCodelength - indexCodelength;
+}
+
 void InfomapBase::calcOneLevelCodelength()
 {
 	Log() << "Calculating one-level codelength... " << std::flush;
@@ -531,36 +778,54 @@ void InfomapBase::calcEntropyRate()
 	double entropyRate = 0.0;
 	double physEntropyRate = 0.0;
 
-	for (TreeData::leafIterator it(m_treeData.begin_leaf()), itEnd(m_treeData.end_leaf());
-		it != itEnd; ++it)
-	{
-		NodeBase& node = **it;
-		double sumOutFlow = 0.0;
-		double entropy = 0.0;
-		double physEntropy = 0.0;
-		std::map<unsigned int, double> physOutFlow;
-		for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), edgeEnd(node.end_outEdge());
-				edgeIt != edgeEnd; ++edgeIt)
+	if (m_treeData.isLeafLinkView())
+	{
+		// Only first-order networks are stored without edges, so there is no physical entropy rate
+		const Adjacency& links = m_treeData.leafLinkView();
+		for (unsigned int i = 0; i < links.numNodes(); ++i)
 		{
-			EdgeType& edge = **edgeIt;
-			sumOutFlow += edge.data.flow;
-			physOutFlow[edge.target.getPhysicalIndex()] += edge.data.flow;
+			double sumOutFlow = links.selfLinkFlow(i);
+			for (unsigned int link = links.beginOut(i), endLink = links.endOut(i); link != endLink; ++link)
+				sumOutFlow += links.outFlow(link);
+			double entropy = links.hasSelfLink(i) ? -infomath::plogp(links.selfLinkFlow(i) / sumOutFlow) : 0.0;
+			for (unsigned int link = links.beginOut(i), endLink = links.endOut(i); link != endLink; ++link)
+				entropy += -infomath::plogp(links.outFlow(link) / sumOutFlow);
+			entropyRate += getNodeData(m_treeData.getLeafNode(i)).flow * entropy;
 		}
-		for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), edgeEnd(node.end_outEdge());
-				edgeIt != edgeEnd; ++edgeIt)
+	}
+	else
+	{
+		for (TreeData::leafIterator it(m_treeData.begin_leaf()), itEnd(m_treeData.end_leaf());
+			it != itEnd; ++it)
 		{
-			EdgeType& edge = **edgeIt;
-			entropy += -infomath::plogp(edge.data.flow / sumOutFlow);
-		}
-		if (m_config.isMemoryNetwork()) {
-			for (std::map<unsigned int, double>::iterator physIt(physOutFlow.begin()); physIt != physOutFlow.end(); ++physIt)
+			NodeBase& node = **it;
+			double sumOutFlow = 0.0;
+			double entropy = 0.0;
+			double physEntropy = 0.0;
+			std::map<unsigned int, double> physOutFlow;
+			for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), edgeEnd(node.end_outEdge());
+					edgeIt != edgeEnd; ++edgeIt)
+			{
+				EdgeType& edge = **edgeIt;
+				sumOutFlow += edge.data.flow;
+				physOutFlow[edge.target.getPhysicalIndex()] += edge.data.flow;
+			}
+			for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), edgeEnd(node.end_outEdge());
+					edgeIt != edgeEnd; ++edgeIt)
 			{
-				double physFlow = physIt->second;
-				physEntropy += -infomath::plogp(physFlow / sumOutFlow);
+				EdgeType& edge = **edgeIt;
+				entropy += -infomath::plogp(edge.data.flow / sumOutFlow);
+			}
+			if (m_config.isMemoryNetwork()) {
+				for (std::map<unsigned int, double>::iterator physIt(physOutFlow.begin()); physIt != physOutFlow.end(); ++physIt)
+				{
+					double physFlow = physIt->second;
+					physEntropy += -infomath::plogp(physFlow / sumOutFlow);
+				}
+				physEntropyRate += getNodeData(node).flow * physEntropy;
 			}
-			physEntropyRate += getNodeData(node).flow * physEntropy;
+			entropyRate += getNodeData(node).flow * entropy;
 		}
-		entropyRate += getNodeData(node).flow * entropy;
 	}
 
 	Log() << "done!\n";
@@ -662,7 +927,7 @@ void InfomapBase::runPartition()
 				bestHierarchicalCodelength = hierarchicalCodelength;
 				bestSolutionStatistics.str("");
 				// printNetworkData(m_config.outName);
-				printNetworkData(m_ioNetwork); //TODO: Doesn't write to output tree from library
+				printNetworkData(ioNetwork()); //TODO: Doesn't write to output tree from library
 				bestNumLevels = printPerLevelCodelength(bestSolutionStatistics);
 				m_iterationStats[m_trialIndex].isMinimum = true;
 			}
@@ -690,13 +955,18 @@ void InfomapBase::runPartition()
 	// Log(1) << "indexCodelength: " << indexCodelength << "\n";
 
 	if (m_config.resetConfigBeforeRecursion) {
-		m_config.reset();
+		mutableConfig().reset();
 	}
 
 //	double t0 = omp_get_wtime();
 
 	while (partitionQueue.size() > 0)
 	{
+		if (stopOnTimeBudget())
+		{
+			Log() << "(time budget exceeded) " << std::flush;
+			break;
+		}
 		Log(1,1) << "Level " << partitionQueue.level << ": " << (partitionQueue.flow*100) <<
 				"% of the flow in " << partitionQueue.size() << " modules. Finding sub-modules... " << std::setprecision(6) << std::flush;
 		Log(2) << "Level " << partitionQueue.level << ": " << (partitionQueue.flow*100) <<
@@ -722,6 +992,10 @@ void InfomapBase::runPartition()
 
 		hierarchicalCodelength = limitCodelength;
 
+		if (m_subLevel == 0 && m_config.benchmark)
+			Logger::benchmark(io::Str() << "sub" << partitionQueue.level, hierarchicalCodelength, numTopModules(),
+					numNonTrivialTopModules(), partitionQueue.level + 1);
+
 		partitionQueue.swap(nextLevelQueue);
 	}
 	Log(0,0) << ". Found " << partitionQueue.level << " levels with codelength " <<
@@ -789,7 +1063,7 @@ void InfomapBase::queueTopModules(PartitionQueue& partitionQueue)
 	for (NodeBase::sibling_iterator moduleIt(root()->begin_child()), endIt(root()->end_child());
 			moduleIt != endIt; ++moduleIt, ++moduleIndex)
 	{
-		partitionQueue[moduleIndex] = moduleIt.base();
+		partitionQueue[moduleIndex] = PendingModule(moduleIt.base(), this);
 		if (moduleIt->childDegree() > 1)
 		{
 			nonTrivialFlow += getNodeData(*moduleIt).flow;
@@ -816,7 +1090,7 @@ void InfomapBase::queueLeafModules(PartitionQueue& partitionQueue)
 	unsigned int maxDepth = 0;
 	for (NodeBase::leaf_module_iterator leafModuleIt(m_treeData.root()); !leafModuleIt.isEnd(); ++leafModuleIt, ++moduleIndex)
 	{
-		partitionQueue[moduleIndex] = leafModuleIt.base();
+		partitionQueue[moduleIndex] = PendingModule(leafModuleIt.base(), this);
 		double flow = getNodeData(*leafModuleIt).flow;
 		sumFlow += flow;
 		sumModuleCodelength += leafModuleIt->codelength;
@@ -868,6 +1142,8 @@ void InfomapBase::tryIndexingIteratively(bool replaceExistingModules)
 		superInfomap->reseed(numIndexingCompleted);
 		superInfomap->initSuperNetwork(*root());
 		superInfomap->partition();
+		if (superInfomap->m_sharedConfig.stoppedOnTimeBudget())
+			m_sharedConfig.setStoppedOnTimeBudget();
 
 
 		// Break if trivial super structure
@@ -1104,87 +1380,179 @@ unsigned int InfomapBase::deleteSubLevels()
 	return maxNumLevelsRemoved;
 }
 
-bool InfomapBase::processPartitionQueue(PartitionQueue& queue, PartitionQueue& nextLevelQueue, bool tryIndexing)
-{
-	PartitionQueue::size_t numModules = queue.size();
-	std::vector<double> indexCodelengths(numModules, 0.0);
-	std::vector<double> moduleCodelengths(numModules, 0.0);
-	std::vector<double> leafCodelengths(numModules, 0.0);
-	std::vector<PartitionQueue> subQueues(numModules);
+namespace {
 
-//#define _OPENMP
+	double getWallTime()
+	{
 #ifdef _OPENMP
-//	sortPartitionQueue(queue);
-	int numModulesInt = static_cast<int>(numModules);
-//	int numProcs = std::min(numModulesInt, omp_get_num_procs());
-	int iModule;
-
-//#pragma omp parallel
-//	{
-//#pragma omp for nowait
-//		for (iProc = 0; iProc < numProcs; ++iProc)
-//		{
-//			for (int moduleIndex = iProc; moduleIndex < numModulesInt; moduleIndex += numProcs)
-//			{
-//#pragma omp parallel for schedule(dynamic, 1)
-#pragma omp parallel for schedule(dynamic)
-	for(iModule = 0; iModule < numModulesInt; ++iModule)
-	{
-		unsigned int moduleIndex = static_cast<unsigned int>(iModule);
-		NodeBase& module = *queue[moduleIndex];
+		return omp_get_wtime();
 #else
-	for (PartitionQueue::size_t moduleIndex = 0; moduleIndex < numModules; ++moduleIndex)
-	{
-		NodeBase& module = *queue[moduleIndex];
+		return Stopwatch::getElapsedTimeSinceProgramStartInSec();
 #endif
+	}
 
-		// Delete former sub-structure if exists
-		module.getSubStructure().subInfomap.reset(0);
-		module.codelength = calcCodelengthOnModuleOfLeafNodes(module);
+	struct IndexOnDecreasingValue
+	{
+		IndexOnDecreasingValue(const std::vector<double>& values) : values(values) {}
+		bool operator()(unsigned int i, unsigned int j) const { return values[i] > values[j]; }
+		const std::vector<double>& values;
+	};
+
+	// Per thread, the seconds spent in nested runTasks calls, which a task doesn't count as
+	// its own work, and where the running task sums the work of its nested tasks.
+	double s_nestedTasksSeconds = 0.0;
+	double* s_nestedTasksWork = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(s_nestedTasksSeconds, s_nestedTasksWork)
+#endif
 
-		// If only trivial substructure is to be found, no need to create infomap instance to find sub-module structures.
-		if (module.childDegree() <= 2)
+	template<typename Task>
+	void runMeasuredTask(Task& task, unsigned int taskIndex, double& seconds, double* parentWork)
+	{
+		double* outerNestedTasksWork = s_nestedTasksWork;
+		double nestedTasksWork = 0.0;
+		s_nestedTasksWork = &nestedTasksWork;
+		double nestedTasksSecondsBefore = s_nestedTasksSeconds;
+		double startTime = getWallTime();
+		task(taskIndex);
+		seconds = getWallTime() - startTime - (s_nestedTasksSeconds - nestedTasksSecondsBefore) + nestedTasksWork;
+		s_nestedTasksWork = outerNestedTasksWork;
+		if (parentWork != 0)
 		{
-			leafCodelengths[moduleIndex] = module.codelength;
-			continue;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+			*parentWork += seconds;
 		}
+	}
 
-		PartitionQueue& subQueue = subQueues[moduleIndex];
-		subQueue.level = queue.level + 1;
-
-		std::auto_ptr<InfomapBase> subInfomap(getNewInfomapInstance());
-		subInfomap->m_subLevel = m_subLevel + 1;
-		subInfomap->reseed(moduleIndex + m_subLevel);
-
-		subInfomap->initSubNetwork(module, false);
-
-		subInfomap->partitionAndQueueNextLevel(subQueue, tryIndexing);
-
-		// If non-trivial substructure is found which improves the codelength, store it on the module
-		bool nonTrivialSubstructure = subInfomap->numTopModules() > 1 &&
-				subInfomap->numTopModules() < subInfomap->numLeafNodes();
-		bool improvement = nonTrivialSubstructure &&
-				(subInfomap->hierarchicalCodelength < module.codelength - m_config.minimumCodelengthImprovement);
+}
 
-		if (improvement)
+template<typename Task>
+void InfomapBase::runTasks(Task& task, unsigned int numTasks, std::vector<double>& seconds)
+{
+	seconds.assign(numTasks, 0.0);
+#ifdef _OPENMP
+	Task* taskPtr = &task;
+	double* secondsPtr = &seconds[0];
+	double* parentWork = s_nestedTasksWork;
+	if (omp_get_level() > 0)
+	{
+		double nestedTasksSecondsBefore = s_nestedTasksSeconds;
+		double startTime = getWallTime();
+		for (unsigned int i = 0; i < numTasks; ++i)
 		{
-//			moduleCodelength -= module.codelength;
-			indexCodelengths[moduleIndex] = subInfomap->indexCodelength;
-			moduleCodelengths[moduleIndex] = subInfomap->moduleCodelength;
-//						improvements[moduleIndex] = module.codelength - subInfomap->hierarchicalCodelength;
-			module.getSubStructure().subInfomap = subInfomap;
-			//				nextLevelSize += subQueue.size();
+#pragma omp task firstprivate(i, taskPtr, secondsPtr, parentWork)
+			runMeasuredTask(*taskPtr, i, secondsPtr[i], parentWork);
 		}
-		else
+#pragma omp taskwait
+		// Replace the time of the tasks run in this call on this thread, as it is all in this window
+		s_nestedTasksSeconds = nestedTasksSecondsBefore + getWallTime() - startTime;
+		return;
+	}
+
+#pragma omp parallel
+	{
+#pragma omp single
 		{
-			leafCodelengths[moduleIndex] = module.codelength;
-			module.getSubStructure().exploredWithoutImprovement = true;
-			subQueue.skip = true;
-			// Else use the codelength from the flat substructure
+			for (unsigned int i = 0; i < numTasks; ++i)
+			{
+#pragma omp task firstprivate(i, taskPtr, secondsPtr, parentWork)
+				runMeasuredTask(*taskPtr, i, secondsPtr[i], parentWork);
+			}
 		}
+	}
+#else
+	for (unsigned int i = 0; i < numTasks; ++i)
+		runMeasuredTask(task, i, seconds[i], s_nestedTasksWork);
+#endif
+}
+
+struct InfomapBase::PartitionQueuedModuleTask
+{
+	PartitionQueuedModuleTask(InfomapBase& infomap, PartitionQueue& queue, const std::vector<unsigned int>& order,
+			std::vector<PartitionQueue>& subQueues, std::vector<double>& indexCodelengths,
+			std::vector<double>& moduleCodelengths, std::vector<double>& leafCodelengths,
+			std::vector<SubModuleGraft>& grafts, bool tryIndexing) :
+		infomap(infomap), queue(queue), order(order), subQueues(subQueues), indexCodelengths(indexCodelengths),
+		moduleCodelengths(moduleCodelengths), leafCodelengths(leafCodelengths), grafts(grafts),
+		tryIndexing(tryIndexing) {}
+
+	void operator()(unsigned int taskIndex)
+	{
+		unsigned int moduleIndex = order[taskIndex];
+		infomap.partitionQueuedModule(queue, moduleIndex, subQueues[moduleIndex], indexCodelengths[moduleIndex],
+				moduleCodelengths[moduleIndex], leafCodelengths[moduleIndex], grafts[moduleIndex], tryIndexing);
+	}
+
+	InfomapBase& infomap;
+	PartitionQueue& queue;
+	const std::vector<unsigned int>& order;
+	std::vector<PartitionQueue>& subQueues;
+	std::vector<double>& indexCodelengths;
+	std::vector<double>& moduleCodelengths;
+	std::vector<double>& leafCodelengths;
+	std::vector<SubModuleGraft>& grafts;
+	bool tryIndexing;
+};
+
+struct InfomapBase::PartitionModuleTask
+{
+	PartitionModuleTask(InfomapBase& infomap, const std::vector<NodeBase*>& modules,
+			const std::vector<unsigned int>& order, unsigned int recursiveCount, bool fast,
+			std::vector<std::vector<unsigned int> >& subModuleIndices, std::vector<unsigned int>& numSubModules) :
+		infomap(infomap), modules(modules), order(order), recursiveCount(recursiveCount), fast(fast),
+		subModuleIndices(subModuleIndices), numSubModules(numSubModules) {}
 
+	void operator()(unsigned int taskIndex)
+	{
+		unsigned int moduleIndex = order[taskIndex];
+		infomap.partitionModule(*modules[moduleIndex], recursiveCount, fast,
+				subModuleIndices[moduleIndex], numSubModules[moduleIndex]);
 	}
 
+	InfomapBase& infomap;
+	const std::vector<NodeBase*>& modules;
+	const std::vector<unsigned int>& order;
+	unsigned int recursiveCount;
+	bool fast;
+	std::vector<std::vector<unsigned int> >& subModuleIndices;
+	std::vector<unsigned int>& numSubModules;
+};
+
+bool InfomapBase::processPartitionQueue(PartitionQueue& queue, PartitionQueue& nextLevelQueue, bool tryIndexing)
+{
+	PartitionQueue::size_t numModules = queue.size();
+	std::vector<double> indexCodelengths(numModules, 0.0);
+	std::vector<double> moduleCodelengths(numModules, 0.0);
+	std::vector<double> leafCodelengths(numModules, 0.0);
+	std::vector<PartitionQueue> subQueues(numModules);
+
+	std::vector<double> costs(numModules);
+	int numModulesInt = static_cast<int>(numModules);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) if (!omp_in_parallel())
+#endif
+	for (int moduleIndex = 0; moduleIndex < numModulesInt; ++moduleIndex)
+		costs[moduleIndex] = estimatePartitionCost(queue[moduleIndex].owner->m_treeData, *queue[moduleIndex]);
+	std::vector<unsigned int> order;
+	schedulePartitionTasks(costs, order);
+
+	// Each module is partitioned in its own task. The sub-Infomap instances spawn nested tasks
+	// when partitioning their own modules, so a large module doesn't hold back the other threads.
+	std::vector<SubModuleGraft> grafts(numModules);
+	std::vector<double> seconds;
+	PartitionQueuedModuleTask task(*this, queue, order, subQueues, indexCodelengths, moduleCodelengths,
+			leafCodelengths, grafts, tryIndexing);
+	runTasks(task, static_cast<unsigned int>(numModules), seconds);
+	logPartitionSchedule(costs, order, seconds);
+
+	// Graft the detached sub-module structures in the main tree, now that no other task reads it
+	for (PartitionQueue::size_t moduleIndex = 0; moduleIndex < numModules; ++moduleIndex)
+	{
+		if (!grafts[moduleIndex].subModules.empty())
+			graftSubModules(*queue[moduleIndex], grafts[moduleIndex]);
+	}
 
 	double sumLeafCodelength = 0.0;
 	double sumIndexCodelength = 0.0;
@@ -1224,20 +1592,196 @@ bool InfomapBase::processPartitionQueue(PartitionQueue& queue, PartitionQueue& n
 	return nextLevelSize > 0;
 }
 
-void InfomapBase::sortPartitionQueue(PartitionQueue& queue)
+void InfomapBase::partitionQueuedModule(PartitionQueue& queue, unsigned int moduleIndex, PartitionQueue& subQueue,
+		double& indexCodelength, double& moduleCodelength, double& leafCodelength, SubModuleGraft& graft,
+		bool tryIndexing)
+{
+	NodeBase& module = *queue[moduleIndex];
+
+	// Delete former sub-structure if exists
+	module.getSubStructure().subInfomap.reset(0);
+	module.codelength = calcCodelengthOnModuleOfLeafNodes(module);
+
+	// If only trivial substructure is to be found, no need to create infomap instance to find sub-module structures.
+	if (module.childDegree() <= 2)
+	{
+		leafCodelength = module.codelength;
+		return;
+	}
+
+	subQueue.level = queue.level + 1;
+
+	std::auto_ptr<InfomapBase> subInfomap(getNewInfomapInstance());
+	subInfomap->m_subLevel = m_subLevel + 1;
+	subInfomap->reseed(moduleIndex + m_subLevel);
+
+	subInfomap->initSubNetworkView(*queue[moduleIndex].owner, module);
+
+	subInfomap->partitionAndQueueNextLevel(subQueue, tryIndexing);
+
+	// If non-trivial substructure is found which improves the codelength, store it on the module
+	bool nonTrivialSubstructure = subInfomap->numTopModules() > 1 &&
+			subInfomap->numTopModules() < subInfomap->numLeafNodes();
+	bool improvement = nonTrivialSubstructure &&
+			(subInfomap->hierarchicalCodelength < module.codelength - m_config.minimumCodelengthImprovement);
+
+	if (improvement)
+	{
+		indexCodelength = subInfomap->indexCodelength;
+		moduleCodelength = subInfomap->moduleCodelength;
+		// Keep only the sub-module structure in bounded-memory mode, else the whole instance
+		if (!m_config.graftSubModules || !detachSubModules(*subInfomap, *queue[moduleIndex].owner, subQueue, graft))
+			module.getSubStructure().subInfomap = subInfomap;
+	}
+	else
+	{
+		// Else use the codelength from the flat substructure
+		leafCodelength = module.codelength;
+		module.getSubStructure().exploredWithoutImprovement = true;
+		subQueue.skip = true;
+	}
+}
+
+bool InfomapBase::detachSubModules(InfomapBase& subInfomap, InfomapBase& owner, PartitionQueue& subQueue, SubModuleGraft& graft)
+{
+	NodeBase& subRoot = *subInfomap.root();
+	for (NodeBase::sibling_iterator subModuleIt(subRoot.begin_child()), endIt(subRoot.end_child());
+			subModuleIt != endIt; ++subModuleIt)
+	{
+		if (!subModuleIt->isDirectLeafModule())
+			return false;
+	}
+	ASSERT(subQueue.size() == subRoot.childDegree());
+
+	unsigned int numSubModules = subRoot.childDegree();
+	graft.subModules.resize(numSubModules);
+	graft.numChildren.resize(numSubModules);
+	graft.childOrder.reserve(subInfomap.numLeafNodes());
+	graft.indexCodelength = subInfomap.indexCodelength;
+	unsigned int i = 0;
+	for (NodeBase::sibling_iterator subModuleIt(subRoot.begin_child()), endIt(subRoot.end_child());
+			subModuleIt != endIt; ++subModuleIt, ++i)
+	{
+		NodeBase* subModule;
+		// The tasks of other modules of the owner may create sub-modules in its tree at the same time
+#ifdef _OPENMP
+#pragma omp critical (ownerTreeNodes)
+#endif
+		subModule = owner.m_treeData.createNode(*subModuleIt);
+		subModule->index = subModuleIt->index;
+		subModule->codelength = subModuleIt->codelength;
+		// (The physical members of memory modules stay indexed within the sub-network, only their flow is used)
+		graft.subModules[i] = subModule;
+		graft.numChildren[i] = subModuleIt->childDegree();
+		// The leaf index of the sub-network is the position among the children of the module
+		for (NodeBase::sibling_iterator childIt(subModuleIt->begin_child()), endChildIt(subModuleIt->end_child());
+				childIt != endChildIt; ++childIt)
+			graft.childOrder.push_back(childIt->leafIndex);
+		subQueue[i] = PendingModule(subModule, &owner);
+	}
+	return true;
+}
+
+void InfomapBase::graftSubModules(NodeBase& module, SubModuleGraft& graft)
 {
-	std::multimap<double, PendingModule, std::greater<double> > sortedModules;
-	for (PartitionQueue::size_t i = 0; i < queue.size(); ++i)
+	std::vector<NodeBase*> children;
+	children.reserve(module.childDegree());
+	for (NodeBase::sibling_iterator childIt(module.begin_child()), endIt(module.end_child());
+			childIt != endIt; ++childIt)
+		children.push_back(childIt.base());
+
+	module.releaseChildren();
+	unsigned int childIndex = 0;
+	for (unsigned int i = 0; i < graft.subModules.size(); ++i)
 	{
-		sortedModules.insert(std::pair<double, PendingModule>(getNodeData(*queue[i]).flow, queue[i]));
+		NodeBase* subModule = graft.subModules[i];
+		module.addChild(subModule);
+		for (unsigned int j = 0; j < graft.numChildren[i]; ++j, ++childIndex)
+			subModule->addChild(children[graft.childOrder[childIndex]]);
 	}
-	std::multimap<double, PendingModule, std::greater<double> >::iterator mapIt = sortedModules.begin();
-	for (PartitionQueue::size_t i = 0; i < queue.size(); ++i, ++mapIt)
+	// As the index codelength on the root of the sub-Infomap instance
+	module.codelength = graft.indexCodelength;
+
+	graft = SubModuleGraft();
+}
+
+double InfomapBase::estimatePartitionCost(const TreeData& tree, NodeBase& module)
+{
+	// Count the links within the module as generateSubNetworkView would collect them
+	const NodeBase* modulePtr = &module;
+	unsigned int numLinks = 0;
+	for (NodeBase::sibling_iterator childIt(module.begin_child()), endIt(module.end_child());
+			childIt != endIt; ++childIt)
+	{
+		NodeBase& node = *childIt;
+		if (tree.isLeafLinkView() && node.isLeaf())
+		{
+			const Adjacency& links = tree.leafLinkView();
+			unsigned int leafIndex = node.leafIndex;
+			for (unsigned int link = links.beginOut(leafIndex), endLink = links.endOut(leafIndex); link != endLink; ++link)
+			{
+				if (tree.getLeafNode(links.outNeighbour(link)).parent == modulePtr)
+					++numLinks;
+			}
+		}
+		else
+		{
+			for (NodeBase::edge_iterator outEdgeIt(node.begin_outEdge()), endIt(node.end_outEdge());
+					outEdgeIt != endIt; ++outEdgeIt)
+			{
+				if ((*outEdgeIt)->target.parent == modulePtr)
+					++numLinks;
+			}
+		}
+	}
+	return module.childDegree() + numLinks;
+}
+
+void InfomapBase::schedulePartitionTasks(const std::vector<double>& costs, std::vector<unsigned int>& order)
+{
+	order.resize(costs.size());
+	for (unsigned int i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), IndexOnDecreasingValue(costs));
+}
+
+void InfomapBase::logPartitionSchedule(const std::vector<double>& costs, const std::vector<unsigned int>& order,
+		const std::vector<double>& taskSeconds)
+{
+	if (m_subLevel != 0 || order.empty())
+		return;
+
+	double sumCost = 0.0;
+	double sumSeconds = 0.0;
+	for (unsigned int i = 0; i < order.size(); ++i)
 	{
-		queue[i] = mapIt->second;
+		sumCost += costs[i];
+		sumSeconds += taskSeconds[i];
 	}
 
+	// Nothing to predict from before the first measurement
+	bool calibrated = m_partitionSecondsPerCost > 0.0;
+	Log(3) << "\nPartition schedule of " << order.size() << " modules: predicted ";
+	if (calibrated)
+		Log(3) << sumCost * m_partitionSecondsPerCost << "s";
+	else
+		Log(3) << "-";
+	Log(3) << ", measured " << sumSeconds << "s of work in sum. " <<
+			"Largest modules (cost: predicted/measured seconds):";
+	unsigned int numLogged = std::min(static_cast<unsigned int>(order.size()), 10u);
+	for (unsigned int i = 0; i < numLogged; ++i)
+	{
+		Log(3) << "\n  " << costs[order[i]] << ": ";
+		if (calibrated)
+			Log(3) << costs[order[i]] * m_partitionSecondsPerCost;
+		else
+			Log(3) << "-";
+		Log(3) << "/" << taskSeconds[i];
+	}
+	Log(3) << "\n";
 
+	if (sumCost > 0.0 && sumSeconds > 0.0)
+		m_partitionSecondsPerCost = sumSeconds / sumCost;
 }
 
 void InfomapBase::partition(unsigned int recursiveCount, bool fast, bool forceConsolidation)
@@ -1335,6 +1879,8 @@ void InfomapBase::partition(unsigned int recursiveCount, bool fast, bool forceCo
 		oldCodelength = codelength;
 		while (numTopModules() > 1)
 		{
+			if (stopOnTimeBudget())
+				break;
 			++m_tuneIterationIndex;
 			if (doFineTune)
 			{
@@ -1646,42 +2192,13 @@ void InfomapBase::coarseTune(unsigned int recursiveCount)
 
 void InfomapBase::partitionEachModule(unsigned int recursiveCount, bool fast)
 {
-	unsigned int moduleIndexOffset = 0;
+	std::vector<NodeBase*> modules;
+	modules.reserve(root()->childDegree());
 	for (NodeBase::sibling_iterator moduleIt(root()->begin_child()), endIt(root()->end_child());
 			moduleIt != endIt; ++moduleIt)
-	{
-		// If only one child in the module, no need to create infomap instance to find sub-module structures.
-		if (moduleIt->childDegree() == 1)
-		{
-			for (NodeBase::sibling_iterator nodeIt(moduleIt->begin_child()), endIt(moduleIt->end_child());
-					nodeIt != endIt; ++nodeIt)
-			{
-				nodeIt->index = moduleIndexOffset;
-			}
-			moduleIndexOffset += 1;
-			continue;
-		}
-
-		std::auto_ptr<InfomapBase> subInfomap(getNewInfomapInstance());
-		// To not happen to get back the same network with the same seed
-		subInfomap->m_subLevel = m_subLevel + 1;
-		subInfomap->initSubNetwork(*moduleIt, false);
-		subInfomap->reseed(getSeedFromCodelength(codelength));
-		//		if (hierarchical)
-		//			subInfomap->hierarchicalPartition();
-		//		else
-		subInfomap->partition(recursiveCount, fast);
-
-		NodeBase::sibling_iterator originalLeafNodeIt(moduleIt->begin_child());
-		for (TreeData::leafIterator leafIt(subInfomap->m_treeData.begin_leaf()), endIt(subInfomap->m_treeData.end_leaf());
-				leafIt != endIt; ++leafIt, ++originalLeafNodeIt)
-		{
-			NodeBase& node = **leafIt;
-			originalLeafNodeIt->index = node.parent->index + moduleIndexOffset;
-		}
-		moduleIndexOffset += subInfomap->m_treeData.root()->childDegree();
-	}
+		modules.push_back(moduleIt.base());
 
+	partitionModules(modules, recursiveCount, fast);
 }
 
 void InfomapBase::partitionEachModuleParallel(unsigned int recursiveCount, bool fast)
@@ -1690,8 +2207,6 @@ void InfomapBase::partitionEachModuleParallel(unsigned int recursiveCount, bool
 	return partitionEachModule(recursiveCount, fast);
 #endif
 
-//	double t0 = omp_get_wtime();
-
 	// Store pointers to all modules in a vector
 	unsigned int numModules = root()->childDegree();
 	std::vector<NodeBase*> modules(numModules);
@@ -1700,78 +2215,84 @@ void InfomapBase::partitionEachModuleParallel(unsigned int recursiveCount, bool
 		modules[i] = moduleIt.base();
 
 	// Sort modules on flow
-	std::multimap<double, NodeBase*, std::greater<double> > sortedModules;
+	std::vector<double> flows(numModules);
+	std::vector<unsigned int> order(numModules);
 	for (unsigned int i = 0; i < numModules; ++i)
 	{
-		sortedModules.insert(std::pair<double, NodeBase*>(getNodeData(*modules[i]).flow, modules[i]));
+		flows[i] = getNodeData(*modules[i]).flow;
+		order[i] = i;
 	}
-	std::multimap<double, NodeBase*, std::greater<double> >::const_iterator sortedModuleIt(sortedModules.begin());
-	for (unsigned int i = 0; i < numModules; ++i, ++sortedModuleIt)
-		modules[i] = sortedModuleIt->second;
+	std::stable_sort(order.begin(), order.end(), IndexOnDecreasingValue(flows));
+	std::vector<NodeBase*> sortedModules(numModules);
+	for (unsigned int i = 0; i < numModules; ++i)
+		sortedModules[i] = modules[order[i]];
 
-//	double t1 = omp_get_wtime();
-//	Log() << "Sorting: " << (t1-t0)*1000 << " ms";
+	partitionModules(sortedModules, recursiveCount, fast);
+}
 
-	// Partition each module in a parallel loop
+void InfomapBase::partitionModules(const std::vector<NodeBase*>& modules, unsigned int recursiveCount, bool fast)
+{
+	unsigned int numModules = modules.size();
+	std::vector<double> costs(numModules);
 	int numModulesInt = static_cast<int>(numModules);
-	int iModule;
-#pragma omp parallel for schedule(dynamic)
-	for(iModule = 0; iModule < numModulesInt; ++iModule)
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) if (!omp_in_parallel())
+#endif
+	for (int i = 0; i < numModulesInt; ++i)
+		costs[i] = estimatePartitionCost(m_treeData, *modules[i]);
+	std::vector<unsigned int> order;
+	schedulePartitionTasks(costs, order);
+
+	// Partition each module in its own task
+	std::vector<std::vector<unsigned int> > subModuleIndices(numModules);
+	std::vector<unsigned int> numSubModules(numModules, 1);
+	std::vector<double> seconds;
+	PartitionModuleTask task(*this, modules, order, recursiveCount, fast, subModuleIndices, numSubModules);
+	runTasks(task, numModules, seconds);
+	logPartitionSchedule(costs, order, seconds);
+
+	// Collect result: set sub-module index on each leaf node in the order of the modules
+	unsigned int moduleIndexOffset = 0;
+	for (unsigned int i = 0; i < numModules; ++i)
 	{
-//		omp_sched_t sched;
-//		int mod;
-//		omp_get_schedule(&sched, &mod);
-//		printf("\nThread %d in loop index %d (schedule type: %d, chunk size: %d)\n", omp_get_thread_num(), iModule, sched, mod);
-
-		unsigned int moduleIndex = static_cast<unsigned int>(iModule);
-		NodeBase& module = *modules[moduleIndex];
-
-		// Delete former sub-structure if exists
-		module.getSubStructure().subInfomap.reset(0);
+		const std::vector<unsigned int>& indices = subModuleIndices[i];
+		NodeBase::sibling_iterator nodeIt(modules[i]->begin_child());
+		for (unsigned int j = 0; j < indices.size(); ++j, ++nodeIt)
+			nodeIt->index = indices[j] + moduleIndexOffset;
+		moduleIndexOffset += numSubModules[i];
+	}
+}
 
-		if (module.childDegree() > 1)
-		{
-			std::auto_ptr<InfomapBase> subInfomap(getNewInfomapInstance());
-			subInfomap->m_subLevel = m_subLevel + 1;
-			subInfomap->reseed(getSeedFromCodelength(codelength));
-			subInfomap->initSubNetwork(module, false);
-			subInfomap->partition(recursiveCount, fast);
+void InfomapBase::partitionModule(NodeBase& module, unsigned int recursiveCount, bool fast,
+		std::vector<unsigned int>& subModuleIndices, unsigned int& numSubModules)
+{
+	// Delete former sub-structure if exists
+	module.getSubStructure().subInfomap.reset(0);
 
-			module.getSubStructure().subInfomap = subInfomap;
-		}
+	// If only one child in the module, no need to create infomap instance to find sub-module structures.
+	if (module.childDegree() == 1)
+	{
+		subModuleIndices.assign(1, 0);
+		numSubModules = 1;
+		return;
 	}
 
-//	double t2 = omp_get_wtime();
-//	Log() << "\nParallel for: " << (t2-t1)*1000 << " ms\n";
+	std::auto_ptr<InfomapBase> subInfomap(getNewInfomapInstance());
+	// To not happen to get back the same network with the same seed
+	subInfomap->m_subLevel = m_subLevel + 1;
+	subInfomap->reseed(getSeedFromCodelength(codelength));
+	subInfomap->initSubNetworkView(*this, module);
+	subInfomap->partition(recursiveCount, fast);
 
-	// Collect result: set sub-module index on each module
-	unsigned int moduleIndexOffset = 0;
-	for (unsigned int i = 0; i < numModules; ++i)
+	// The leaf nodes of the sub-network are in the same order as the children of the module
+	subModuleIndices.resize(module.childDegree());
+	unsigned int i = 0;
+	for (TreeData::leafIterator leafIt(subInfomap->m_treeData.begin_leaf()), endIt(subInfomap->m_treeData.end_leaf());
+			leafIt != endIt; ++leafIt, ++i)
 	{
-		NodeBase& module = *modules[i];
-		if (module.getSubStructure().haveSubInfomapInstance())
-		{
-			InfomapBase& subInfomap = *module.getSubStructure().subInfomap;
-
-			NodeBase::sibling_iterator originalLeafNodeIt(module.begin_child());
-			for (TreeData::leafIterator leafIt(subInfomap.m_treeData.begin_leaf()), endIt(subInfomap.m_treeData.end_leaf());
-					leafIt != endIt; ++leafIt, ++originalLeafNodeIt)
-			{
-				NodeBase& node = **leafIt;
-				originalLeafNodeIt->index = node.parent->index + moduleIndexOffset;
-			}
-			moduleIndexOffset += subInfomap.m_treeData.root()->childDegree();
-		}
-		else
-		{
-			for (NodeBase::sibling_iterator nodeIt(module.begin_child()), endIt(module.end_child());
-					nodeIt != endIt; ++nodeIt)
-			{
-				nodeIt->index = moduleIndexOffset;
-			}
-			moduleIndexOffset += 1;
-		}
+		subModuleIndices[i] = (*leafIt)->parent->index;
 	}
+	numSubModules = subInfomap->m_treeData.root()->childDegree();
 }
 
 bool InfomapBase::initNetwork()
@@ -1779,9 +2300,22 @@ bool InfomapBase::initNetwork()
  	if (checkAndConvertBinaryTree())
  		return false;
 
+	std::auto_ptr<FlowCache> flowCache;
+	if (!m_config.flowCacheDirectory.empty())
+	{
+		flowCache.reset(new FlowCache(m_config));
+		// The network printing needs the parsed network
+		if (!m_config.printPajekNetwork && !m_config.printStateNetwork && flowCache->read())
+		{
+			Log() << "Read cached flow network from '" << flowCache->filename() << "'.\n";
+			initNetwork(*flowCache);
+			return true;
+		}
+	}
+
 	if (m_config.isMemoryNetwork())
 	{
-		initMemoryNetwork();
+		initMemoryNetwork(flowCache.get());
 		return true;
 	}
 
@@ -1789,21 +2323,45 @@ bool InfomapBase::initNetwork()
 
 	network.readInputData();
 
+	setBipartiteNodeIndices(network.numNodes(), network.numBipartiteNodes());
+
+	return initNetwork(network, flowCache.get());
+}
+
+bool InfomapBase::initNetwork(Network& network)
+{
+	return initNetwork(network, 0);
+}
+
+void InfomapBase::initNetwork(FlowCache& flowCache)
+{
+	flowCache.nodeNames().swap(m_nodeNames);
+	if (m_config.isMemoryNetwork())
+	{
+		initMemoryFlowNetwork(flowCache.numNodes(), flowCache.stateNodes(), flowCache.nodeFlow(),
+				flowCache.nodeTeleportRates(), flowCache.flowLinks());
+		return;
+	}
+	setBipartiteNodeIndices(flowCache.numNodes(), flowCache.numBipartiteNodes());
+	m_featureLinks.swap(flowCache.featureLinks());
+	initFlowNetwork(flowCache.nodeFlow(), flowCache.nodeTeleportRates(), flowCache.flowLinks());
+}
+
+void InfomapBase::setBipartiteNodeIndices(unsigned int numNodes, unsigned int numBipartiteNodes)
+{
 	if (m_config.isBipartite() && m_config.hideBipartiteNodes) {
-		m_config.maxNodeIndexVisible = network.numNodes() - network.numBipartiteNodes() - 1;
-		Log() << "Skip " << network.numBipartiteNodes() << " bipartites nodes in output, limit to " <<
+		mutableConfig().maxNodeIndexVisible = numNodes - numBipartiteNodes - 1;
+		Log() << "Skip " << numBipartiteNodes << " bipartites nodes in output, limit to " <<
 				m_config.maxNodeIndexVisible + 1 << " ordinary nodes.\n";
 	}
-	m_config.minBipartiteNodeIndex = network.numNodes() - network.numBipartiteNodes();
-
-	return initNetwork(network);
+	mutableConfig().minBipartiteNodeIndex = numNodes - numBipartiteNodes;
 }
 
-bool InfomapBase::initNetwork(Network& network)
+bool InfomapBase::initNetwork(Network& network, FlowCache* flowCache)
 {
 	if (m_config.isMemoryNetwork())
 	{
-		initMemoryNetwork(static_cast<MemNetwork&>(network));
+		initMemoryNetwork(static_cast<MemNetwork&>(network), flowCache);
 		return true;
 	}
 
@@ -1840,22 +2398,55 @@ bool InfomapBase::initNetwork(Network& network)
  	network.disposeLinks();
 	network.swapNodeNames(m_nodeNames);
 
- 	const std::vector<double>& nodeFlow = flowNetwork.getNodeFlow();
- 	const std::vector<double>& nodeTeleportWeights = flowNetwork.getNodeTeleportRates();
- 	m_treeData.reserveNodeCount(network.numNodes());
+	if (flowCache != 0)
+	{
+		Log() << "Writing flow network to cache '" << flowCache->filename() << "'... " << std::flush;
+		if (flowCache->write(m_nodeNames, network.numNodes(), network.numBipartiteNodes(), flowNetwork,
+				std::vector<StateNode>()))
+			Log() << "done!\n";
+		else
+			Log() << "failed!\nWarning: " << flowCache->writeError() << " Continuing without caching the flow.\n";
+	}
+	m_featureLinks.swap(flowNetwork.getFeatureLinks());
 
- 	for (unsigned int i = 0; i < network.numNodes(); ++i)
+	initFlowNetwork(flowNetwork.getNodeFlow(), flowNetwork.getNodeTeleportRates(), flowNetwork.getFlowLinks());
+	return true;
+}
+
+void InfomapBase::initFlowNetwork(const std::vector<double>& nodeFlow, const std::vector<double>& nodeTeleportWeights,
+		const FlowNetwork::LinkVec& links)
+{
+	std::string outname = m_config.outName;
+	unsigned int numNodes = nodeFlow.size();
+ 	m_treeData.reserveNodeCount(numNodes);
+
+ 	for (unsigned int i = 0; i < numNodes; ++i)
  		m_treeData.addNewNode(m_nodeNames[i], nodeFlow[i], nodeTeleportWeights[i]);
- 	const FlowNetwork::LinkVec& links = flowNetwork.getFlowLinks();
- 	for (unsigned int i = 0; i < links.size(); ++i)
- 		m_treeData.addEdge(links[i].source, links[i].target, links[i].weight, links[i].flow * m_config.markovTime);
+
+	// Store the links only in the leaf adjacency, without an Edge object per link, if they come in
+	// order of source as it is built. The variable markov time rescales the flow on the edges.
+	bool useLeafLinkView = !m_config.variableMarkovTime;
+	for (unsigned int i = 1; useLeafLinkView && i < links.size(); ++i)
+		useLeafLinkView = links[i - 1].source <= links[i].source;
+	if (useLeafLinkView)
+	{
+		m_treeData.beginLeafLinkView(links.size());
+		for (unsigned int i = 0; i < links.size(); ++i)
+			m_treeData.addLeafLink(links[i].source, links[i].target, links[i].flow * m_config.markovTime);
+		m_treeData.endLeafLinkView();
+	}
+	else
+	{
+		for (unsigned int i = 0; i < links.size(); ++i)
+			m_treeData.addEdge(links[i].source, links[i].target, links[i].weight, links[i].flow * m_config.markovTime);
+	}
 
 	
 	if (m_config.variableMarkovTime)
 	{
 		// Adjust flow for constant entropy
 		bool useWeightedEntropy = true;
-		double averageNodeFlow = 1.0 / network.numNodes();
+		double averageNodeFlow = 1.0 / numNodes;
 		
 		double sumEntropy = 0.0;
 		for (TreeData::leafIterator it(m_treeData.begin_leaf()), itEnd(m_treeData.end_leaf());
@@ -1953,21 +2544,54 @@ bool InfomapBase::initNetwork(Network& network)
 		printFlowNetwork(flowOut);
 		Log() << "done!\n";
 	}
+}
 
- 	return true;
+void InfomapBase::addFeatureNodes(HierarchicalNetwork& output)
+{
+	unsigned int numOrdinaryNodes = m_treeData.numLeafNodes();
+	std::vector<std::pair<SNode*, double> > moduleFlow;
+	for (unsigned int i = 0; i < m_featureLinks.numFeatureNodes(); ++i)
+	{
+		// Sum the link flow on the leaf modules of the ordinary nodes, in link order to break ties
+		moduleFlow.clear();
+		for (unsigned int j = m_featureLinks.offsets[i]; j < m_featureLinks.offsets[i + 1]; ++j)
+		{
+			SNode* module = output.getLeafNode(m_featureLinks.nodes[j]).parentNode;
+			unsigned int k = 0;
+			while (k < moduleFlow.size() && moduleFlow[k].first != module)
+				++k;
+			if (k == moduleFlow.size())
+				moduleFlow.push_back(std::make_pair(module, 0.0));
+			moduleFlow[k].second += m_featureLinks.flow[j];
+		}
+
+		SNode* bestModule = &output.getRootNode();
+		double maxFlow = -1.0;
+		for (unsigned int k = 0; k < moduleFlow.size(); ++k)
+		{
+			if (moduleFlow[k].second > maxFlow)
+			{
+				maxFlow = moduleFlow[k].second;
+				bestModule = moduleFlow[k].first;
+			}
+		}
+
+		unsigned int nodeIndex = numOrdinaryNodes + i;
+		output.addLeafNode(*bestModule, 0.0, 0.0, m_nodeNames[nodeIndex], nodeIndex, nodeIndex, false, 0, nodeIndex);
+	}
 }
 
-void InfomapBase::initMemoryNetwork()
+void InfomapBase::initMemoryNetwork(FlowCache* flowCache)
 {
 	std::auto_ptr<MemNetwork> net(m_config.isMultiplexNetwork() ? new MultiplexNetwork(m_config) : new MemNetwork(m_config));
 	MemNetwork& network = *net;
 
 	network.readInputData();
 
-	initMemoryNetwork(network);
+	initMemoryNetwork(network, flowCache);
 }
 
-void InfomapBase::initMemoryNetwork(MemNetwork& network)
+void InfomapBase::initMemoryNetwork(MemNetwork& network, FlowCache* flowCache)
 {
 	if (!network.isFinalized()) {
 		Log() << "Finalizing memory network...\n";
@@ -2002,21 +2626,34 @@ void InfomapBase::initMemoryNetwork(MemNetwork& network)
 	network.disposeLinks();
 	network.swapNodeNames(m_nodeNames);
 
-//	const std::vector<std::string>& nodeNames = network.nodeNames();
-	const std::vector<double>& nodeFlow = flowNetwork.getNodeFlow();
-	const std::vector<double>& nodeTeleportWeights = flowNetwork.getNodeTeleportRates();
-	m_treeData.reserveNodeCount(network.numStateNodes());
-	const std::vector<StateNode>& stateNodes = flowNetwork.getStateNodes();
+	if (flowCache != 0)
+	{
+		Log() << "Writing flow network to cache '" << flowCache->filename() << "'... " << std::flush;
+		if (flowCache->write(m_nodeNames, network.numNodes(), 0, flowNetwork, flowNetwork.getStateNodes()))
+			Log() << "done!\n";
+		else
+			Log() << "failed!\nWarning: " << flowCache->writeError() << " Continuing without caching the flow.\n";
+	}
 
-	for (unsigned int i = 0; i < network.numStateNodes(); ++i) {
+	initMemoryFlowNetwork(network.numNodes(), flowNetwork.getStateNodes(), flowNetwork.getNodeFlow(),
+			flowNetwork.getNodeTeleportRates(), flowNetwork.getFlowLinks());
+}
+
+void InfomapBase::initMemoryFlowNetwork(unsigned int numPhysicalNodes, const std::vector<StateNode>& stateNodes,
+		const std::vector<double>& nodeFlow, const std::vector<double>& nodeTeleportWeights,
+		const FlowNetwork::LinkVec& links)
+{
+	std::string outname = m_config.outName;
+	unsigned int numStateNodes = nodeFlow.size();
+	m_treeData.reserveNodeCount(numStateNodes);
+
+	for (unsigned int i = 0; i < numStateNodes; ++i) {
 		m_treeData.addNewNode("", nodeFlow[i], nodeTeleportWeights[i]);
 		StateNode& stateNode = getMemoryNode(m_treeData.getLeafNode(i));
 		stateNode.stateIndex = stateNodes[i].stateIndex;
 		stateNode.physIndex = stateNodes[i].physIndex;
 	}
 
-	const FlowNetwork::LinkVec& links = flowNetwork.getFlowLinks();
-
 	for (unsigned int i = 0; i < links.size(); ++i) {
 		// Ignore self-links
 //		if (links[i].source == links[i].target)
@@ -2027,13 +2664,8 @@ void InfomapBase::initMemoryNetwork(MemNetwork& network)
 //	std::vector<double> m1Flow(network.numNodes(), 0.0);
 
 	// Add physical nodes
-	const MemNetwork::StateNodeMap& nodeMap = network.stateNodeMap();
-	for (MemNetwork::StateNodeMap::const_iterator statenodeIt(nodeMap.begin()); statenodeIt != nodeMap.end(); ++statenodeIt)
-	{
-		unsigned int nodeIndex = statenodeIt->second;
-		getPhysicalMembers(m_treeData.getLeafNode(nodeIndex)).push_back(PhysData(statenodeIt->first.physIndex, nodeFlow[nodeIndex]));
-//		m1Flow[statenodeIt->first.physIndex] += nodeFlow[nodeIndex];
-	}
+	for (unsigned int i = 0; i < numStateNodes; ++i)
+		getPhysicalMembers(m_treeData.getLeafNode(i)).push_back(PhysData(stateNodes[i].physIndex, nodeFlow[i]));
 
 	double sumNodeFlow = 0.0;
 	for (unsigned int i = 0; i < nodeFlow.size(); ++i)
@@ -2079,8 +2711,8 @@ void InfomapBase::initMemoryNetwork(MemNetwork& network)
 			SafeOutFile out(outName.c_str());
 			double sumFlow = 0.0;
 			double sumStateflow = 0.0;
-			std::vector<double> m1Flow(network.numNodes(), 0.0);
-			for (unsigned int i = 0; i < network.numStateNodes(); ++i)
+			std::vector<double> m1Flow(numPhysicalNodes, 0.0);
+			for (unsigned int i = 0; i < numStateNodes; ++i)
 			{
 				const PhysData& physData = getPhysicalMembers(m_treeData.getLeafNode(i))[0];
 				m1Flow[physData.physNodeIndex] += physData.sumFlowFromStateNode;
@@ -2114,6 +2746,20 @@ void InfomapBase::initSubNetwork(NodeBase& parent, bool recalculateFlow)
 	generateNetworkFromChildren(parent); // Updates the exitNetworkFlow for the nodes
 }
 
+/**
+ * Like initSubNetwork, but only the nodes are cloned. The links within the module are read
+ * from the edges of its children, or from the leaf adjacency of the parent if that is also
+ * a view, so the sub-network never owns any edges.
+ * @note Memory networks fall back to cloning the edges.
+ */
+void InfomapBase::initSubNetworkView(const InfomapBase& parentInfomap, NodeBase& parent)
+{
+	DEBUG_OUT("InfomapBase::initSubNetworkView()..." << std::endl);
+	root()->owner = &parent;
+	cloneFlowData(parent, *root());
+	generateSubNetworkView(parentInfomap.m_treeData, parent);
+}
+
 void InfomapBase::initSuperNetwork(NodeBase& parent)
 {
 	DEBUG_OUT("InfomapBase::initSuperNetwork()..." << std::endl);
@@ -2160,6 +2806,25 @@ void InfomapBase::setActiveNetworkFromLeafs()
 	m_moveTo.resize(m_activeNetwork.size());
 }
 
+void InfomapBase::initActiveAdjacency()
+{
+	bool isLeafNetwork = m_activeNetwork.size() == m_treeData.numLeafNodes();
+	for (unsigned int i = 0; isLeafNetwork && i < m_activeNetwork.size(); ++i)
+		isLeafNetwork = m_activeNetwork[i] == m_treeData.m_leafNodes[i];
+
+	if (isLeafNetwork)
+	{
+		// The leaf links don't change between the optimization rounds, only build them once
+		m_activeAdjacency = &m_treeData.leafAdjacency();
+		m_moduleAdjacency.clear();
+	}
+	else
+	{
+		m_moduleAdjacency.build(m_activeNetwork);
+		m_activeAdjacency = &m_moduleAdjacency;
+	}
+}
+
 bool InfomapBase::consolidateExternalClusterData(bool printResults)
 {
 	Log() << "Build hierarchical structure from external cluster data... " << std::flush;
@@ -2224,9 +2889,9 @@ bool InfomapBase::checkAndConvertBinaryTree()
 			FileURI(m_config.networkFile).getExtension() != "btree")
 		return false;
 
-	m_ioNetwork.readStreamableTree(m_config.networkFile);
+	ioNetwork().readStreamableTree(m_config.networkFile);
 
-	printHierarchicalData(m_ioNetwork);
+	printHierarchicalData(ioNetwork());
 
 	return true;
 }
@@ -2258,7 +2923,7 @@ unsigned int InfomapBase::numBottomModules()
 
 void InfomapBase::printNetworkData(std::string filename)
 {
-	printNetworkData(m_ioNetwork, filename);
+	printNetworkData(ioNetwork(), filename);
 }
 
 void InfomapBase::printNetworkData(HierarchicalNetwork& output, std::string filename)
@@ -30,12 +30,14 @@
 #include "TreeData.h"
 #include <string>
 #include "../io/Config.h"
+#include "../io/SharedConfig.h"
 #include "../utils/MersenneTwister.h"
 #include <memory>
 #include "../io/SafeFile.h"
 #include <limits>
 #include "../io/HierarchicalNetwork.h"
 #include "MemNetwork.h"
+#include "FlowNetwork.h"
 
 #ifdef NS_INFOMAP
 namespace infomap
@@ -46,6 +48,8 @@ struct DepthStat;
 struct PerLevelStat;
 struct PerIterationStats;
 class PartitionQueue;
+class FlowCache;
+struct SubModuleGraft;
 
 class InfomapBase
 {
@@ -53,16 +57,19 @@ protected:
 	typedef Edge<NodeBase>												EdgeType;
 public:
 	InfomapBase(const Config& conf, NodeFactoryBase* nodeFactory)
-	:	m_config(conf),
+	:	m_sharedConfig(conf),
+		m_config(m_sharedConfig.get()),
 	 	m_rand(conf.seedToRandomNumberGenerator),
 		m_treeData(nodeFactory),
 	 	m_activeNetwork(m_nonLeafActiveNetwork),
+	 	m_activeAdjacency(0),
 	 	m_isCoarseTune(false),
 	 	m_trialIndex(0),
 	 	m_tuneIterationIndex(0),
 	 	m_aggregationLevel(0),
 	 	m_numNonTrivialTopModules(0),
 	 	m_subLevel(0),
+	 	m_partitionSecondsPerCost(0.0),
 	 	m_TOP_LEVEL_ADDITION(1 << 20),
 	 	oneLevelCodelength(0.0),
 	 	codelength(0.0),
@@ -72,22 +79,24 @@ public:
 		bestHierarchicalCodelength(std::numeric_limits<double>::max()),
 	 	bestIntermediateCodelength(std::numeric_limits<double>::max()),
 		m_initialMaxNumberOfModularLevels(0),
-		m_ioNetwork(conf),
 		m_externalOutput(false),
 		bestNumLevels(0)
 	{}
 
 	InfomapBase(const InfomapBase& infomap, NodeFactoryBase* nodeFactory)
-	:	m_config(infomap.m_config),
+	:	m_sharedConfig(infomap.m_sharedConfig),
+		m_config(m_sharedConfig.get()),
 	 	m_rand(infomap.m_config.seedToRandomNumberGenerator + 1),
 		m_treeData(nodeFactory),
 	 	m_activeNetwork(m_nonLeafActiveNetwork),
+	 	m_activeAdjacency(0),
 	 	m_isCoarseTune(false),
 	 	m_trialIndex(infomap.m_trialIndex),
 	 	m_tuneIterationIndex(0),
 	 	m_aggregationLevel(0),
 	 	m_numNonTrivialTopModules(0),
 	 	m_subLevel(infomap.m_subLevel),
+	 	m_partitionSecondsPerCost(infomap.m_partitionSecondsPerCost),
 	 	m_TOP_LEVEL_ADDITION(1 << 20),
 	 	oneLevelCodelength(0.0),
 	 	codelength(0.0),
@@ -97,7 +106,6 @@ public:
 		bestHierarchicalCodelength(std::numeric_limits<double>::max()),
 	 	bestIntermediateCodelength(std::numeric_limits<double>::max()),
 		m_initialMaxNumberOfModularLevels(0),
-		m_ioNetwork(infomap.m_config),
 		m_externalOutput(false),
 		bestNumLevels(0)
 	{}
@@ -152,6 +160,21 @@ protected:
 
 	void initPreClustering(bool printResults = false);
 
+	/**
+	 * Add the feature nodes that were projected out of a bipartite network to the output,
+	 * each in the leaf module with the most flow on its links.
+	 */
+	void addFeatureNodes(HierarchicalNetwork& output);
+
+	/**
+	 * Point the active adjacency to the cached leaf adjacency if the leaf network is active,
+	 * else rebuild it from the active nodes. Requires the index of each active node to hold
+	 * its position in the active network, as set when initiating the module optimization.
+	 */
+	void initActiveAdjacency();
+
+	const Adjacency& activeAdjacency() const { return *m_activeAdjacency; }
+
 	/**
 	 * Set the exit (and enter) flow on the nodes.
 	 *
@@ -238,6 +261,10 @@ protected:
 	virtual unsigned int consolidateModules(bool replaceExistingStructure = true, bool asSubModules = false) = 0;
 
 	virtual std::auto_ptr<InfomapBase> getNewInfomapInstance() = 0;
+	/**
+	 * Get a new top-level instance with its own copy of the configuration.
+	 */
+	virtual std::auto_ptr<InfomapBase> getNewInfomapInstance(const Config& conf) = 0;
 	virtual std::auto_ptr<InfomapBase> getNewInfomapInstanceWithoutMemory() = 0;
 
 	virtual unsigned int aggregateFlowValuesFromLeafToRoot() = 0;
@@ -254,6 +281,12 @@ protected:
 
 	virtual void generateNetworkFromChildren(NodeBase& parent) = 0;
 
+	/**
+	 * Generate the network of the children of parent as a view on the links in parentTree,
+	 * without cloning any edges. The links are kept only in the leaf adjacency.
+	 */
+	virtual void generateSubNetworkView(const TreeData& parentTree, NodeBase& parent) = 0;
+
 	virtual void transformNodeFlowToEnterFlow(NodeBase* parent) = 0;
 
 	virtual void cloneFlowData(const NodeBase& source, NodeBase& target) = 0;
@@ -275,6 +308,16 @@ protected:
 
 	bool useHardPartitions() { return m_config.isMemoryNetwork() && m_config.hardPartitions && m_subLevel == 0; }
 
+	/**
+	 * Leave the feature nodes of a bipartite network out of the core loop, if the active network
+	 * holds nodes of the original network and not modules, see Config::bipartiteTwoPhase.
+	 */
+	bool skipBipartiteNodes() {
+		return m_config.bipartiteTwoPhase && m_config.isBipartite() && m_subLevel < m_TOP_LEVEL_ADDITION &&
+				!m_activeNetwork.empty() && m_activeNetwork[0]->isLeaf();
+	}
+	bool isBipartiteNode(const NodeBase& node) { return node.originalIndex >= m_config.minBipartiteNodeIndex; }
+
 	unsigned int getLevelAggregationLimit() {
 		return (m_config.fastFirstIteration && isFirstLoop()) ? 1 : m_config.levelAggregationLimit;
 	}
@@ -284,11 +327,46 @@ protected:
 		return static_cast<unsigned long int>(value/m_config.minimumCodelengthImprovement);
 	}
 
+	/**
+	 * Only change the configuration while no sub-Infomap instance sharing it is running,
+	 * as the change applies to all of them.
+	 */
+	Config& mutableConfig() { return m_sharedConfig.get(); }
+	bool stopOnTimeBudget() { return m_sharedConfig.stopOnTimeBudget(); }
+
+	HierarchicalNetwork& ioNetwork()
+	{
+		if (m_ioNetwork.get() == 0)
+			m_ioNetwork.reset(new HierarchicalNetwork(m_config));
+		return *m_ioNetwork;
+	}
+
 	void reseed(unsigned long int seed) {
 		m_rand.seed((seed + 1) * (m_trialIndex + 1) + m_config.seedToRandomNumberGenerator);
 	}
 
 private:
+	void runTrial(unsigned int iTrial, PerIterationStats& stats);
+	/**
+	 * Seed the next trial from its index, so that the result of a parallel trial doesn't depend on
+	 * which worker runs it. The serial trials continue one random stream from the seed instead.
+	 */
+	void seedTrialFromIndex(unsigned int iTrial);
+	/**
+	 * Run the trials concurrently, each thread on its own clone of the leaf network,
+	 * and keep the solution with the shortest hierarchical codelength.
+	 */
+	void runTrialsInParallel(HierarchicalNetwork& output);
+	/**
+	 * Run the trials on a clone of the leaf network without Config::bipartiteTwoPhase,
+	 * for the benchmark of the two-phase optimization against the full core loop.
+	 */
+	void runTrialsWithoutBipartiteTwoPhase(std::vector<PerIterationStats>& stats);
+	void benchmarkBipartiteTwoPhase(const std::vector<PerIterationStats>& fullStats, unsigned int numTrials);
+	/**
+	 * Replace the modular structure with the one found by another instance on a clone of the leaf network.
+	 */
+	void copyModularStructure(InfomapBase& source);
 	void runPartition();
 	double partitionAndQueueNextLevel(PartitionQueue& partitionQueue, bool tryIndexing = true);
 	void tryIndexingIteratively(bool replaceExistingModules = true);
@@ -297,7 +375,36 @@ private:
 	void queueTopModules(PartitionQueue& partitionQueue);
 	void queueLeafModules(PartitionQueue& partitionQueue);
 	bool processPartitionQueue(PartitionQueue& queue, PartitionQueue& nextLevel, bool tryIndexing = true);
-	void sortPartitionQueue(PartitionQueue& queue);
+	void partitionQueuedModule(PartitionQueue& queue, unsigned int moduleIndex, PartitionQueue& subQueue,
+			double& indexCodelength, double& moduleCodelength, double& leafCodelength, SubModuleGraft& graft,
+			bool tryIndexing);
+	/**
+	 * Copy the two-level structure found by the sub-Infomap instance into detached nodes of the owner
+	 * tree and re-target the sub-queue to them, so that the instance can be released.
+	 * @return false if the structure is deeper than two levels and can't be detached
+	 */
+	bool detachSubModules(InfomapBase& subInfomap, InfomapBase& owner, PartitionQueue& subQueue, SubModuleGraft& graft);
+	/**
+	 * Move the children of the module into the detached sub-modules and add these as its children.
+	 */
+	static void graftSubModules(NodeBase& module, SubModuleGraft& graft);
+	/**
+	 * Estimate the work of partitioning a module from its number of children and the number
+	 * of links between them, in the unit of m_partitionSecondsPerCost.
+	 */
+	static double estimatePartitionCost(const TreeData& tree, NodeBase& module);
+	/**
+	 * Order the modules on decreasing estimated cost, so that the largest ones are dispatched
+	 * first and the smaller ones fill in around them.
+	 */
+	static void schedulePartitionTasks(const std::vector<double>& costs, std::vector<unsigned int>& order);
+	/**
+	 * Log the predicted versus the measured partition time of the scheduled modules on the top
+	 * level, and calibrate the time per unit of cost from the measurement.
+	 * @param taskSeconds The work of each task from runTasks, indexed as order.
+	 */
+	void logPartitionSchedule(const std::vector<double>& costs, const std::vector<unsigned int>& order,
+			const std::vector<double>& taskSeconds);
 	void partition(unsigned int recursiveCount = 0, bool fast = false, bool forceConsolidation = true);
 	void mergeAndConsolidateRepeatedly(bool forceConsolidation = false, bool fast = false);
 	void generalTune(unsigned int level);
@@ -309,14 +416,42 @@ private:
 	 * leaf node with the sub-module structure found by partitioning each module.
 	 */
 	void partitionEachModule(unsigned int recursiveCount = 0, bool fast = false);
+	/**
+	 * As partitionEachModule, but collect the sub-module indices in order of decreasing module flow.
+	 */
 	void partitionEachModuleParallel(unsigned int recursiveCount = 0, bool fast = false);
+	void partitionModules(const std::vector<NodeBase*>& modules, unsigned int recursiveCount, bool fast);
+	void partitionModule(NodeBase& module, unsigned int recursiveCount, bool fast,
+			std::vector<unsigned int>& subModuleIndices, unsigned int& numSubModules);
+	/**
+	 * Run task(i) for each i in [0, numTasks) as OpenMP tasks and wait for them to finish.
+	 * Called inside a parallel region, the tasks join the current team, so threads that are
+	 * idle at a barrier or waiting on their own tasks steal sub-partitioning work at any
+	 * depth of the recursion. Without OpenMP the tasks run in order.
+	 * @param seconds Set to the work of each task in seconds, not counting the time spent
+	 * waiting on nested tasks (where the thread may run tasks of other modules) but counting
+	 * the work of its own nested tasks on any thread.
+	 */
+	template<typename Task>
+	static void runTasks(Task& task, unsigned int numTasks, std::vector<double>& seconds);
+	struct PartitionQueuedModuleTask;
+	struct PartitionModuleTask;
 	void initSubNetwork(NodeBase& parent, bool recalculateFlow = false);
+	void initSubNetworkView(const InfomapBase& parentInfomap, NodeBase& parent);
 	void initSuperNetwork(NodeBase& parent);
 	void setActiveNetworkFromChildrenOfRoot();
 	void setActiveNetworkFromLeafModules();
 	void setActiveNetworkFromLeafs();
-	void initMemoryNetwork();
-	void initMemoryNetwork(MemNetwork& input);
+	bool initNetwork(Network& network, FlowCache* flowCache);
+	void initNetwork(FlowCache& flowCache);
+	void setBipartiteNodeIndices(unsigned int numNodes, unsigned int numBipartiteNodes);
+	void initFlowNetwork(const std::vector<double>& nodeFlow, const std::vector<double>& nodeTeleportWeights,
+			const FlowNetwork::LinkVec& links);
+	void initMemoryNetwork(FlowCache* flowCache = 0);
+	void initMemoryNetwork(MemNetwork& input, FlowCache* flowCache = 0);
+	void initMemoryFlowNetwork(unsigned int numPhysicalNodes, const std::vector<StateNode>& stateNodes,
+			const std::vector<double>& nodeFlow, const std::vector<double>& nodeTeleportWeights,
+			const FlowNetwork::LinkVec& links);
 	void initNodeNames(Network& network);
 	bool checkAndConvertBinaryTree();
 	void printNetworkData(std::string filename = "");
@@ -334,11 +469,15 @@ private:
 
 protected:
 	typedef std::vector<NodeBase*>::iterator	activeNetwork_iterator;
-	Config m_config;
+	SharedConfig m_sharedConfig;
+	const Config& m_config; // Shared with the sub-Infomap instances, see mutableConfig()
 	MTRand m_rand;
 	TreeData m_treeData;
 	std::vector<std::string> m_nodeNames;
+	FlowNetwork::FeatureLinks m_featureLinks; // The feature nodes as hyperedges, see Config::bipartiteHyperedges
 	std::vector<NodeBase*>& m_activeNetwork; // Points either to m_nonLeafActiveNetwork or m_treeData.m_leafNodes
+	Adjacency m_moduleAdjacency;
+	const Adjacency* m_activeAdjacency; // Points either to m_moduleAdjacency or the leaf adjacency in m_treeData
 	std::vector<unsigned int> m_moveTo;
 	bool m_isCoarseTune;
 	unsigned int m_trialIndex;
@@ -346,6 +485,7 @@ protected:
 	unsigned int m_aggregationLevel;
 	unsigned int m_numNonTrivialTopModules;
 	unsigned int m_subLevel;
+	double m_partitionSecondsPerCost; // Calibrated from the measured partition times on the top level, zero until measured
 	const unsigned int m_TOP_LEVEL_ADDITION;
 	double oneLevelCodelength;
 	double codelength;
@@ -356,7 +496,7 @@ protected:
 	double bestIntermediateCodelength;
 	std::ostringstream bestIntermediateStatistics;
 	unsigned int m_initialMaxNumberOfModularLevels;
-	HierarchicalNetwork m_ioNetwork;
+	std::auto_ptr<HierarchicalNetwork> m_ioNetwork; // Created on first use, only the top level writes output
 	bool m_externalOutput; // Write to external HierarchicalNetwork
 	std::vector<PerIterationStats> m_iterationStats;
 
@@ -365,12 +505,25 @@ protected:
 
 };
 
+/**
+ * A sub-module structure found under a module, detached from the sub-Infomap instance that found it.
+ */
+struct SubModuleGraft
+{
+	SubModuleGraft() : indexCodelength(0.0) {}
+	std::vector<NodeBase*> subModules;
+	std::vector<unsigned int> numChildren; // Per sub-module
+	std::vector<unsigned int> childOrder; // Positions of the children of the module, grouped on sub-module
+	double indexCodelength;
+};
+
 struct PendingModule
 {
-	PendingModule() : module(0) {}
-	PendingModule(NodeBase* m) : module(m) {}
+	PendingModule() : module(0), owner(0) {}
+	PendingModule(NodeBase* m, InfomapBase* owner) : module(m), owner(owner) {}
 	NodeBase& operator*() { return *module; }
 	NodeBase* module;
+	InfomapBase* owner; // The Infomap instance whose tree holds the module
 };
 
 #include <deque>
@@ -112,6 +112,7 @@ protected:
 	virtual void printNodeRanks(std::ostream& out);
 
 	virtual void printFlowNetwork(std::ostream& out);
+	void printLeafLinksOfNode(std::ostream& out, unsigned int leafIndex, unsigned int indexOffset);
 
 	virtual void sortTree(NodeBase& parent);
 
@@ -174,6 +175,11 @@ void InfomapGreedy<InfomapImplementation>::printFlowNetwork(std::ostream& out)
 	{
 		NodeBase& node = **nodeIt;
 		out << node.originalIndex + indexOffset << " (" << getNode(node).data << ")\n";
+		if (m_treeData.isLeafLinkView())
+		{
+			printLeafLinksOfNode(out, node.leafIndex, indexOffset);
+			continue;
+		}
 		for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), endEdgeIt(node.end_outEdge());
 				edgeIt != endEdgeIt; ++edgeIt)
 		{
@@ -189,6 +195,45 @@ void InfomapGreedy<InfomapImplementation>::printFlowNetwork(std::ostream& out)
 	}
 }
 
+/**
+ * Print the links of a leaf node stored only in the leaf adjacency. The self-link is placed
+ * among the links as its edge would be, in order of the neighbour.
+ */
+template<typename InfomapImplementation>
+inline
+void InfomapGreedy<InfomapImplementation>::printLeafLinksOfNode(std::ostream& out, unsigned int leafIndex, unsigned int indexOffset)
+{
+	const Adjacency& links = m_treeData.leafLinkView();
+	unsigned int originalIndex = m_treeData.getLeafNode(leafIndex).originalIndex;
+	bool printSelfLink = links.hasSelfLink(leafIndex);
+	for (unsigned int link = links.beginOut(leafIndex), endLink = links.endOut(leafIndex); link != endLink; ++link)
+	{
+		unsigned int target = links.outNeighbour(link);
+		if (printSelfLink && target > leafIndex)
+		{
+			out << "  --> " << originalIndex + indexOffset << " (" << links.selfLinkFlow(leafIndex) << ")\n";
+			printSelfLink = false;
+		}
+		out << "  --> " << m_treeData.getLeafNode(target).originalIndex + indexOffset << " (" << links.outFlow(link) << ")\n";
+	}
+	if (printSelfLink)
+		out << "  --> " << originalIndex + indexOffset << " (" << links.selfLinkFlow(leafIndex) << ")\n";
+
+	printSelfLink = links.hasSelfLink(leafIndex);
+	for (unsigned int link = links.beginIn(leafIndex), endLink = links.endIn(leafIndex); link != endLink; ++link)
+	{
+		unsigned int source = links.inNeighbour(link);
+		if (printSelfLink && source > leafIndex)
+		{
+			out << "  <-- " << originalIndex + indexOffset << " (" << links.selfLinkFlow(leafIndex) << ")\n";
+			printSelfLink = false;
+		}
+		out << "  <-- " << m_treeData.getLeafNode(source).originalIndex + indexOffset << " (" << links.inFlow(link) << ")\n";
+	}
+	if (printSelfLink)
+		out << "  <-- " << originalIndex + indexOffset << " (" << links.selfLinkFlow(leafIndex) << ")\n";
+}
+
 template<typename InfomapImplementation>
 inline
 void InfomapGreedy<InfomapImplementation>::sortTree(NodeBase& parent)
@@ -221,12 +266,30 @@ inline
 void InfomapGreedy<InfomapImplementation>::saveHierarchicalNetwork(HierarchicalNetwork& output, std::string rootName, bool includeLinks)
 {
 	output.init(rootName, hierarchicalCodelength, oneLevelCodelength);
+	output.setTimeBudgetExceeded(m_sharedConfig.stoppedOnTimeBudget());
+	output.setProjectedBipartiteFlow(m_featureLinks.numFeatureNodes() > 0);
 
-	output.prepareAddLeafNodes(m_treeData.numLeafNodes());
+	unsigned int numFeatureNodes = m_config.hideBipartiteNodes ? 0 : m_featureLinks.numFeatureNodes();
+	output.prepareAddLeafNodes(m_treeData.numLeafNodes() + numFeatureNodes);
 
 	buildHierarchicalNetworkHelper(output, output.getRootNode(), m_nodeNames);
 
-	if (includeLinks)
+	if (numFeatureNodes > 0)
+		addFeatureNodes(output);
+
+	if (includeLinks && m_treeData.isLeafLinkView())
+	{
+		const Adjacency& links = m_treeData.leafLinkView();
+		for (unsigned int i = 0; i < links.numNodes(); ++i)
+		{
+			unsigned int sourceIndex = m_treeData.getLeafNode(i).originalIndex;
+			if (links.hasSelfLink(i))
+				output.addLeafEdge(sourceIndex, sourceIndex, links.selfLinkFlow(i));
+			for (unsigned int link = links.beginOut(i), endLink = links.endOut(i); link != endLink; ++link)
+				output.addLeafEdge(sourceIndex, m_treeData.getLeafNode(links.outNeighbour(link)).originalIndex, links.outFlow(link));
+		}
+	}
+	else if (includeLinks)
 	{
 		for (TreeData::leafIterator leafIt(m_treeData.begin_leaf()); leafIt != m_treeData.end_leaf(); ++leafIt)
 		{
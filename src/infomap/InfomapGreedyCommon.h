@@ -28,6 +28,8 @@
 #ifndef INFOMAPGREEDYCOMMON_H_
 #define INFOMAPGREEDYCOMMON_H_
 #include "InfomapGreedySpecialized.h"
+#include "Workspace.h"
+#include <algorithm>
 #include <memory>
 #ifdef _OPENMP
 #include <omp.h>
@@ -41,12 +43,6 @@ namespace infomap
 #endif
 
 
-struct CompNodePair {
-	bool operator() (const std::pair<NodeBase*, NodeBase*>& first, const std::pair<NodeBase*, NodeBase*>& second) const {
-		return first.first->index == second.first->index ? (first.second->index < second.second->index) : (first.first->index < second.first->index);
-	}
-};
-
 template<typename InfomapGreedyDerivedType>
 class InfomapGreedyCommon : public InfomapGreedySpecialized<typename derived_traits<InfomapGreedyDerivedType>::flow_type>
 {
@@ -80,11 +76,13 @@ protected:
 	using Super::root;
 
 	virtual std::auto_ptr<InfomapBase> getNewInfomapInstance();
+	virtual std::auto_ptr<InfomapBase> getNewInfomapInstance(const Config& conf);
 
 	NodeType& getNode(NodeBase& node);
 	const NodeType& getNode(const NodeBase& node) const;
 
 	virtual unsigned int aggregateFlowValuesFromLeafToRoot();
+	void aggregateLinkFlowBetweenModules(const NodeBase& source, const NodeBase& target, double linkFlow);
 	virtual double calcCodelengthOnAllNodesInTree();
 
 	virtual double calcCodelengthOnRootOfLeafNodes(const NodeBase& parent);
@@ -98,16 +96,26 @@ protected:
 
 	virtual unsigned int optimizeModules();
 
+	unsigned int optimizeModulesFromDirtyQueue(unsigned int loopLimit);
+
 	virtual unsigned int optimizeModulesCrude();
 
 	unsigned int tryMoveEachNodeIntoBestModule();
 
+	unsigned int tryMoveNodesIntoBestModule(const std::vector<unsigned int>& nodeOrder, std::vector<unsigned int>* dirtyQueue);
+
+	void markNodeAsDirty(unsigned int nodeIndex, std::vector<unsigned int>* dirtyQueue);
+
 	unsigned int tryMoveEachNodeIntoBestModuleParallelizable();
 
 	unsigned int tryMoveEachNodeIntoBestModuleInParallel();
 
+	unsigned int tryMoveEachNodeIntoBestModuleInBatches();
+
 	unsigned int tryMoveEachNodeIntoStrongestConnectedModule();
 
+	unsigned int moveBipartiteNodesIntoStrongestConnectedModule();
+
 	virtual void moveNodesToPredefinedModules();
 
 	virtual unsigned int consolidateModules(bool replaceExistingStructure, bool asSubModules);
@@ -133,6 +141,13 @@ std::auto_ptr<InfomapBase> InfomapGreedyCommon<InfomapGreedyDerivedType>::getNew
 	return std::auto_ptr<InfomapBase>(new InfomapGreedyDerivedType(*this));
 }
 
+template<typename InfomapGreedyDerivedType>
+inline
+std::auto_ptr<InfomapBase> InfomapGreedyCommon<InfomapGreedyDerivedType>::getNewInfomapInstance(const Config& conf)
+{
+	return std::auto_ptr<InfomapBase>(new InfomapGreedyDerivedType(conf));
+}
+
 template<typename InfomapGreedyDerivedType>
 inline
 typename InfomapGreedyCommon<InfomapGreedyDerivedType>::NodeType& InfomapGreedyCommon<InfomapGreedyDerivedType>::getNode(NodeBase& node)
@@ -174,42 +189,27 @@ inline unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::aggregateFlow
 		Log() << "Warning, aggregated flow is not exactly 1.0, but " << rootData.flow << ".\n";
 
 	// Aggregate enter and exit flow between modules
-	for (TreeData::leafIterator leafIt(m_treeData.begin_leaf());
-			leafIt != m_treeData.end_leaf(); ++leafIt)
+	if (m_treeData.isLeafLinkView())
 	{
-		NodeBase& leafNodeSource = **leafIt;
-		for (NodeBase::edge_iterator edgeIt(leafNodeSource.begin_outEdge()), endIt(leafNodeSource.end_outEdge());
-				edgeIt != endIt; ++edgeIt)
+		const Adjacency& links = m_treeData.leafLinkView();
+		for (unsigned int i = 0; i < links.numNodes(); ++i)
 		{
-			EdgeType& edge = **edgeIt;
-			NodeBase& leafNodeTarget = edge.target;
-			double linkFlow = edge.data.flow;
-
-			NodeBase* node1 = leafNodeSource.parent;
-			NodeBase* node2 = leafNodeTarget.parent;
-
-			if (node1 == node2)
-				continue;
-
-			// First aggregate link flow until equal depth
-			while(node1->originalIndex > node2->originalIndex)
-			{
-				getNode(*node1).data.exitFlow += linkFlow;
-				node1 = node1->parent;
-			}
-			while(node2->originalIndex > node1->originalIndex)
-			{
-				getNode(*node2).data.enterFlow += linkFlow;
-				node2 = node2->parent;
-			}
-
-			// Then aggregate link flow until equal parent
-			while (node1 != node2)
+			for (unsigned int link = links.beginOut(i), endLink = links.endOut(i); link != endLink; ++link)
+				aggregateLinkFlowBetweenModules(m_treeData.getLeafNode(i), m_treeData.getLeafNode(links.outNeighbour(link)),
+						links.outFlow(link));
+		}
+	}
+	else
+	{
+		for (TreeData::leafIterator leafIt(m_treeData.begin_leaf());
+				leafIt != m_treeData.end_leaf(); ++leafIt)
+		{
+			NodeBase& leafNodeSource = **leafIt;
+			for (NodeBase::edge_iterator edgeIt(leafNodeSource.begin_outEdge()), endIt(leafNodeSource.end_outEdge());
+					edgeIt != endIt; ++edgeIt)
 			{
-				getNode(*node1).data.exitFlow += linkFlow;
-				getNode(*node2).data.enterFlow += linkFlow;
-				node1 = node1->parent;
-				node2 = node2->parent;
+				EdgeType& edge = **edgeIt;
+				aggregateLinkFlowBetweenModules(leafNodeSource, edge.target, edge.data.flow);
 			}
 		}
 	}
@@ -219,6 +219,43 @@ inline unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::aggregateFlow
 	return numLevels;
 }
 
+/**
+ * Add the flow of a link between two leaf nodes to the exit flow of the modules of the source
+ * and the enter flow of the modules of the target, up to their common parent.
+ * @note The depth of each module must be stored in its originalIndex.
+ */
+template<typename InfomapGreedyDerivedType>
+inline void InfomapGreedyCommon<InfomapGreedyDerivedType>::aggregateLinkFlowBetweenModules(const NodeBase& source,
+		const NodeBase& target, double linkFlow)
+{
+	NodeBase* node1 = source.parent;
+	NodeBase* node2 = target.parent;
+
+	if (node1 == node2)
+		return;
+
+	// First aggregate link flow until equal depth
+	while(node1->originalIndex > node2->originalIndex)
+	{
+		getNode(*node1).data.exitFlow += linkFlow;
+		node1 = node1->parent;
+	}
+	while(node2->originalIndex > node1->originalIndex)
+	{
+		getNode(*node2).data.enterFlow += linkFlow;
+		node2 = node2->parent;
+	}
+
+	// Then aggregate link flow until equal parent
+	while (node1 != node2)
+	{
+		getNode(*node1).data.exitFlow += linkFlow;
+		getNode(*node2).data.enterFlow += linkFlow;
+		node1 = node1->parent;
+		node2 = node2->parent;
+	}
+}
+
 template<typename InfomapGreedyDerivedType>
 inline double InfomapGreedyCommon<InfomapGreedyDerivedType>::calcCodelengthOnAllNodesInTree()
 {
@@ -373,17 +410,78 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::optimizeModules()
 		loopLimit = static_cast<unsigned int>(Super::m_rand() * (loopLimit - minRandLoop)) + minRandLoop;
 	unsigned int loopLimitOnAggregationLevels = 20;
 
+	if (Super::m_config.dirtyNodeQueue && !Super::m_config.deterministicInnerParallelization && !Super::m_config.innerParallelization)
+		return optimizeModulesFromDirtyQueue(Super::m_aggregationLevel == 0 && !Super::m_isCoarseTune? loopLimit : loopLimitOnAggregationLevels);
+
 	// Iterate while the optimization loop moves some nodes within the dynamic modular structure
 	do
 	{
 		oldCodelength = Super::codelength;
-		if (Super::m_config.innerParallelization)
+		if (Super::m_config.deterministicInnerParallelization)
+			tryMoveEachNodeIntoBestModuleInBatches(); // returns numNodesMoved
+		else if (Super::m_config.innerParallelization)
 			tryMoveEachNodeIntoBestModuleInParallel(); // returns numNodesMoved
 		else
 			tryMoveEachNodeIntoBestModule(); // returns numNodesMoved
 		++m_coreLoopCount;
 	} while (m_coreLoopCount != (Super::m_aggregationLevel == 0 && !Super::m_isCoarseTune? loopLimit : loopLimitOnAggregationLevels) &&
-			Super::codelength < oldCodelength - Super::m_config.minimumCodelengthImprovement);
+			Super::codelength < oldCodelength - Super::m_config.minimumCodelengthImprovement &&
+			!Super::stopOnTimeBudget());
+
+	if (Super::skipBipartiteNodes())
+		moveBipartiteNodesIntoStrongestConnectedModule();
+
+	return m_coreLoopCount;
+}
+
+/**
+ * Queue-driven alternative to the sweeps in optimizeModules. Only the nodes
+ * that are dirty are visited, in random order, and only the nodes whose
+ * neighbourhood changed are queued for the next round, so the cost of a round
+ * is proportional to the number of dirty nodes instead of to the network size.
+ * Stops when the queue is drained, the codelength stops improving or after
+ * loopLimit rounds (no limit if zero), as the sweeps do.
+ */
+template<typename InfomapGreedyDerivedType>
+inline
+unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::optimizeModulesFromDirtyQueue(unsigned int loopLimit)
+{
+	m_coreLoopCount = 0;
+	unsigned int numNodes = Super::m_activeNetwork.size();
+	Workspace& workspace = Workspace::forCurrentThread();
+	std::vector<unsigned int>& dirtyQueue = workspace.dirtyQueue;
+	std::vector<unsigned int>& nextDirtyQueue = workspace.nextDirtyQueue;
+	dirtyQueue.clear();
+	for (unsigned int i = 0; i < numNodes; ++i)
+	{
+		if (Super::m_activeNetwork[i]->dirty)
+			dirtyQueue.push_back(i);
+	}
+
+	double oldCodelength = Super::codelength;
+	while (!dirtyQueue.empty())
+	{
+		oldCodelength = Super::codelength;
+		unsigned int queueSize = dirtyQueue.size();
+		for (unsigned int j = 0; j < queueSize - 1; ++j)
+		{
+			unsigned int randPos = j + Super::m_rand.randInt(queueSize - j - 1);
+			std::swap(dirtyQueue[j], dirtyQueue[randPos]);
+		}
+
+		nextDirtyQueue.clear();
+		tryMoveNodesIntoBestModule(dirtyQueue, &nextDirtyQueue);
+		dirtyQueue.swap(nextDirtyQueue);
+		++m_coreLoopCount;
+
+		if (m_coreLoopCount == loopLimit ||
+				!(Super::codelength < oldCodelength - Super::m_config.minimumCodelengthImprovement) ||
+				Super::stopOnTimeBudget())
+			break;
+	}
+
+	if (Super::skipBipartiteNodes())
+		moveBipartiteNodesIntoStrongestConnectedModule();
 
 	return m_coreLoopCount;
 }
@@ -409,6 +507,9 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::optimizeModulesCrude
 		++m_coreLoopCount;
 	} while (m_coreLoopCount != loopLimit && numMoved > 0);
 
+	if (Super::skipBipartiteNodes())
+		moveBipartiteNodesIntoStrongestConnectedModule();
+
 	return m_coreLoopCount;
 }
 
@@ -425,19 +526,45 @@ template<typename InfomapGreedyDerivedType>
 inline
 unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoBestModule()
 {
-	unsigned int numNodes = Super::m_activeNetwork.size();
 	// Get random enumeration of nodes
-	std::vector<unsigned int> randomOrder(numNodes);
+	std::vector<unsigned int>& randomOrder = Workspace::forCurrentThread().nodeOrder;
+	randomOrder.resize(Super::m_activeNetwork.size());
 	infomath::getRandomizedIndexVector(randomOrder, Super::m_rand);
+	return tryMoveNodesIntoBestModule(randomOrder, 0);
+}
 
-	std::vector<DeltaFlowType> moduleDeltaEnterExit(numNodes);
-	std::vector<unsigned int> redirect(numNodes, 0);
-	unsigned int offset = 1;
+/**
+ * Try to move each node in nodeOrder into its best module, in that order.
+ * If dirtyQueue is given, the nodes that should be visited again are appended
+ * to it: the moved nodes, the neighbours that weren't already dirty and the
+ * nodes skipped on a condition that may change within the core loop. Nodes
+ * that the core loop never moves (feature nodes and merged nodes on the first
+ * loop) keep their dirty flag but are not queued, as they would only be skipped again.
+ *
+ * @return The number of nodes moved.
+ */
+template<typename InfomapGreedyDerivedType>
+inline
+unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveNodesIntoBestModule(const std::vector<unsigned int>& nodeOrder,
+		std::vector<unsigned int>* dirtyQueue)
+{
+	unsigned int numNodes = Super::m_activeNetwork.size();
+	bool skipBipartiteNodes = Super::skipBipartiteNodes();
+	unsigned int numNodesInOrder = nodeOrder.size();
+	const Adjacency& adjacency = Super::activeAdjacency();
+
+	Workspace& workspace = Workspace::forCurrentThread();
+	std::vector<DeltaFlowType>& moduleDeltaEnterExit = workspace.moduleDeltas<DeltaFlowType>(numNodes);
+	std::vector<double>& deltaCodelengths = workspace.deltaCodelengths(numNodes + 1);
+	std::vector<double>& plogpTerms = workspace.plogpTerms;
+	workspace.prepareRedirect(numNodes);
+	std::vector<unsigned int>& redirect = workspace.redirect;
+	unsigned int offset = workspace.redirectOffset;
 	unsigned int maxOffset = std::numeric_limits<unsigned int>::max() - 1 - numNodes;
 
 
 	unsigned int numMoved = 0;
-	for (unsigned int i = 0; i < numNodes; ++i)
+	for (unsigned int i = 0; i < numNodesInOrder; ++i)
 	{
 		// Reset offset before overflow
 		if (offset > maxOffset)
@@ -446,20 +573,28 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 			offset = 1;
 		}
 
-		// Pick nodes in random order
-		unsigned int flip = randomOrder[i];
+		// Pick nodes in the given order
+		unsigned int flip = nodeOrder[i];
 		NodeType& current = getNode(*Super::m_activeNetwork[flip]);
 
 		if (!current.dirty)
 			continue;
 
+		// Feature nodes are placed after the core loop
+		if (skipBipartiteNodes && Super::isBipartiteNode(current))
+			continue;
+
 		// Don't move out from previous merge on first loop
 		if (Super::m_moduleMembers[current.index] > 1 && Super::isFirstLoop() && m_config.tuneIterationLimit != 1)
 			continue;
 
 		// Don't decrease the number of modules if already equal the preferred number
 		if (Super::isTopLevel() && Super::numActiveModules() == m_config.preferredNumberOfModules && Super::m_moduleMembers[current.index] == 1)
+		{
+			if (dirtyQueue != 0)
+				dirtyQueue->push_back(flip);
 			continue;
+		}
 
 
 		// If no links connecting this node with other nodes, it won't move into others,
@@ -480,7 +615,7 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 		// Create vector with module links
 
 		unsigned int numModuleLinks = 0;
-		if (current.isDangling())
+		if (adjacency.isDangling(flip))
 		{
 			redirect[current.index] = offset + numModuleLinks;
 			moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(current.index, 0.0, 0.0);
@@ -489,43 +624,35 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 		else
 		{
 			// For all outlinks
-			for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-					edgeIt != endIt; ++edgeIt)
+			for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
 			{
-				EdgeType& edge = **edgeIt;
-				if (edge.isSelfPointing())
-					continue;
-				NodeType& neighbour = getNode(edge.target);
+				unsigned int neighbourModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
 
-				if (redirect[neighbour.index] >= offset)
+				if (redirect[neighbourModule] >= offset)
 				{
-					moduleDeltaEnterExit[redirect[neighbour.index] - offset].deltaExit += edge.data.flow;
+					moduleDeltaEnterExit[redirect[neighbourModule] - offset].deltaExit += adjacency.outFlow(link);
 				}
 				else
 				{
-					redirect[neighbour.index] = offset + numModuleLinks;
-					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(neighbour.index, edge.data.flow, 0.0);
+					redirect[neighbourModule] = offset + numModuleLinks;
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(neighbourModule, adjacency.outFlow(link), 0.0);
 					++numModuleLinks;
 				}
 			}
 		}
 		// For all inlinks
-		for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-				edgeIt != endIt; ++edgeIt)
+		for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
 		{
-			EdgeType& edge = **edgeIt;
-			if (edge.isSelfPointing())
-				continue;
-			NodeType& neighbour = getNode(edge.source);
+			unsigned int neighbourModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
 
-			if (redirect[neighbour.index] >= offset)
+			if (redirect[neighbourModule] >= offset)
 			{
-				moduleDeltaEnterExit[redirect[neighbour.index] - offset].deltaEnter += edge.data.flow;
+				moduleDeltaEnterExit[redirect[neighbourModule] - offset].deltaEnter += adjacency.inFlow(link);
 			}
 			else
 			{
-				redirect[neighbour.index] = offset + numModuleLinks;
-				moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(neighbour.index, 0.0, edge.data.flow);
+				redirect[neighbourModule] = offset + numModuleLinks;
+				moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(neighbourModule, 0.0, adjacency.inFlow(link));
 				++numModuleLinks;
 			}
 		}
@@ -570,13 +697,16 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 		DeltaFlowType strongestConnectedModule(oldModuleDelta);
 		double deltaCodelengthOnStrongestConnectedModule = 0.0;
 
+		Super::template getDeltaCodelengthsOnMovingNode<DeltaFlowType>(current, oldModuleDelta,
+				&moduleDeltaEnterExit[0], numModuleLinks, plogpTerms, &deltaCodelengths[0]);
+
 		// Find the move that minimizes the description length
 		for (unsigned int j = 0; j < numModuleLinks; ++j)
 		{
 			unsigned int otherModule = moduleDeltaEnterExit[j].module;
 			if(otherModule != current.index)
 			{
-				double deltaCodelength = Super::getDeltaCodelengthOnMovingNode(current, oldModuleDelta, moduleDeltaEnterExit[j]);
+				double deltaCodelength = deltaCodelengths[j];
 				deltaCodelength += derived().getDeltaCodelengthOnMovingMemoryNode(oldModuleDelta, moduleDeltaEnterExit[j]);
 
 				if (deltaCodelength < bestDeltaCodelength - Super::m_config.minimumSingleNodeCodelengthImprovement)
@@ -629,13 +759,15 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 
 			++numMoved;
 
+			// The moved node stays dirty
+			if (dirtyQueue != 0)
+				dirtyQueue->push_back(flip);
+
 			// Mark neighbours as dirty
-			for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-					edgeIt != endIt; ++edgeIt)
-				(*edgeIt)->target.dirty = true;
-			for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-					edgeIt != endIt; ++edgeIt)
-				(*edgeIt)->source.dirty = true;
+			for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+				markNodeAsDirty(adjacency.outNeighbour(link), dirtyQueue);
+			for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+				markNodeAsDirty(adjacency.inNeighbour(link), dirtyQueue);
 		}
 		else
 			current.dirty = false;
@@ -643,9 +775,23 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 		offset += numNodes;
 	}
 
+	workspace.redirectOffset = offset;
 	return numMoved;
 }
 
+/**
+ * Mark the node as dirty, and queue it if it wasn't already dirty.
+ */
+template<typename InfomapGreedyDerivedType>
+inline
+void InfomapGreedyCommon<InfomapGreedyDerivedType>::markNodeAsDirty(unsigned int nodeIndex, std::vector<unsigned int>* dirtyQueue)
+{
+	NodeBase& node = *Super::m_activeNetwork[nodeIndex];
+	if (dirtyQueue != 0 && !node.dirty)
+		dirtyQueue->push_back(nodeIndex);
+	node.dirty = true;
+}
+
 /**
  * Minimize the codelength by trying to move each node into best module.
  *
@@ -660,8 +806,10 @@ inline
 unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoBestModuleParallelizable()
 {
 	unsigned int numNodes = Super::m_activeNetwork.size();
+	bool skipBipartiteNodes = Super::skipBipartiteNodes();
 	// Get random enumeration of nodes
-	std::vector<unsigned int> randomOrder(numNodes);
+	std::vector<unsigned int>& randomOrder = Workspace::forCurrentThread().nodeOrder;
+	randomOrder.resize(numNodes);
 	infomath::getRandomizedIndexVector(randomOrder, Super::m_rand);
 
 	unsigned int numMoved = 0;
@@ -676,6 +824,10 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
 		if (!current.dirty)
 			continue;
 
+		// Feature nodes are placed after the core loop
+		if (skipBipartiteNodes && Super::isBipartiteNode(current))
+			continue;
+
 		if (Super::m_moduleMembers[current.index] > 1 && Super::isFirstLoop() && m_config.tuneIterationLimit != 1)
 			continue;
 
@@ -840,280 +992,751 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoB
  * 1. Calculate the change in codelength for a move to each of its neighbouring modules or to an empty module
  * 2. Move to the one that reduces the codelength the most, if any.
  *
+ * Each thread collects the module links in its own dense scratch buffers. The best move
+ * is found optimistically on copies of the flow of the candidate modules, and then validated
+ * on the current module flow and applied while holding only the lock stripes of the old and
+ * the new module. The change in codelength terms is accumulated per thread and applied
+ * after the sweep. The empty modules are sharded on the threads, so a thread only
+ * moves nodes into empty modules that it has emptied or been given itself. Memory networks
+ * share physical node data between modules, so they are optimized serially.
+ *
  * @return The number of nodes moved.
  */
 template<typename InfomapGreedyDerivedType>
 inline
 unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoBestModuleInParallel()
 {
+#ifndef _OPENMP
+	return tryMoveEachNodeIntoBestModule();
+#else
 	// Don't nest parallelization
-	if (!Super::isTopLevel())
+	if (!Super::isTopLevel() || m_config.isMemoryNetwork())
 		return tryMoveEachNodeIntoBestModule();
 
 	unsigned int numNodes = Super::m_activeNetwork.size();
+	bool skipBipartiteNodes = Super::skipBipartiteNodes();
+	const Adjacency& adjacency = Super::activeAdjacency();
 	// Get random enumeration of nodes
-	std::vector<unsigned int> randomOrder(numNodes);
+	std::vector<unsigned int>& randomOrder = Workspace::forCurrentThread().nodeOrder;
+	randomOrder.resize(numNodes);
 	infomath::getRandomizedIndexVector(randomOrder, Super::m_rand);
 
+	// Seed one random number generator per thread to randomize link order without sharing state
+	int numThreads = omp_get_max_threads();
+	std::vector<unsigned long> threadSeeds(numThreads);
+	for (int i = 0; i < numThreads; ++i)
+		threadSeeds[i] = Super::m_rand.randInt();
+
+	// Lock stripes protecting the flow data and member count of the modules
+	const unsigned int numLockStripes = std::min(numNodes, 4096u);
+	std::vector<omp_lock_t> moduleLocks(numLockStripes);
+	for (unsigned int i = 0; i < numLockStripes; ++i)
+		omp_init_lock(&moduleLocks[i]);
+
+	// Shard the empty modules on the threads, each thread only takes and returns its own
+	std::vector<std::vector<unsigned int> > emptyModuleShards(numThreads);
+	for (unsigned int i = 0; i < Super::m_emptyModules.size(); ++i)
+		emptyModuleShards[i % numThreads].push_back(Super::m_emptyModules[i]);
+	unsigned int numEmptyModules = Super::m_emptyModules.size();
+
 	unsigned int numMoved = 0;
 	unsigned int numInvalidMoves = 0;
-	double diffSerialParallelCodelength = 0.0;
+	CodelengthTermsDelta sumTermsDelta;
 	const unsigned int emptyTarget = numNodes; // Use last node index + 1 as index for empty module target.
 	int numNodesInt = static_cast<int>(numNodes);
 
-//#pragma omp parallel for schedule(static)
-#pragma omp parallel for schedule(dynamic) // Use dynamic scheduling as some threads could end early
-	for (int i = 0; i < numNodesInt; ++i)
+#pragma omp parallel reduction(+:numMoved,numInvalidMoves)
 	{
-//		printf("Node %d processed by thread %d\n", i, omp_get_thread_num());
-		// Pick nodes in random order
-		unsigned int flip = randomOrder[i];
-		NodeType& current = getNode(*Super::m_activeNetwork[flip]);
-
-		if (!current.dirty)
-			continue;
-
-		// If other nodes have moved here, don't move away on first loop
-		if (Super::m_moduleMembers[current.index] > 1 && Super::isFirstLoop() && m_config.tuneIterationLimit != 1)
-			continue;
-
-		// Don't decrease the number of modules if already equal the preferred number
-		if (Super::isTopLevel() && Super::numActiveModules() == m_config.preferredNumberOfModules && Super::m_moduleMembers[current.index] == 1)
-			continue;
-
-		// If no links connecting this node with other nodes, it won't move into others,
-		// and others won't move into this. TODO: Always best leave it alone?
-//		if (current.degree() == 0)
-		if (current.degree() == 0 ||
-			(Super::m_config.includeSelfLinks &&
-			(current.outDegree() == 1 && current.inDegree() == 1) &&
-			(**current.begin_outEdge()).target == current))
+		MTRand rand(threadSeeds[omp_get_thread_num()]);
+		std::vector<unsigned int>& emptyModules = emptyModuleShards[omp_get_thread_num()];
+		Workspace& workspace = Workspace::forCurrentThread();
+		std::vector<DeltaFlowType>& moduleDeltaEnterExit = workspace.moduleDeltas<DeltaFlowType>(numNodes + 1);
+		std::vector<double>& deltaCodelengths = workspace.deltaCodelengths(numNodes + 1);
+		std::vector<double>& plogpTerms = workspace.plogpTerms;
+		workspace.prepareRedirect(numNodes);
+		std::vector<unsigned int>& redirect = workspace.redirect;
+		unsigned int offset = workspace.redirectOffset;
+		unsigned int maxOffset = std::numeric_limits<unsigned int>::max() - 1 - numNodes;
+		CodelengthTermsDelta termsDelta;
+
+		// The decision phase is optimistic. It reads the flow of the candidate modules from copies
+		// taken under their locks, as the module flow is only written under the locks, and the
+		// apply phase validates the move on the current module flow. The module of each node, the
+		// number of members of each module and the dirty flags are read and written atomically.
+		std::vector<FlowType> moduleFlowCopy(numNodes);
+		std::vector<ModulePlogpTerms> modulePlogpTermsCopy(numNodes);
+
+#pragma omp for schedule(dynamic, 64) // Use dynamic scheduling as some threads could end early
+		for (int i = 0; i < numNodesInt; ++i)
 		{
-			DEBUG_OUT("SKIPPING isolated node " << current << "\n");
-			//TODO: If not skipping self-links, this yields different results from moveNodesToPredefinedModules!!
-			ASSERT(!m_config.includeSelfLinks);
-			current.dirty = false;
-			continue;
-		}
-
-		// Create map with module links
-		std::map<unsigned int, DeltaFlowType> deltaFlow;
+			// Reset offset before overflow
+			if (offset > maxOffset)
+			{
+				redirect.assign(numNodes, 0);
+				offset = 1;
+			}
 
-		// If alone in the module, add virtual link to the module (used when adding teleportation)
-		deltaFlow[current.index] += DeltaFlowType(current.index, 0.0, 0.0);
+			// Pick nodes in random order
+			unsigned int flip = randomOrder[i];
+			NodeType& current = getNode(*Super::m_activeNetwork[flip]);
 
-		// For all outlinks
-		for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-				edgeIt != endIt; ++edgeIt)
-		{
-			EdgeType& edge = **edgeIt;
-			if (edge.isSelfPointing())
+			bool isDirty;
+#pragma omp atomic read
+			isDirty = current.dirty;
+			if (!isDirty)
 				continue;
-			NodeType& neighbour = getNode(edge.target);
 
-			deltaFlow[neighbour.index] += DeltaFlowType(neighbour.index, edge.data.flow, 0.0);
-		}
-		// For all inlinks
-		for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-				edgeIt != endIt; ++edgeIt)
-		{
-			EdgeType& edge = **edgeIt;
-			if (edge.isSelfPointing())
+			// Feature nodes are placed after the core loop
+			if (skipBipartiteNodes && Super::isBipartiteNode(current))
 				continue;
-			NodeType& neighbour = getNode(edge.source);
-
-			deltaFlow[neighbour.index] += DeltaFlowType(neighbour.index, 0.0, edge.data.flow);
-		}
-
-
-		// Empty function if no teleportation coding model
-		Super::template addTeleportationDeltaFlowIfMove<DeltaFlowType>(current, deltaFlow);
-
-		// Option to move to empty module (if node not already alone, and not already at the preferred number of modules)
-		unsigned int emptyModuleIndex = emptyTarget;
-		if (Super::m_moduleMembers[current.index] > 1 && Super::m_emptyModules.size() > 0 &&
-				(m_config.preferredNumberOfModules == 0 || (Super::isTopLevel() && Super::numActiveModules() != m_config.preferredNumberOfModules)))
-		{
-			emptyModuleIndex = Super::m_emptyModules.back();
-			deltaFlow[emptyModuleIndex] += DeltaFlowType(emptyModuleIndex, 0.0, 0.0);
-		}
 
-		// Store the DeltaFlow of the current module
-		DeltaFlowType oldModuleDelta(deltaFlow[current.index]);
+			unsigned int numOldModuleMembers;
+#pragma omp atomic read
+			numOldModuleMembers = Super::m_moduleMembers[current.index];
 
-		// For memory networks
-		derived().addContributionOfMovingMemoryNodes(current, oldModuleDelta, deltaFlow);
+			// If other nodes have moved here, don't move away on first loop
+			if (numOldModuleMembers > 1 && Super::isFirstLoop() && m_config.tuneIterationLimit != 1)
+				continue;
 
+			unsigned int numActiveModules;
+#pragma omp atomic read
+			numActiveModules = numEmptyModules;
+			numActiveModules = numNodes - numActiveModules;
 
-		std::vector<DeltaFlowType> moduleDeltaEnterExit(deltaFlow.size());
-		unsigned int numModuleLinks = 0;
-		for (typename std::map<unsigned int, DeltaFlowType>::iterator it(deltaFlow.begin()); it != deltaFlow.end(); ++it)
-		{
-			moduleDeltaEnterExit[numModuleLinks] = it->second;
-			++numModuleLinks;
-		}
+			// Don't decrease the number of modules if already equal the preferred number
+			if (numActiveModules == m_config.preferredNumberOfModules && numOldModuleMembers == 1)
+				continue;
 
-		// Randomize link order for optimized search
-		for (unsigned int j = 0; j < numModuleLinks - 1; ++j)
-		{
-			unsigned int randPos = j + Super::m_rand.randInt(numModuleLinks - j - 1);
-			swap(moduleDeltaEnterExit[j], moduleDeltaEnterExit[randPos]);
-		}
+			// If no links connecting this node with other nodes, it won't move into others,
+			// and others won't move into this. TODO: Always best leave it alone?
+			if (adjacency.isIsolated(flip, Super::m_config.includeSelfLinks))
+			{
+				DEBUG_OUT("SKIPPING isolated node " << current << "\n");
+				//TODO: If not skipping self-links, this yields different results from moveNodesToPredefinedModules!!
+				ASSERT(!m_config.includeSelfLinks);
+#pragma omp atomic write
+				current.dirty = false;
+				continue;
+			}
 
-		DeltaFlowType bestDeltaModule(oldModuleDelta);
-		double bestDeltaCodelength = 0.0;
-		DeltaFlowType strongestConnectedModule(oldModuleDelta);
-		double deltaCodelengthOnStrongestConnectedModule = 0.0;
+			// Create vector with module links
+			unsigned int numModuleLinks = 0;
 
-		// Find the move that minimizes the description length
-		for (unsigned int j = 0; j < numModuleLinks; ++j)
-		{
-			unsigned int otherModule = moduleDeltaEnterExit[j].module;
-			if(otherModule != current.index)
+			// For all outlinks
+			for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
 			{
-				double deltaCodelength = Super::getDeltaCodelengthOnMovingNode(current, oldModuleDelta, moduleDeltaEnterExit[j]);
-				deltaCodelength += derived().getDeltaCodelengthOnMovingMemoryNode(oldModuleDelta, moduleDeltaEnterExit[j]);
+				unsigned int otherModule;
+#pragma omp atomic read
+				otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
 
-				if (deltaCodelength < bestDeltaCodelength - Super::m_config.minimumSingleNodeCodelengthImprovement)
+				if (redirect[otherModule] >= offset)
 				{
-					bestDeltaModule = moduleDeltaEnterExit[j];
-					bestDeltaCodelength = deltaCodelength;
+					moduleDeltaEnterExit[redirect[otherModule] - offset].deltaExit += adjacency.outFlow(link);
 				}
-
-				// Save strongest connected module to prefer if codelength improvement equal
-				if (moduleDeltaEnterExit[j].deltaExit > strongestConnectedModule.deltaExit)
+				else
 				{
-					strongestConnectedModule = moduleDeltaEnterExit[j];
-					deltaCodelengthOnStrongestConnectedModule = deltaCodelength;
+					redirect[otherModule] = offset + numModuleLinks;
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(otherModule, adjacency.outFlow(link), 0.0);
+					++numModuleLinks;
 				}
 			}
-		}
-
-		// Prefer strongest connected module if equal delta codelength
-		if (strongestConnectedModule.module != bestDeltaModule.module &&
-				deltaCodelengthOnStrongestConnectedModule <= bestDeltaCodelength)// + Super::m_config.minimumCodelengthImprovement)
-		{
-			bestDeltaModule = strongestConnectedModule;
-		}
-
-		// Make best possible move
-		if(bestDeltaModule.module == current.index)
-		{
-			current.dirty = false;
-			continue;
-		}
-		else
-		{
-#pragma omp critical (moveUpdate)
+			// For all inlinks
+			for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
 			{
-				unsigned int bestModuleIndex = bestDeltaModule.module;
-				unsigned int oldModuleIndex = current.index;
+				unsigned int otherModule;
+#pragma omp atomic read
+				otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
 
-				bool validMove = true;
-				if (bestModuleIndex == emptyModuleIndex)	{
-					// Check validity of move to empty target
-					validMove = Super::m_moduleMembers[current.index] > 1 && Super::m_emptyModules.size() > 0;
+				if (redirect[otherModule] >= offset)
+				{
+					moduleDeltaEnterExit[redirect[otherModule] - offset].deltaEnter += adjacency.inFlow(link);
 				}
 				else
 				{
-					// Not valid if the best module is empty now but not when decided
-					validMove = Super::m_moduleMembers[bestModuleIndex] > 0;
+					redirect[otherModule] = offset + numModuleLinks;
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(otherModule, 0.0, adjacency.inFlow(link));
+					++numModuleLinks;
 				}
+			}
 
-				if (validMove)
-				{
-
-					// Recalculate delta codelength for proposed move to see if still an improvement
-					DeltaFlowType oldModuleDelta(oldModuleIndex, 0.0, 0.0, 0.0, 0.0);
-					DeltaFlowType newModuleDelta(bestModuleIndex, 0.0, 0.0, 0.0, 0.0);
+			// If alone in the module, add virtual link to the module (used when adding teleportation)
+			if (redirect[current.index] < offset)
+			{
+				redirect[current.index] = offset + numModuleLinks;
+				moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(current.index, 0.0, 0.0);
+				++numModuleLinks;
+			}
 
-					Super::addTeleportationDeltaFlowOnOldModuleIfMove(current, oldModuleDelta);
-					Super::addTeleportationDeltaFlowOnNewModuleIfMove(current, newModuleDelta);
+			// Option to move to empty module (if node not already alone, and not already at the preferred number of modules)
+			unsigned int numLinkedModules = numModuleLinks;
+			unsigned int emptyModuleIndex = emptyTarget;
+			if (numOldModuleMembers > 1 && !emptyModules.empty() &&
+					(m_config.preferredNumberOfModules == 0 || numActiveModules != m_config.preferredNumberOfModules))
+			{
+				emptyModuleIndex = emptyModules.back();
+				if (redirect[emptyModuleIndex] < offset)
+				{
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(emptyModuleIndex, 0.0, 0.0);
+					++numModuleLinks;
+				}
+			}
+
+			// Copy the flow of the candidate modules under their locks
+			for (unsigned int j = 0; j < numModuleLinks; ++j)
+			{
+				unsigned int module = moduleDeltaEnterExit[j].module;
+				omp_lock_t& moduleLock = moduleLocks[module % numLockStripes];
+				omp_set_lock(&moduleLock);
+				moduleFlowCopy[module] = Super::m_moduleFlowData[module];
+				modulePlogpTermsCopy[module] = Super::m_modulePlogpTerms[module];
+				omp_unset_lock(&moduleLock);
+			}
+
+			// Empty function if no teleportation coding model, not added on the empty module
+			Super::template addTeleportationDeltaFlowIfMove<DeltaFlowType>(current, moduleDeltaEnterExit, numLinkedModules,
+					moduleFlowCopy);
+
+			// Store the DeltaFlow of the current module
+			DeltaFlowType oldModuleDelta(moduleDeltaEnterExit[redirect[current.index] - offset]);
+
+			// Randomize link order for optimized search
+			for (unsigned int j = 0; j < numModuleLinks - 1; ++j)
+			{
+				unsigned int randPos = j + rand.randInt(numModuleLinks - j - 1);
+				swap(moduleDeltaEnterExit[j], moduleDeltaEnterExit[randPos]);
+			}
+
+			DeltaFlowType bestDeltaModule(oldModuleDelta);
+			double bestDeltaCodelength = 0.0;
+			DeltaFlowType strongestConnectedModule(oldModuleDelta);
+			double deltaCodelengthOnStrongestConnectedModule = 0.0;
+
+			Super::template getDeltaCodelengthsOnMovingNode<DeltaFlowType>(current, oldModuleDelta,
+					&moduleDeltaEnterExit[0], numModuleLinks, plogpTerms, &deltaCodelengths[0],
+					moduleFlowCopy, modulePlogpTermsCopy);
+
+			// Find the move that minimizes the description length
+			for (unsigned int j = 0; j < numModuleLinks; ++j)
+			{
+				unsigned int otherModule = moduleDeltaEnterExit[j].module;
+				if(otherModule != current.index)
+				{
+					double deltaCodelength = deltaCodelengths[j];
+
+					if (deltaCodelength < bestDeltaCodelength - Super::m_config.minimumSingleNodeCodelengthImprovement)
+					{
+						bestDeltaModule = moduleDeltaEnterExit[j];
+						bestDeltaCodelength = deltaCodelength;
+					}
+
+					// Save strongest connected module to prefer if codelength improvement equal
+					if (moduleDeltaEnterExit[j].deltaExit > strongestConnectedModule.deltaExit)
+					{
+						strongestConnectedModule = moduleDeltaEnterExit[j];
+						deltaCodelengthOnStrongestConnectedModule = deltaCodelength;
+					}
+				}
+			}
+
+			offset += numNodes;
+
+			// Prefer strongest connected module if equal delta codelength
+			if (strongestConnectedModule.module != bestDeltaModule.module &&
+					deltaCodelengthOnStrongestConnectedModule <= bestDeltaCodelength)// + Super::m_config.minimumCodelengthImprovement)
+			{
+				bestDeltaModule = strongestConnectedModule;
+			}
+
+			if(bestDeltaModule.module == current.index)
+			{
+#pragma omp atomic write
+				current.dirty = false;
+				continue;
+			}
+
+			// Lock the old and the new module in stripe order to avoid deadlocks
+			unsigned int oldModuleIndex = current.index;
+			unsigned int bestModuleIndex = bestDeltaModule.module;
+			unsigned int firstStripe = std::min(oldModuleIndex % numLockStripes, bestModuleIndex % numLockStripes);
+			unsigned int secondStripe = std::max(oldModuleIndex % numLockStripes, bestModuleIndex % numLockStripes);
+			omp_set_lock(&moduleLocks[firstStripe]);
+			if (secondStripe != firstStripe)
+				omp_set_lock(&moduleLocks[secondStripe]);
+
+			// Validate the move against the current state of the two modules
+			bool validMove = true;
+			if (bestModuleIndex == emptyModuleIndex)
+			{
+				// Not valid if another node has moved into the empty target or if left alone
+				validMove = Super::m_moduleMembers[bestModuleIndex] == 0 && Super::m_moduleMembers[oldModuleIndex] > 1;
+			}
+			else
+			{
+				// Not valid if the best module is empty now but not when decided
+				validMove = Super::m_moduleMembers[bestModuleIndex] > 0;
+			}
+
+			if (validMove)
+			{
+				// Recalculate delta codelength for proposed move to see if still an improvement
+				DeltaFlowType oldModuleDelta(oldModuleIndex, 0.0, 0.0);
+				DeltaFlowType newModuleDelta(bestModuleIndex, 0.0, 0.0);
+
+				Super::addTeleportationDeltaFlowOnOldModuleIfMove(current, oldModuleDelta);
+				Super::addTeleportationDeltaFlowOnNewModuleIfMove(current, newModuleDelta);
+
+				// For all outlinks
+				for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+				{
+					unsigned int otherModule;
+#pragma omp atomic read
+					otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
+					if (otherModule == oldModuleIndex)
+						oldModuleDelta.deltaExit += adjacency.outFlow(link);
+					else if (otherModule == bestModuleIndex)
+						newModuleDelta.deltaExit += adjacency.outFlow(link);
+				}
+
+				// For all inlinks
+				for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+				{
+					unsigned int otherModule;
+#pragma omp atomic read
+					otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
+					if (otherModule == oldModuleIndex)
+						oldModuleDelta.deltaEnter += adjacency.inFlow(link);
+					else if (otherModule == bestModuleIndex)
+						newModuleDelta.deltaEnter += adjacency.inFlow(link);
+				}
+
+				double deltaCodelength = Super::getDeltaCodelengthOnMovingNode(current, oldModuleDelta, newModuleDelta);
+
+				if (deltaCodelength <= 0.0 - Super::m_config.minimumSingleNodeCodelengthImprovement)
+				{
+					// Update empty module vector, an empty best module is the last in the shard of this thread
+					if (Super::m_moduleMembers[bestModuleIndex] == 0)
+					{
+						emptyModules.pop_back();
+#pragma omp atomic
+						--numEmptyModules;
+					}
+					if (Super::m_moduleMembers[oldModuleIndex] == 1)
+					{
+						emptyModules.push_back(oldModuleIndex);
+#pragma omp atomic
+						++numEmptyModules;
+					}
+
+					Super::updateModuleFlowOnMovingNode(current, oldModuleDelta, newModuleDelta, termsDelta);
+
+#pragma omp atomic
+					Super::m_moduleMembers[oldModuleIndex] -= 1;
+#pragma omp atomic
+					Super::m_moduleMembers[bestModuleIndex] += 1;
+
+#pragma omp atomic write
+					current.index = bestModuleIndex;
+					++numMoved;
+				}
+				else
+				{
+					++numInvalidMoves;
+				}
+			}
+			else
+			{
+				++numInvalidMoves;
+			}
+
+			if (secondStripe != firstStripe)
+				omp_unset_lock(&moduleLocks[secondStripe]);
+			omp_unset_lock(&moduleLocks[firstStripe]);
+
+			// Mark neighbours as dirty
+			if (current.index == bestModuleIndex)
+			{
+				for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+				{
+#pragma omp atomic write
+					Super::m_activeNetwork[adjacency.outNeighbour(link)]->dirty = true;
+				}
+				for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+				{
+#pragma omp atomic write
+					Super::m_activeNetwork[adjacency.inNeighbour(link)]->dirty = true;
+				}
+			}
+		}
+		workspace.redirectOffset = offset;
+
+#pragma omp atomic
+		sumTermsDelta.enterFlow += termsDelta.enterFlow;
+#pragma omp atomic
+		sumTermsDelta.enter_log_enter += termsDelta.enter_log_enter;
+#pragma omp atomic
+		sumTermsDelta.exit_log_exit += termsDelta.exit_log_exit;
+#pragma omp atomic
+		sumTermsDelta.flow_log_flow += termsDelta.flow_log_flow;
+	}
 
+	for (unsigned int i = 0; i < numLockStripes; ++i)
+		omp_destroy_lock(&moduleLocks[i]);
+
+	Super::m_emptyModules.clear();
+	for (int i = 0; i < numThreads; ++i)
+		Super::m_emptyModules.insert(Super::m_emptyModules.end(), emptyModuleShards[i].begin(), emptyModuleShards[i].end());
+
+	Super::applyCodelengthTermsDelta(sumTermsDelta);
+
+	return numMoved + numInvalidMoves;
+#endif
+}
+
+/**
+ * Minimize the codelength by trying to move each node into best module, in parallel
+ * conflict-free batches.
+ *
+ * The dirty nodes are greedily colored in random order so that no neighbours share
+ * a color, and each color class is processed as a batch:
+ * 1. For each node in the batch, find the best module in parallel on a fixed state
+ * 2. Validate and apply the proposed moves serially in the order of the batch
+ *
+ * As the proposals only depend on the state before each batch and the moves are
+ * applied in a fixed order, the result doesn't depend on the number of threads.
+ *
+ * @return The number of nodes moved.
+ */
+template<typename InfomapGreedyDerivedType>
+inline
+unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoBestModuleInBatches()
+{
+	// Don't nest parallelization, the serial version is deterministic too
+	if (!Super::isTopLevel() || m_config.isMemoryNetwork())
+		return tryMoveEachNodeIntoBestModule();
+
+	unsigned int numNodes = Super::m_activeNetwork.size();
+	bool skipBipartiteNodes = Super::skipBipartiteNodes();
+	const Adjacency& adjacency = Super::activeAdjacency();
+	// Get random enumeration of nodes
+	std::vector<unsigned int>& randomOrder = Workspace::forCurrentThread().nodeOrder;
+	randomOrder.resize(numNodes);
+	infomath::getRandomizedIndexVector(randomOrder, Super::m_rand);
+
+	const unsigned int noColor = std::numeric_limits<unsigned int>::max();
+	std::vector<unsigned int> color(numNodes, noColor);
+	std::vector<unsigned int> colorUsedByNode(numNodes + 1, noColor);
+	std::vector<unsigned int> batchSizes;
+	for (unsigned int i = 0; i < numNodes; ++i)
+	{
+		unsigned int flip = randomOrder[i];
+		NodeBase& current = *Super::m_activeNetwork[flip];
+		if (!current.dirty)
+			continue;
+
+		// Feature nodes are placed after the core loop
+		if (skipBipartiteNodes && Super::isBipartiteNode(current))
+			continue;
+
+		for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+		{
+			unsigned int neighbourColor = color[adjacency.outNeighbour(link)];
+			if (neighbourColor != noColor)
+				colorUsedByNode[neighbourColor] = i;
+		}
+		for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+		{
+			unsigned int neighbourColor = color[adjacency.inNeighbour(link)];
+			if (neighbourColor != noColor)
+				colorUsedByNode[neighbourColor] = i;
+		}
+
+		unsigned int nodeColor = 0;
+		while (colorUsedByNode[nodeColor] == i)
+			++nodeColor;
+		color[flip] = nodeColor;
+		if (nodeColor == batchSizes.size())
+			batchSizes.push_back(0);
+		++batchSizes[nodeColor];
+	}
+
+	// Order the nodes on batch, keeping the random order within each batch
+	unsigned int numBatches = batchSizes.size();
+	std::vector<unsigned int> batchStart(numBatches + 1, 0);
+	for (unsigned int i = 0; i < numBatches; ++i)
+		batchStart[i + 1] = batchStart[i] + batchSizes[i];
+	std::vector<unsigned int> batchNodes(batchStart[numBatches]);
+	std::vector<unsigned int> batchFill(batchStart.begin(), batchStart.end() - 1);
+	for (unsigned int i = 0; i < numNodes; ++i)
+	{
+		unsigned int flip = randomOrder[i];
+		if (color[flip] != noColor)
+			batchNodes[batchFill[color[flip]]++] = flip;
+	}
+
+	// A skipped node keeps its dirty flag as in the serial loop
+	const unsigned int noProposal = std::numeric_limits<unsigned int>::max();
+	std::vector<unsigned int> proposedModule(batchNodes.size());
+	std::vector<double> proposedDeltaCodelength(batchNodes.size());
+	unsigned int numMoved = 0;
+	// Each node in a batch is offered its own empty module, taken out of the empty modules during
+	// the batch so that moving into it doesn't have to search for it
+	std::vector<unsigned int> batchEmptyModules;
+	std::vector<unsigned char> batchEmptyModuleTaken;
+	unsigned int batchNumActiveModules = 0;
+
+#pragma omp parallel
+	{
+		Workspace& workspace = Workspace::forCurrentThread();
+		std::vector<DeltaFlowType>& moduleDeltaEnterExit = workspace.moduleDeltas<DeltaFlowType>(numNodes + 1);
+		std::vector<double>& deltaCodelengths = workspace.deltaCodelengths(numNodes + 1);
+		std::vector<double>& plogpTerms = workspace.plogpTerms;
+		workspace.prepareRedirect(numNodes);
+		std::vector<unsigned int>& redirect = workspace.redirect;
+		unsigned int offset = workspace.redirectOffset;
+		unsigned int maxOffset = std::numeric_limits<unsigned int>::max() - 1 - numNodes;
+
+		for (unsigned int iBatch = 0; iBatch < numBatches; ++iBatch)
+		{
+			int batchBegin = static_cast<int>(batchStart[iBatch]);
+			int batchEnd = static_cast<int>(batchStart[iBatch + 1]);
+
+#pragma omp single
+			{
+				batchNumActiveModules = Super::numActiveModules();
+				unsigned int numBatchEmptyModules = std::min(static_cast<unsigned int>(batchEnd - batchBegin), static_cast<unsigned int>(Super::m_emptyModules.size()));
+				batchEmptyModules.assign(Super::m_emptyModules.end() - numBatchEmptyModules, Super::m_emptyModules.end());
+				std::reverse(batchEmptyModules.begin(), batchEmptyModules.end());
+				Super::m_emptyModules.resize(Super::m_emptyModules.size() - numBatchEmptyModules);
+				batchEmptyModuleTaken.assign(numBatchEmptyModules, 0);
+			}
+
+#pragma omp for schedule(dynamic, 64)
+			for (int k = batchBegin; k < batchEnd; ++k)
+			{
+				// Reset offset before overflow
+				if (offset > maxOffset)
+				{
+					redirect.assign(numNodes, 0);
+					offset = 1;
+				}
+
+				unsigned int flip = batchNodes[k];
+				NodeType& current = getNode(*Super::m_activeNetwork[flip]);
+				proposedModule[k] = noProposal;
+
+				// Don't move out from previous merge on first loop
+				if (Super::m_moduleMembers[current.index] > 1 && Super::isFirstLoop() && m_config.tuneIterationLimit != 1)
+					continue;
+
+				// Don't decrease the number of modules if already equal the preferred number
+				if (batchNumActiveModules == m_config.preferredNumberOfModules && Super::m_moduleMembers[current.index] == 1)
+					continue;
+
+				// Create vector with module links
+				unsigned int numModuleLinks = 0;
+				if (adjacency.isDangling(flip))
+				{
+					redirect[current.index] = offset + numModuleLinks;
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(current.index, 0.0, 0.0);
+					++numModuleLinks;
+				}
+				else
+				{
 					// For all outlinks
-					for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-							edgeIt != endIt; ++edgeIt)
+					for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
 					{
-						EdgeType& edge = **edgeIt;
-						if (edge.isSelfPointing())
-							continue;
-						unsigned int otherModule = edge.target.index;
-						if (otherModule == oldModuleIndex)
-							oldModuleDelta.deltaExit += edge.data.flow;
-						else if (otherModule == bestModuleIndex)
-							newModuleDelta.deltaExit += edge.data.flow;
+						unsigned int otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
+
+						if (redirect[otherModule] >= offset)
+						{
+							moduleDeltaEnterExit[redirect[otherModule] - offset].deltaExit += adjacency.outFlow(link);
+						}
+						else
+						{
+							redirect[otherModule] = offset + numModuleLinks;
+							moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(otherModule, adjacency.outFlow(link), 0.0);
+							++numModuleLinks;
+						}
 					}
+				}
+				// For all inlinks
+				for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+				{
+					unsigned int otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
 
-					// For all inlinks
-					for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-							edgeIt != endIt; ++edgeIt)
+					if (redirect[otherModule] >= offset)
 					{
-						EdgeType& edge = **edgeIt;
-						if (edge.isSelfPointing())
-							continue;
-						unsigned int otherModule = edge.source.index;
-						if (otherModule == oldModuleIndex)
-							oldModuleDelta.deltaEnter += edge.data.flow;
-						else if (otherModule == bestModuleIndex)
-							newModuleDelta.deltaEnter += edge.data.flow;
+						moduleDeltaEnterExit[redirect[otherModule] - offset].deltaEnter += adjacency.inFlow(link);
+					}
+					else
+					{
+						redirect[otherModule] = offset + numModuleLinks;
+						moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(otherModule, 0.0, adjacency.inFlow(link));
+						++numModuleLinks;
 					}
+				}
 
+				// If alone in the module, add virtual link to the module (used when adding teleportation)
+				if (redirect[current.index] < offset)
+				{
+					redirect[current.index] = offset + numModuleLinks;
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(current.index, 0.0, 0.0);
+					++numModuleLinks;
+				}
 
-					double deltaCodelength = Super::getDeltaCodelengthOnMovingNode(current, oldModuleDelta, newModuleDelta);
-					deltaCodelength += derived().getDeltaCodelengthOnMovingMemoryNode(oldModuleDelta, newModuleDelta);
+				// Empty function if no teleportation coding model
+				Super::template addTeleportationDeltaFlowIfMove<DeltaFlowType>(current, moduleDeltaEnterExit, numModuleLinks);
+
+				// Option to move to empty module (if node not already alone, and not already at the preferred number of modules)
+				unsigned int batchIndex = k - batchBegin;
+				if (Super::m_moduleMembers[current.index] > 1 && batchIndex < batchEmptyModules.size() &&
+						(m_config.preferredNumberOfModules == 0 || batchNumActiveModules != m_config.preferredNumberOfModules))
+				{
+					moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(batchEmptyModules[batchIndex], 0.0, 0.0);
+					++numModuleLinks;
+				}
 
-					if (deltaCodelength <= 0.0 - Super::m_config.minimumSingleNodeCodelengthImprovement)
+				// Store the DeltaFlow of the current module
+				DeltaFlowType oldModuleDelta(moduleDeltaEnterExit[redirect[current.index] - offset]);
+				offset += numNodes;
+
+				// Keep the link order from the edge order to not depend on a shared random number generator
+				DeltaFlowType bestDeltaModule(oldModuleDelta);
+				double bestDeltaCodelength = 0.0;
+				DeltaFlowType strongestConnectedModule(oldModuleDelta);
+				double deltaCodelengthOnStrongestConnectedModule = 0.0;
+
+				Super::template getDeltaCodelengthsOnMovingNode<DeltaFlowType>(current, oldModuleDelta,
+						&moduleDeltaEnterExit[0], numModuleLinks, plogpTerms, &deltaCodelengths[0]);
+
+				// Find the move that minimizes the description length
+				for (unsigned int j = 0; j < numModuleLinks; ++j)
+				{
+					unsigned int otherModule = moduleDeltaEnterExit[j].module;
+					if(otherModule != current.index)
 					{
-						//Update empty module vector
-						if(Super::m_moduleMembers[bestModuleIndex] == 0)
+						double deltaCodelength = deltaCodelengths[j];
+
+						if (deltaCodelength < bestDeltaCodelength - Super::m_config.minimumSingleNodeCodelengthImprovement)
 						{
-							Super::m_emptyModules.pop_back();
+							bestDeltaModule = moduleDeltaEnterExit[j];
+							bestDeltaCodelength = deltaCodelength;
 						}
-						if(Super::m_moduleMembers[oldModuleIndex] == 1)
+
+						// Save strongest connected module to prefer if codelength improvement equal
+						if (moduleDeltaEnterExit[j].deltaExit > strongestConnectedModule.deltaExit)
 						{
-							Super::m_emptyModules.push_back(oldModuleIndex);
+							strongestConnectedModule = moduleDeltaEnterExit[j];
+							deltaCodelengthOnStrongestConnectedModule = deltaCodelength;
 						}
+					}
+				}
 
-						Super::updateCodelengthOnMovingNode(current, oldModuleDelta, newModuleDelta);
-						derived().updateCodelengthOnMovingMemoryNode(oldModuleDelta, newModuleDelta);
+				// Prefer strongest connected module if equal delta codelength
+				if (strongestConnectedModule.module != bestDeltaModule.module &&
+						deltaCodelengthOnStrongestConnectedModule <= bestDeltaCodelength + Super::m_config.minimumCodelengthImprovement)
+				{
+					bestDeltaModule = strongestConnectedModule;
+					bestDeltaCodelength = deltaCodelengthOnStrongestConnectedModule;
+				}
 
-						// Update physical node map on move for memory networks
-						derived().performMoveOfMemoryNode(current, oldModuleIndex, bestModuleIndex);
+				proposedModule[k] = bestDeltaModule.module;
+				proposedDeltaCodelength[k] = bestDeltaCodelength;
+			}
 
-						// Mark neighbours as dirty
-						for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-								edgeIt != endIt; ++edgeIt)
-							(*edgeIt)->target.dirty = true;
-						for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-								edgeIt != endIt; ++edgeIt)
-							(*edgeIt)->source.dirty = true;
+#pragma omp single
+			{
+				for (int k = batchBegin; k < batchEnd; ++k)
+				{
+					unsigned int flip = batchNodes[k];
+					NodeType& current = getNode(*Super::m_activeNetwork[flip]);
+					unsigned int oldModuleIndex = current.index;
+					unsigned int bestModuleIndex = proposedModule[k];
 
-						Super::m_moduleMembers[oldModuleIndex] -= 1;
-						Super::m_moduleMembers[bestModuleIndex] += 1;
+					if (bestModuleIndex == noProposal)
+						continue;
 
-						current.index = bestModuleIndex;
-						++numMoved;
-						diffSerialParallelCodelength += bestDeltaCodelength - deltaCodelength;
+					if (bestModuleIndex == oldModuleIndex)
+					{
+						current.dirty = false;
+						continue;
 					}
-					else
+
+					// An empty best module is only valid if it is the empty module offered to the node and the node
+					// is not alone, as a previous move in the batch may have emptied the best module or the old module
+					unsigned int batchIndex = k - batchBegin;
+					bool toOwnEmptyModule = batchIndex < batchEmptyModules.size() && bestModuleIndex == batchEmptyModules[batchIndex];
+					if (Super::m_moduleMembers[bestModuleIndex] == 0 && (!toOwnEmptyModule || Super::m_moduleMembers[oldModuleIndex] == 1))
+						continue;
+
+					// Recalculate delta codelength for proposed move on the current state
+					DeltaFlowType oldModuleDelta(oldModuleIndex, 0.0, 0.0);
+					DeltaFlowType newModuleDelta(bestModuleIndex, 0.0, 0.0);
+
+					Super::addTeleportationDeltaFlowOnOldModuleIfMove(current, oldModuleDelta);
+					Super::addTeleportationDeltaFlowOnNewModuleIfMove(current, newModuleDelta);
+
+					// For all outlinks
+					for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+					{
+						unsigned int otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
+						if (otherModule == oldModuleIndex)
+							oldModuleDelta.deltaExit += adjacency.outFlow(link);
+						else if (otherModule == bestModuleIndex)
+							newModuleDelta.deltaExit += adjacency.outFlow(link);
+					}
+
+					// For all inlinks
+					for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+					{
+						unsigned int otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
+						if (otherModule == oldModuleIndex)
+							oldModuleDelta.deltaEnter += adjacency.inFlow(link);
+						else if (otherModule == bestModuleIndex)
+							newModuleDelta.deltaEnter += adjacency.inFlow(link);
+					}
+
+					// Accept the move if still as good as what the serial loop would have made when proposed
+					double deltaCodelength = Super::getDeltaCodelengthOnMovingNode(current, oldModuleDelta, newModuleDelta);
+					if (deltaCodelength > std::max(0.0 - Super::m_config.minimumSingleNodeCodelengthImprovement, proposedDeltaCodelength[k]))
+						continue;
+
+					//Update empty module vector
+					if (toOwnEmptyModule)
+						batchEmptyModuleTaken[batchIndex] = 1;
+					if (Super::m_moduleMembers[oldModuleIndex] == 1)
 					{
-						++numInvalidMoves;
+						Super::m_emptyModules.push_back(oldModuleIndex);
 					}
+
+					Super::updateCodelengthOnMovingNode(current, oldModuleDelta, newModuleDelta);
+
+					Super::m_moduleMembers[oldModuleIndex] -= 1;
+					Super::m_moduleMembers[bestModuleIndex] += 1;
+
+					current.index = bestModuleIndex;
+					++numMoved;
+
+					// Mark neighbours as dirty
+					for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+						Super::m_activeNetwork[adjacency.outNeighbour(link)]->dirty = true;
+					for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+						Super::m_activeNetwork[adjacency.inNeighbour(link)]->dirty = true;
 				}
-				else
+
+				// Return the empty modules not taken, in the order they were taken out
+				for (unsigned int j = batchEmptyModules.size(); j-- > 0; )
 				{
-					++numInvalidMoves;
+					if (!batchEmptyModuleTaken[j])
+						Super::m_emptyModules.push_back(batchEmptyModules[j]);
 				}
 			}
 		}
 
+		workspace.redirectOffset = offset;
 	}
 
-//	Log() << "\n(#invalidMoves: " << numInvalidMoves <<
-//			", diffSerialParallelCodelength: " << diffSerialParallelCodelength << ") ";
-
-//	return numMoved;
-	return numMoved + numInvalidMoves;
+	return numMoved;
 }
 
 
@@ -1125,9 +1748,12 @@ template<typename InfomapGreedyDerivedType>
 inline
 unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoStrongestConnectedModule()
 {
+	const Adjacency& adjacency = Super::activeAdjacency();
 	unsigned int numNodes = Super::m_activeNetwork.size();
+	bool skipBipartiteNodes = Super::skipBipartiteNodes();
 	// Get random enumeration of nodes
-	std::vector<unsigned int> randomOrder(numNodes);
+	std::vector<unsigned int>& randomOrder = Workspace::forCurrentThread().nodeOrder;
+	randomOrder.resize(numNodes);
 	infomath::getRandomizedIndexVector(randomOrder, Super::m_rand);
 
 	unsigned int numMoved = 0;
@@ -1140,30 +1766,31 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoS
 		if (!current.dirty) //TODO: Only skip stable nodes until converged, then start over as a fine tune?
 			continue;
 
+		// Feature nodes are placed after the core loop
+		if (skipBipartiteNodes && Super::isBipartiteNode(current))
+			continue;
+
 		if (Super::m_moduleMembers[current.index] > 1 && Super::isFirstLoop() && m_config.tuneIterationLimit != 1)
 			continue;
 
+		// A self-link keeps the node in its current module if stronger than any other link
 		unsigned int strongestConnectedModule = current.index;
-		double maxFlow = 0.0;
+		double maxFlow = adjacency.selfLinkFlow(flip);
 
 		// For all outlinks
-		for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-				edgeIt != endIt; ++edgeIt)
+		for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
 		{
-			EdgeType& edge = **edgeIt;
-			if (edge.data.flow > maxFlow) {
-				maxFlow = edge.data.flow;
-				strongestConnectedModule = edge.target.index;
+			if (adjacency.outFlow(link) > maxFlow) {
+				maxFlow = adjacency.outFlow(link);
+				strongestConnectedModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
 			}
 		}
 		// For all inlinks
-		for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-				edgeIt != endIt; ++edgeIt)
+		for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
 		{
-			EdgeType& edge = **edgeIt;
-			if (edge.data.flow > maxFlow) {
-				maxFlow = edge.data.flow;
-				strongestConnectedModule = edge.source.index;
+			if (adjacency.inFlow(link) > maxFlow) {
+				maxFlow = adjacency.inFlow(link);
+				strongestConnectedModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
 			}
 		}
 
@@ -1178,31 +1805,23 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoS
 			DeltaFlowType newModuleDelta(newM, 0.0, 0.0, 0.0, 0.0);
 
 			// For all outlinks
-			for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-					edgeIt != endIt; ++edgeIt)
+			for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
 			{
-				EdgeType& edge = **edgeIt;
-				if (edge.isSelfPointing())
-					continue;
-				unsigned int otherModule = edge.target.index;
+				unsigned int otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
 				if (otherModule == oldM)
-					oldModuleDelta.deltaExit += edge.data.flow;
+					oldModuleDelta.deltaExit += adjacency.outFlow(link);
 				else if (otherModule == newM)
-					newModuleDelta.deltaExit += edge.data.flow;
+					newModuleDelta.deltaExit += adjacency.outFlow(link);
 			}
 
 			// For all inlinks
-			for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-					edgeIt != endIt; ++edgeIt)
+			for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
 			{
-				EdgeType& edge = **edgeIt;
-				if (edge.isSelfPointing())
-					continue;
-				unsigned int otherModule = edge.source.index;
+				unsigned int otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
 				if (otherModule == oldM)
-					oldModuleDelta.deltaEnter += edge.data.flow;
+					oldModuleDelta.deltaEnter += adjacency.inFlow(link);
 				else if (otherModule == newM)
-					newModuleDelta.deltaEnter += edge.data.flow;
+					newModuleDelta.deltaEnter += adjacency.inFlow(link);
 			}
 
 
@@ -1227,12 +1846,10 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoS
 			++numMoved;
 
 			// Mark neighbours as dirty
-			for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-					edgeIt != endIt; ++edgeIt)
-				(*edgeIt)->target.dirty = true;
-			for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-					edgeIt != endIt; ++edgeIt)
-				(*edgeIt)->source.dirty = true;
+			for (unsigned int link = adjacency.beginOut(flip), endLink = adjacency.endOut(flip); link != endLink; ++link)
+				Super::m_activeNetwork[adjacency.outNeighbour(link)]->dirty = true;
+			for (unsigned int link = adjacency.beginIn(flip), endLink = adjacency.endIn(flip); link != endLink; ++link)
+				Super::m_activeNetwork[adjacency.inNeighbour(link)]->dirty = true;
 		}
 		else
 			current.dirty = false;
@@ -1241,12 +1858,131 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::tryMoveEachNodeIntoS
 	return numMoved;
 }
 
+/**
+ * Move each feature node of a bipartite network, left out of the core loop, into the module
+ * that holds most flow on its links, in one pass over the active network.
+ * Each feature node keeps its module on ties.
+ * @return The number of nodes moved.
+ */
+template<typename InfomapGreedyDerivedType>
+inline
+unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::moveBipartiteNodesIntoStrongestConnectedModule()
+{
+	const Adjacency& adjacency = Super::activeAdjacency();
+	unsigned int numNodes = Super::m_activeNetwork.size();
+	Workspace& workspace = Workspace::forCurrentThread();
+	std::vector<DeltaFlowType>& moduleDeltaEnterExit = workspace.moduleDeltas<DeltaFlowType>(numNodes);
+	workspace.prepareRedirect(numNodes);
+	std::vector<unsigned int>& redirect = workspace.redirect;
+	unsigned int offset = workspace.redirectOffset;
+	unsigned int maxOffset = std::numeric_limits<unsigned int>::max() - 1 - numNodes;
+	double oldCodelength = Super::codelength;
+
+	unsigned int numMoved = 0;
+	for (unsigned int k = 0; k < numNodes; ++k)
+	{
+		NodeType& current = getNode(*Super::m_activeNetwork[k]);
+		if (!Super::isBipartiteNode(current))
+			continue;
+
+		// Reset offset before overflow
+		if (offset > maxOffset)
+		{
+			redirect.assign(numNodes, 0);
+			offset = 1;
+		}
+
+		// Sum the flow to each neighbouring module, starting with the current module
+		redirect[current.index] = offset;
+		moduleDeltaEnterExit[0] = DeltaFlowType(current.index, 0.0, 0.0);
+		unsigned int numModuleLinks = 1;
+		for (unsigned int link = adjacency.beginOut(k), endLink = adjacency.endOut(k); link != endLink; ++link)
+		{
+			unsigned int otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
+			if (redirect[otherModule] >= offset)
+			{
+				moduleDeltaEnterExit[redirect[otherModule] - offset].deltaExit += adjacency.outFlow(link);
+			}
+			else
+			{
+				redirect[otherModule] = offset + numModuleLinks;
+				moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(otherModule, adjacency.outFlow(link), 0.0);
+				++numModuleLinks;
+			}
+		}
+		for (unsigned int link = adjacency.beginIn(k), endLink = adjacency.endIn(k); link != endLink; ++link)
+		{
+			unsigned int otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
+			if (redirect[otherModule] >= offset)
+			{
+				moduleDeltaEnterExit[redirect[otherModule] - offset].deltaEnter += adjacency.inFlow(link);
+			}
+			else
+			{
+				redirect[otherModule] = offset + numModuleLinks;
+				moduleDeltaEnterExit[numModuleLinks] = DeltaFlowType(otherModule, 0.0, adjacency.inFlow(link));
+				++numModuleLinks;
+			}
+		}
+		offset += numNodes;
+
+		unsigned int strongest = 0;
+		for (unsigned int j = 1; j < numModuleLinks; ++j)
+		{
+			if (moduleDeltaEnterExit[j].deltaExit + moduleDeltaEnterExit[j].deltaEnter >
+					moduleDeltaEnterExit[strongest].deltaExit + moduleDeltaEnterExit[strongest].deltaEnter)
+				strongest = j;
+		}
+		if (strongest == 0)
+			continue;
+
+		unsigned int oldM = current.index;
+		unsigned int newM = moduleDeltaEnterExit[strongest].module;
+		DeltaFlowType oldModuleDelta(moduleDeltaEnterExit[0]);
+		DeltaFlowType newModuleDelta(moduleDeltaEnterExit[strongest]);
+
+		Super::addTeleportationDeltaFlowOnOldModuleIfMove(current, oldModuleDelta);
+		Super::addTeleportationDeltaFlowOnNewModuleIfMove(current, newModuleDelta);
+
+		// For memory networks
+		derived().performPredefinedMoveOfMemoryNode(current, oldM, newM, oldModuleDelta, newModuleDelta);
+
+		//Update empty module vector
+		if(Super::m_moduleMembers[newM] == 0)
+		{
+			Super::m_emptyModules.pop_back();
+		}
+		if(Super::m_moduleMembers[oldM] == 1)
+		{
+			Super::m_emptyModules.push_back(oldM);
+		}
+
+		Super::updateCodelengthOnMovingNode(current, oldModuleDelta, newModuleDelta);
+		derived().updateCodelengthOnMovingMemoryNode(oldModuleDelta, newModuleDelta);
+
+		Super::m_moduleMembers[oldM] -= 1;
+		Super::m_moduleMembers[newM] += 1;
+
+		current.index = newM;
+		++numMoved;
+	}
+	workspace.redirectOffset = offset;
+
+	if (Super::m_subLevel == 0 && m_config.benchmark)
+		Logger::benchmarkFields("bipartitePlacement", io::Str() << "tuneIteration=" << Super::m_tuneIterationIndex <<
+				"\tmoved=" << numMoved << "\tdeltaCodelength=" << (Super::codelength - oldCodelength) <<
+				"\tcodelength=" << Super::codelength << "\tmodules=" << Super::numActiveModules());
+
+	return numMoved;
+}
+
 template<typename InfomapGreedyDerivedType>
 void InfomapGreedyCommon<InfomapGreedyDerivedType>::moveNodesToPredefinedModules()
 {
 	// Size of active network and cluster array should match.
 	ASSERT(m_moveTo.size() == m_activeNetwork.size());
 
+	const Adjacency& adjacency = Super::activeAdjacency();
 	unsigned int numNodes = Super::m_activeNetwork.size();
 
 	DEBUG_OUT("Begin moving " << numNodes << " nodes to predefined modules, starting with codelength " <<
@@ -1268,31 +2004,23 @@ void InfomapGreedyCommon<InfomapGreedyDerivedType>::moveNodesToPredefinedModules
 			Super::addTeleportationDeltaFlowOnNewModuleIfMove(current, newModuleDelta);
 
 			// For all outlinks
-			for (NodeBase::edge_iterator edgeIt(current.begin_outEdge()), endIt(current.end_outEdge());
-					edgeIt != endIt; ++edgeIt)
+			for (unsigned int link = adjacency.beginOut(k), endLink = adjacency.endOut(k); link != endLink; ++link)
 			{
-				EdgeType& edge = **edgeIt;
-				if (edge.isSelfPointing())
-					continue;
-				unsigned int otherModule = edge.target.index;
+				unsigned int otherModule = Super::m_activeNetwork[adjacency.outNeighbour(link)]->index;
 				if (otherModule == oldM)
-					oldModuleDelta.deltaExit += edge.data.flow;
+					oldModuleDelta.deltaExit += adjacency.outFlow(link);
 				else if (otherModule == newM)
-					newModuleDelta.deltaExit += edge.data.flow;
+					newModuleDelta.deltaExit += adjacency.outFlow(link);
 			}
 
 			// For all inlinks
-			for (NodeBase::edge_iterator edgeIt(current.begin_inEdge()), endIt(current.end_inEdge());
-					edgeIt != endIt; ++edgeIt)
+			for (unsigned int link = adjacency.beginIn(k), endLink = adjacency.endIn(k); link != endLink; ++link)
 			{
-				EdgeType& edge = **edgeIt;
-				if (edge.isSelfPointing())
-					continue;
-				unsigned int otherModule = edge.source.index;
+				unsigned int otherModule = Super::m_activeNetwork[adjacency.inNeighbour(link)]->index;
 				if (otherModule == oldM)
-					oldModuleDelta.deltaEnter += edge.data.flow;
+					oldModuleDelta.deltaEnter += adjacency.inFlow(link);
 				else if (otherModule == newM)
-					newModuleDelta.deltaEnter += edge.data.flow;
+					newModuleDelta.deltaEnter += adjacency.inFlow(link);
 			}
 
 
@@ -1328,7 +2056,9 @@ template<typename InfomapGreedyDerivedType>
 unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::consolidateModules(bool replaceExistingStructure, bool asSubModules)
 {
 	unsigned int numNodes = Super::m_activeNetwork.size();
-	std::vector<NodeBase*> modules(numNodes, 0);
+	Workspace& workspace = Workspace::forCurrentThread();
+	std::vector<NodeBase*>& modules = workspace.modules;
+	modules.assign(numNodes, 0);
 
 	bool activeNetworkAlreadyHaveModuleLevel = Super::m_activeNetwork[0]->parent != Super::root();
 	bool activeNetworkIsLeafNetwork = Super::m_activeNetwork[0]->isLeaf();
@@ -1364,7 +2094,7 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::consolidateModules(b
 		unsigned int moduleIndex = node->index;
 		if (modules[moduleIndex] == 0)
 		{
-			modules[moduleIndex] = new NodeType(Super::m_moduleFlowData[moduleIndex]);
+			modules[moduleIndex] = new (Super::m_treeData.pool()) NodeType(Super::m_moduleFlowData[moduleIndex]);
 			node->parent->addChild(modules[moduleIndex]);
 			modules[moduleIndex]->index = moduleIndex;
 			// If node->parent is a module, its former children (leafnodes) has been released above, getting only submodules
@@ -1397,22 +2127,39 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::consolidateModules(b
 	}
 
 
-	// Aggregate links from lower level to the new modular level
-	typedef std::pair<NodeBase*, NodeBase*> NodePair;
-	typedef std::map<NodePair, double, CompNodePair> EdgeMap;
-	EdgeMap moduleLinks;
-
-	for (typename Super::activeNetwork_iterator nodeIt(Super::m_activeNetwork.begin()), nodeEnd(Super::m_activeNetwork.end());
-			nodeIt != nodeEnd; ++nodeIt)
+	// Aggregate links from lower level to the new modular level.
+	// First collect the links between different modules in the order of the active network
+	const Adjacency& adjacency = Super::activeAdjacency();
+	std::vector<unsigned int>& linkOffsets = workspace.linkOffsets;
+	linkOffsets.assign(numNodes + 1, 0);
+	int numNodesInt = static_cast<int>(numNodes);
+#pragma omp parallel for schedule(static) if (Super::isTopLevel())
+	for (int i = 0; i < numNodesInt; ++i)
 	{
-		NodeBase* node = *nodeIt;
+		NodeBase* parent = Super::m_activeNetwork[i]->parent;
+		unsigned int numLinks = 0;
+		for (unsigned int link = adjacency.beginOut(i), endLink = adjacency.endOut(i); link != endLink; ++link)
+		{
+			if (Super::m_activeNetwork[adjacency.outNeighbour(link)]->parent != parent)
+				++numLinks;
+		}
+		linkOffsets[i + 1] = numLinks;
+	}
+	for (unsigned int i = 0; i < numNodes; ++i)
+		linkOffsets[i + 1] += linkOffsets[i];
 
-		NodeBase* parent = node->parent;
-		for (NodeBase::edge_iterator edgeIt(node->begin_outEdge()), edgeEnd(node->end_outEdge());
-				edgeIt != edgeEnd; ++edgeIt)
+	unsigned int numLinks = linkOffsets[numNodes];
+	std::vector<ModuleLink>& links = workspace.links;
+	links.resize(numLinks);
+	unsigned int maxModuleIndex = 0;
+#pragma omp parallel for schedule(static) if (Super::isTopLevel()) reduction(max:maxModuleIndex)
+	for (int i = 0; i < numNodesInt; ++i)
+	{
+		NodeBase* parent = Super::m_activeNetwork[i]->parent;
+		unsigned int linkIndex = linkOffsets[i];
+		for (unsigned int link = adjacency.beginOut(i), endLink = adjacency.endOut(i); link != endLink; ++link)
 		{
-			EdgeType* edge = *edgeIt;
-			NodeBase* otherParent = edge->target.parent;
+			NodeBase* otherParent = Super::m_activeNetwork[adjacency.outNeighbour(link)]->parent;
 
 			if (otherParent != parent)
 			{
@@ -1420,21 +2167,73 @@ unsigned int InfomapGreedyCommon<InfomapGreedyDerivedType>::consolidateModules(b
 				// If undirected, the order may be swapped to aggregate the edge on an opposite one
 				if (!IsDirectedType() && m1->index > m2->index)
 					std::swap(m1, m2);
-				// Insert the node pair in the edge map. If not inserted, add the flow value to existing node pair.
-				std::pair<typename EdgeMap::iterator, bool> ret = \
-					moduleLinks.insert(std::make_pair(NodePair(m1, m2), edge->data.flow));
-				if (!ret.second)
-					ret.first->second += edge->data.flow;
+				links[linkIndex++] = ModuleLink(m1, m2, adjacency.outFlow(link));
+				maxModuleIndex = std::max(maxModuleIndex, std::max(m1->index, m2->index));
 			}
 		}
 	}
 
+	// Group the links on (source module, target module) with a stable counting sort on each index,
+	// starting with the least significant, to sum the flow of each group in the order of collection
+	std::vector<ModuleLink>& sortedLinks = workspace.sortedLinks;
+	sortedLinks.resize(numLinks);
+	std::vector<unsigned int>& moduleCount = workspace.moduleCount;
+	moduleCount.assign(maxModuleIndex + 2, 0);
+	for (unsigned int i = 0; i < numLinks; ++i)
+		++moduleCount[links[i].target->index + 1];
+	for (unsigned int i = 0; i <= maxModuleIndex; ++i)
+		moduleCount[i + 1] += moduleCount[i];
+	for (unsigned int i = 0; i < numLinks; ++i)
+		sortedLinks[moduleCount[links[i].target->index]++] = links[i];
+
+	moduleCount.assign(maxModuleIndex + 2, 0);
+	for (unsigned int i = 0; i < numLinks; ++i)
+		++moduleCount[sortedLinks[i].source->index + 1];
+	for (unsigned int i = 0; i <= maxModuleIndex; ++i)
+		moduleCount[i + 1] += moduleCount[i];
+	for (unsigned int i = 0; i < numLinks; ++i)
+		links[moduleCount[sortedLinks[i].source->index]++] = sortedLinks[i];
+
+	// Sum the flow on each group in place
+	unsigned int numModuleLinks = 0;
+	std::vector<unsigned int>& outDegree = workspace.outDegree;
+	outDegree.assign(maxModuleIndex + 1, 0);
+	std::vector<unsigned int>& inDegree = workspace.inDegree;
+	inDegree.assign(maxModuleIndex + 1, 0);
+	for (unsigned int i = 0; i < numLinks; ++i)
+	{
+		const ModuleLink& link = links[i];
+		if (numModuleLinks != 0 &&
+				links[numModuleLinks - 1].source->index == link.source->index &&
+				links[numModuleLinks - 1].target->index == link.target->index)
+		{
+			links[numModuleLinks - 1].flow += link.flow;
+		}
+		else
+		{
+			links[numModuleLinks++] = link;
+			++outDegree[link.source->index];
+			++inDegree[link.target->index];
+		}
+	}
+
 	// Add the aggregated edge flow structure to the new modules
-	for (EdgeMap::const_iterator edgeIt(moduleLinks.begin()), edgeEnd(moduleLinks.end());
-			edgeIt != edgeEnd; ++edgeIt)
+	for (unsigned int i = 0; i < numModuleLinks; ++i)
 	{
-		const NodePair& nodePair = edgeIt->first;
-		nodePair.first->addOutEdge(*nodePair.second, 0.0, edgeIt->second);
+		ModuleLink& link = links[i];
+		unsigned int& numOut = outDegree[link.source->index];
+		if (numOut != 0)
+		{
+			link.source->reserveOutEdges(numOut);
+			numOut = 0;
+		}
+		unsigned int& numIn = inDegree[link.target->index];
+		if (numIn != 0)
+		{
+			link.target->reserveInEdges(numIn);
+			numIn = 0;
+		}
+		link.source->addOutEdge(*link.target, 0.0, link.flow);
 	}
 
 	// Replace active network with its children if not at leaf level.
@@ -36,6 +36,42 @@ namespace infomap
 {
 #endif
 
+/**
+ * Change in the module level codelength terms, accumulated to be able to move
+ * nodes concurrently and apply the sum of all changes afterwards.
+ */
+struct CodelengthTermsDelta
+{
+	CodelengthTermsDelta() :
+		enterFlow(0.0),
+		enter_log_enter(0.0),
+		exit_log_exit(0.0),
+		flow_log_flow(0.0)
+	{}
+
+	double enterFlow;
+	double enter_log_enter;
+	double exit_log_exit;
+	double flow_log_flow;
+};
+
+/**
+ * The plogp terms of a module in the codelength, cached as they only change when a move is
+ * performed but are used for each candidate move.
+ */
+struct ModulePlogpTerms
+{
+	ModulePlogpTerms() :
+		enter_log_enter(0.0),
+		exit_log_exit(0.0),
+		flow_log_flow(0.0)
+	{}
+
+	double enter_log_enter; // plogp(enterFlow)
+	double exit_log_exit; // plogp(exitFlow)
+	double flow_log_flow; // plogp(exitFlow + flow)
+};
+
 /**
  * Infomap methods specialized on the flow type, e.g. including teleportation flow if coding teleportation.
  * As methods can't be partially specialized, the network type template variable is dropped, so
@@ -68,20 +104,57 @@ protected:
 
 	virtual void initEnterExitFlow();
 
-	void addTeleportationDeltaFlowOnOldModuleIfMove(NodeType& nodeToMove, DeltaFlow& oldModuleDeltaFlow) {}
-	void addTeleportationDeltaFlowOnNewModuleIfMove(NodeType& nodeToMove, DeltaFlow& newModuleDeltaFlow) {}
+	void addTeleportationDeltaFlowOnOldModuleIfMove(NodeType& nodeToMove, DeltaFlow& oldModuleDeltaFlow)
+	{ addTeleportationDeltaFlowOnOldModuleIfMove(nodeToMove, oldModuleDeltaFlow, Super::m_moduleFlowData[oldModuleDeltaFlow.module]); }
+	void addTeleportationDeltaFlowOnNewModuleIfMove(NodeType& nodeToMove, DeltaFlow& newModuleDeltaFlow)
+	{ addTeleportationDeltaFlowOnNewModuleIfMove(nodeToMove, newModuleDeltaFlow, Super::m_moduleFlowData[newModuleDeltaFlow.module]); }
+	void addTeleportationDeltaFlowOnOldModuleIfMove(NodeType& nodeToMove, DeltaFlow& oldModuleDeltaFlow, const FlowType& oldModuleFlowData) {}
+	void addTeleportationDeltaFlowOnNewModuleIfMove(NodeType& nodeToMove, DeltaFlow& newModuleDeltaFlow, const FlowType& newModuleFlowData) {}
 
 	template<typename DeltaFlowType>
-	void addTeleportationDeltaFlowIfMove(NodeType& current, std::vector<DeltaFlowType>& moduleDeltaExits, unsigned int numModuleLinks) {}
+	void addTeleportationDeltaFlowIfMove(NodeType& current, std::vector<DeltaFlowType>& moduleDeltaExits, unsigned int numModuleLinks)
+	{ addTeleportationDeltaFlowIfMove(current, moduleDeltaExits, numModuleLinks, Super::m_moduleFlowData); }
+	/**
+	 * Add the teleportation delta flow reading the flow of the modules from moduleFlowData,
+	 * which may be a snapshot of the module flow when the moves are found in parallel.
+	 */
+	template<typename DeltaFlowType>
+	void addTeleportationDeltaFlowIfMove(NodeType& current, std::vector<DeltaFlowType>& moduleDeltaExits, unsigned int numModuleLinks,
+			const std::vector<FlowType>& moduleFlowData) {}
 	template<typename DeltaFlowType>
 	void addTeleportationDeltaFlowIfMove(NodeType& current, std::map<unsigned int, DeltaFlowType>& moduleDeltaFlow) {}
 
 	double getDeltaCodelengthOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta, DeltaFlow& newModuleDelta);
+	template<typename DeltaFlowType>
+	void getDeltaCodelengthsOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta,
+			const DeltaFlowType* newModuleDeltas, unsigned int numModules,
+			std::vector<double>& plogpTerms, double* deltaCodelengths)
+	{
+		getDeltaCodelengthsOnMovingNode(current, oldModuleDelta, newModuleDeltas, numModules, plogpTerms, deltaCodelengths,
+				Super::m_moduleFlowData, m_modulePlogpTerms);
+	}
+	/**
+	 * Like above, but reading the flow and the cached plogp terms of the modules from the
+	 * given vectors, which may be a snapshot when the moves are found in parallel.
+	 */
+	template<typename DeltaFlowType>
+	void getDeltaCodelengthsOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta,
+			const DeltaFlowType* newModuleDeltas, unsigned int numModules,
+			std::vector<double>& plogpTerms, double* deltaCodelengths,
+			const std::vector<FlowType>& moduleFlowData, const std::vector<ModulePlogpTerms>& modulePlogpTerms);
 	void updateCodelengthOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta, DeltaFlow& newModuleDelta);
 
 	void updateFlowOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta, DeltaFlow& newModuleDelta);
 
+	void updateModuleFlowOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta, DeltaFlow& newModuleDelta,
+			CodelengthTermsDelta& termsDelta);
+	void applyCodelengthTermsDelta(const CodelengthTermsDelta& termsDelta);
+
+	void initModulePlogpTerms();
+	void updateModulePlogpTerms(unsigned int module);
+
 	double m_sumDanglingFlow;
+	std::vector<ModulePlogpTerms> m_modulePlogpTerms; // Cached terms for each module in m_moduleFlowData
 };
 
 
@@ -124,6 +197,22 @@ template<typename FlowType>
 inline
 void InfomapGreedySpecialized<FlowType>::initEnterExitFlow()
 {
+	if (Super::m_treeData.isLeafLinkView())
+	{
+		// Self-links are not in the link lists of the adjacency
+		const Adjacency& links = Super::m_treeData.leafLinkView();
+		for (unsigned int i = 0; i < links.numNodes(); ++i)
+		{
+			FlowType& sourceData = Super::getNode(Super::m_treeData.getLeafNode(i)).data;
+			for (unsigned int link = links.beginOut(i), endLink = links.endOut(i); link != endLink; ++link)
+			{
+				sourceData.exitFlow += links.outFlow(link);
+				Super::getNode(Super::m_treeData.getLeafNode(links.outNeighbour(link))).data.enterFlow += links.outFlow(link);
+			}
+		}
+		return;
+	}
+
 	for (TreeData::leafIterator it(Super::m_treeData.begin_leaf()), itEnd(Super::m_treeData.end_leaf());
 			it != itEnd; ++it)
 	{
@@ -151,6 +240,7 @@ template<>
 inline
 void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::initEnterExitFlow()
 {
+	const Adjacency* links = m_treeData.isLeafLinkView() ? &m_treeData.leafLinkView() : 0;
 	for (TreeData::leafIterator it(m_treeData.begin_leaf()), itEnd(m_treeData.end_leaf());
 			it != itEnd; ++it)
 	{
@@ -158,11 +248,20 @@ void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::initEnterExitFlow(
 		FlowType& data = getNode(node).data;
 		// Also store the flow to use for teleportation as the flow can be transformed
 		data.teleportSourceFlow = data.flow;
-		if (node.isDangling())
+		if (links != 0 ? links->isDangling(node.leafIndex) : node.isDangling())
 		{
 			m_sumDanglingFlow += data.flow;
 			data.danglingFlow = data.flow;
 		}
+		else if (links != 0)
+		{
+			// Self-links are not in the link lists of the adjacency
+			for (unsigned int link = links->beginOut(node.leafIndex), endLink = links->endOut(node.leafIndex); link != endLink; ++link)
+			{
+				data.exitFlow += links->outFlow(link);
+				getNode(m_treeData.getLeafNode(links->outNeighbour(link))).data.enterFlow += links->outFlow(link);
+			}
+		}
 		else
 		{
 			for (NodeBase::edge_iterator edgeIt(node.begin_outEdge()), edgeEnd(node.end_outEdge());
@@ -184,11 +283,11 @@ void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::initEnterExitFlow(
 
 template<>
 inline
-void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDeltaFlowOnOldModuleIfMove(NodeType& nodeToMove, DeltaFlow& oldModuleDeltaFlow)
+void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDeltaFlowOnOldModuleIfMove(NodeType& nodeToMove, DeltaFlow& oldModuleDeltaFlow,
+		const FlowType& oldModuleFlowData)
 {
 	double alpha = m_config.teleportationProbability;
 	double beta = 1.0 - alpha;
-	FlowType& oldModuleFlowData = m_moduleFlowData[oldModuleDeltaFlow.module];
 	oldModuleDeltaFlow.deltaExit += (alpha*nodeToMove.data.teleportSourceFlow + beta*nodeToMove.data.danglingFlow) * (oldModuleFlowData.teleportWeight - nodeToMove.data.teleportWeight);
 	oldModuleDeltaFlow.deltaEnter += (alpha*(oldModuleFlowData.teleportSourceFlow - nodeToMove.data.teleportSourceFlow) +
 			beta*(oldModuleFlowData.danglingFlow - nodeToMove.data.danglingFlow)) * nodeToMove.data.teleportWeight;
@@ -196,11 +295,11 @@ void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDe
 
 template<>
 inline
-void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDeltaFlowOnNewModuleIfMove(NodeType& nodeToMove, DeltaFlow& newModuleDeltaFlow)
+void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDeltaFlowOnNewModuleIfMove(NodeType& nodeToMove, DeltaFlow& newModuleDeltaFlow,
+		const FlowType& newModuleFlowData)
 {
 	double alpha = m_config.teleportationProbability;
 	double beta = 1.0 - alpha;
-	FlowType& newModuleFlowData = m_moduleFlowData[newModuleDeltaFlow.module];
 	newModuleDeltaFlow.deltaExit += (alpha*nodeToMove.data.teleportSourceFlow + beta*nodeToMove.data.danglingFlow) * newModuleFlowData.teleportWeight;
 	newModuleDeltaFlow.deltaEnter += (alpha*newModuleFlowData.teleportSourceFlow +	beta*newModuleFlowData.danglingFlow) * nodeToMove.data.teleportWeight;
 }
@@ -208,15 +307,16 @@ void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDe
 template<>
 template<typename DeltaFlowType>
 inline
-void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDeltaFlowIfMove(NodeType& current, std::vector<DeltaFlowType>& moduleDeltaExits, unsigned int numModuleLinks)
+void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDeltaFlowIfMove(NodeType& current, std::vector<DeltaFlowType>& moduleDeltaExits, unsigned int numModuleLinks,
+		const std::vector<FlowType>& moduleFlowData)
 {
 	for (unsigned int j = 0; j < numModuleLinks; ++j)
 	{
 		unsigned int moduleIndex = moduleDeltaExits[j].module;
 		if (moduleIndex == current.index)
-			addTeleportationDeltaFlowOnOldModuleIfMove(current, moduleDeltaExits[j]);
+			addTeleportationDeltaFlowOnOldModuleIfMove(current, moduleDeltaExits[j], moduleFlowData[moduleIndex]);
 		else
-			addTeleportationDeltaFlowOnNewModuleIfMove(current, moduleDeltaExits[j]);
+			addTeleportationDeltaFlowOnNewModuleIfMove(current, moduleDeltaExits[j], moduleFlowData[moduleIndex]);
 	}
 }
 
@@ -237,6 +337,42 @@ void InfomapGreedySpecialized<FlowDirectedWithTeleportation>::addTeleportationDe
 
 
 
+template<typename FlowType>
+inline
+void InfomapGreedySpecialized<FlowType>::initModulePlogpTerms()
+{
+	unsigned int numModules = Super::m_moduleFlowData.size();
+	m_modulePlogpTerms.resize(numModules);
+	for (unsigned int i = 0; i < numModules; ++i)
+		updateModulePlogpTerms(i);
+}
+
+template<typename FlowType>
+inline
+void InfomapGreedySpecialized<FlowType>::updateModulePlogpTerms(unsigned int module)
+{
+	using infomath::plogp;
+	const FlowType& moduleFlowData = Super::m_moduleFlowData[module];
+	ModulePlogpTerms& terms = m_modulePlogpTerms[module];
+	terms.enter_log_enter = plogp(moduleFlowData.enterFlow);
+	terms.exit_log_exit = plogp(moduleFlowData.exitFlow);
+	terms.flow_log_flow = plogp(moduleFlowData.exitFlow + moduleFlowData.flow);
+}
+
+/**
+ * The enter flow is not coded separately for undirected flow
+ */
+template<>
+inline
+void InfomapGreedySpecialized<FlowUndirected>::updateModulePlogpTerms(unsigned int module)
+{
+	using infomath::plogp;
+	const FlowType& moduleFlowData = m_moduleFlowData[module];
+	ModulePlogpTerms& terms = m_modulePlogpTerms[module];
+	terms.exit_log_exit = plogp(moduleFlowData.exitFlow);
+	terms.flow_log_flow = plogp(moduleFlowData.exitFlow + moduleFlowData.flow);
+}
+
 template<typename FlowType>
 inline
 double InfomapGreedySpecialized<FlowType>::getDeltaCodelengthOnMovingNode(NodeType& current,
@@ -252,20 +388,20 @@ double InfomapGreedySpecialized<FlowType>::getDeltaCodelengthOnMovingNode(NodeTy
 	double delta_enter = plogp(Super::enterFlow + deltaEnterExitOldModule - deltaEnterExitNewModule) - Super::enterFlow_log_enterFlow;
 
 	double delta_enter_log_enter = \
-			- plogp(moduleFlowData[oldModule].enterFlow) \
-			- plogp(moduleFlowData[newModule].enterFlow) \
+			- m_modulePlogpTerms[oldModule].enter_log_enter \
+			- m_modulePlogpTerms[newModule].enter_log_enter \
 			+ plogp(moduleFlowData[oldModule].enterFlow - current.data.enterFlow + deltaEnterExitOldModule) \
 			+ plogp(moduleFlowData[newModule].enterFlow + current.data.enterFlow - deltaEnterExitNewModule);
 
 	double delta_exit_log_exit = \
-			- plogp(moduleFlowData[oldModule].exitFlow) \
-			- plogp(moduleFlowData[newModule].exitFlow) \
+			- m_modulePlogpTerms[oldModule].exit_log_exit \
+			- m_modulePlogpTerms[newModule].exit_log_exit \
 			+ plogp(moduleFlowData[oldModule].exitFlow - current.data.exitFlow + deltaEnterExitOldModule) \
 			+ plogp(moduleFlowData[newModule].exitFlow + current.data.exitFlow - deltaEnterExitNewModule);
 
 	double delta_flow_log_flow = \
-			- plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow) \
-			- plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow) \
+			- m_modulePlogpTerms[oldModule].flow_log_flow \
+			- m_modulePlogpTerms[newModule].flow_log_flow \
 			+ plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow \
 					- current.data.exitFlow - current.data.flow + deltaEnterExitOldModule) \
 			+ plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow \
@@ -294,14 +430,14 @@ double InfomapGreedySpecialized<FlowUndirected>::getDeltaCodelengthOnMovingNode(
 	double delta_exit = plogp(enterFlow + deltaEnterExitOldModule - deltaEnterExitNewModule) - enterFlow_log_enterFlow;
 
 	double delta_exit_log_exit = \
-			- plogp(moduleFlowData[oldModule].exitFlow) \
-			- plogp(moduleFlowData[newModule].exitFlow) \
+			- m_modulePlogpTerms[oldModule].exit_log_exit \
+			- m_modulePlogpTerms[newModule].exit_log_exit \
 			+ plogp(moduleFlowData[oldModule].exitFlow - current.data.exitFlow + deltaEnterExitOldModule) \
 			+ plogp(moduleFlowData[newModule].exitFlow + current.data.exitFlow - deltaEnterExitNewModule);
 
 	double delta_flow_log_flow = \
-			- plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow) \
-			- plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow) \
+			- m_modulePlogpTerms[oldModule].flow_log_flow \
+			- m_modulePlogpTerms[newModule].flow_log_flow \
 			+ plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow \
 					- current.data.exitFlow - current.data.flow + deltaEnterExitOldModule) \
 			+ plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow \
@@ -312,6 +448,117 @@ double InfomapGreedySpecialized<FlowUndirected>::getDeltaCodelengthOnMovingNode(
 }
 
 
+/**
+ * Batch version of getDeltaCodelengthOnMovingNode for all candidate modules of a node.
+ * The arguments to plogp for the post-move terms are first gathered in a structure-of-arrays
+ * buffer (one contiguous row per term), then transformed in one pass by infomath::plogpInPlace,
+ * and finally combined per candidate with the cached terms of the current state in the same
+ * order as the scalar version, giving identical results. The post-move terms of the old module
+ * are only computed once.
+ */
+template<typename FlowType>
+template<typename DeltaFlowType>
+inline
+void InfomapGreedySpecialized<FlowType>::getDeltaCodelengthsOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta,
+		const DeltaFlowType* newModuleDeltas, unsigned int numModules,
+		std::vector<double>& plogpTerms, double* deltaCodelengths,
+		const std::vector<FlowType>& moduleFlowData, const std::vector<ModulePlogpTerms>& modulePlogpTerms)
+{
+	if (numModules == 0)
+		return;
+	const FlowType& oldModuleData = moduleFlowData[oldModuleDelta.module];
+	const ModulePlogpTerms& oldModuleTerms = modulePlogpTerms[oldModuleDelta.module];
+	double deltaEnterExitOldModule = oldModuleDelta.deltaEnter + oldModuleDelta.deltaExit;
+
+	double oldTerms[3] = {
+			oldModuleData.enterFlow - current.data.enterFlow + deltaEnterExitOldModule,
+			oldModuleData.exitFlow - current.data.exitFlow + deltaEnterExitOldModule,
+			oldModuleData.exitFlow + oldModuleData.flow - current.data.exitFlow - current.data.flow + deltaEnterExitOldModule
+	};
+	infomath::plogpInPlace(oldTerms, 3);
+
+	const unsigned int numTerms = 4;
+	if (plogpTerms.size() < numTerms * numModules)
+		plogpTerms.resize(numTerms * numModules);
+	double* terms = &plogpTerms[0];
+	for (unsigned int j = 0; j < numModules; ++j)
+	{
+		const FlowType& newModuleData = moduleFlowData[newModuleDeltas[j].module];
+		double deltaEnterExitNewModule = newModuleDeltas[j].deltaEnter + newModuleDeltas[j].deltaExit;
+		terms[j] = Super::enterFlow + deltaEnterExitOldModule - deltaEnterExitNewModule;
+		terms[numModules + j] = newModuleData.enterFlow + current.data.enterFlow - deltaEnterExitNewModule;
+		terms[2 * numModules + j] = newModuleData.exitFlow + current.data.exitFlow - deltaEnterExitNewModule;
+		terms[3 * numModules + j] = newModuleData.exitFlow + newModuleData.flow \
+				+ current.data.exitFlow + current.data.flow - deltaEnterExitNewModule;
+	}
+
+	infomath::plogpInPlace(terms, numTerms * numModules);
+
+	for (unsigned int j = 0; j < numModules; ++j)
+	{
+		const ModulePlogpTerms& newModuleTerms = modulePlogpTerms[newModuleDeltas[j].module];
+		double delta_enter = terms[j] - Super::enterFlow_log_enterFlow;
+		double delta_enter_log_enter = - oldModuleTerms.enter_log_enter - newModuleTerms.enter_log_enter \
+				+ oldTerms[0] + terms[numModules + j];
+		double delta_exit_log_exit = - oldModuleTerms.exit_log_exit - newModuleTerms.exit_log_exit \
+				+ oldTerms[1] + terms[2 * numModules + j];
+		double delta_flow_log_flow = - oldModuleTerms.flow_log_flow - newModuleTerms.flow_log_flow \
+				+ oldTerms[2] + terms[3 * numModules + j];
+		deltaCodelengths[j] = delta_enter - delta_enter_log_enter - delta_exit_log_exit + delta_flow_log_flow;
+	}
+}
+
+template<>
+template<typename DeltaFlowType>
+inline
+void InfomapGreedySpecialized<FlowUndirected>::getDeltaCodelengthsOnMovingNode(NodeType& current, DeltaFlow& oldModuleDelta,
+		const DeltaFlowType* newModuleDeltas, unsigned int numModules,
+		std::vector<double>& plogpTerms, double* deltaCodelengths,
+		const std::vector<FlowType>& moduleFlowData, const std::vector<ModulePlogpTerms>& modulePlogpTerms)
+{
+	if (numModules == 0)
+		return;
+	const FlowType& oldModuleData = moduleFlowData[oldModuleDelta.module];
+	const ModulePlogpTerms& oldModuleTerms = modulePlogpTerms[oldModuleDelta.module];
+	double deltaEnterExitOldModule = oldModuleDelta.deltaEnter + oldModuleDelta.deltaExit;
+	// Double the effect as each link works in both directions
+	deltaEnterExitOldModule *= 2;
+
+	double oldTerms[2] = {
+			oldModuleData.exitFlow - current.data.exitFlow + deltaEnterExitOldModule,
+			oldModuleData.exitFlow + oldModuleData.flow - current.data.exitFlow - current.data.flow + deltaEnterExitOldModule
+	};
+	infomath::plogpInPlace(oldTerms, 2);
+
+	const unsigned int numTerms = 3;
+	if (plogpTerms.size() < numTerms * numModules)
+		plogpTerms.resize(numTerms * numModules);
+	double* terms = &plogpTerms[0];
+	for (unsigned int j = 0; j < numModules; ++j)
+	{
+		const FlowType& newModuleData = moduleFlowData[newModuleDeltas[j].module];
+		double deltaEnterExitNewModule = newModuleDeltas[j].deltaEnter + newModuleDeltas[j].deltaExit;
+		deltaEnterExitNewModule *= 2;
+		terms[j] = enterFlow + deltaEnterExitOldModule - deltaEnterExitNewModule;
+		terms[numModules + j] = newModuleData.exitFlow + current.data.exitFlow - deltaEnterExitNewModule;
+		terms[2 * numModules + j] = newModuleData.exitFlow + newModuleData.flow \
+				+ current.data.exitFlow + current.data.flow - deltaEnterExitNewModule;
+	}
+
+	infomath::plogpInPlace(terms, numTerms * numModules);
+
+	for (unsigned int j = 0; j < numModules; ++j)
+	{
+		const ModulePlogpTerms& newModuleTerms = modulePlogpTerms[newModuleDeltas[j].module];
+		double delta_exit = terms[j] - enterFlow_log_enterFlow;
+		double delta_exit_log_exit = - oldModuleTerms.exit_log_exit - newModuleTerms.exit_log_exit \
+				+ oldTerms[0] + terms[numModules + j];
+		double delta_flow_log_flow = - oldModuleTerms.flow_log_flow - newModuleTerms.flow_log_flow \
+				+ oldTerms[1] + terms[2 * numModules + j];
+		deltaCodelengths[j] = delta_exit - 2.0*delta_exit_log_exit + delta_flow_log_flow;
+	}
+}
+
 /**
  * Update the codelength to reflect the move of node current
  * in oldModuleDelta to newModuleDelta
@@ -333,14 +580,14 @@ void InfomapGreedySpecialized<FlowType>::updateCodelengthOnMovingNode(NodeType&
 			moduleFlowData[oldModule].enterFlow + \
 			moduleFlowData[newModule].enterFlow;
 	Super::enter_log_enter -= \
-			plogp(moduleFlowData[oldModule].enterFlow) + \
-			plogp(moduleFlowData[newModule].enterFlow);
+			m_modulePlogpTerms[oldModule].enter_log_enter + \
+			m_modulePlogpTerms[newModule].enter_log_enter;
 	Super::exit_log_exit -= \
-			plogp(moduleFlowData[oldModule].exitFlow) + \
-			plogp(moduleFlowData[newModule].exitFlow);
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
 	Super::flow_log_flow -= \
-			plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow) + \
-			plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow);
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
 
 
 	moduleFlowData[oldModule] -= current.data;
@@ -351,18 +598,21 @@ void InfomapGreedySpecialized<FlowType>::updateCodelengthOnMovingNode(NodeType&
 	moduleFlowData[newModule].enterFlow -= deltaEnterExitNewModule;
 	moduleFlowData[newModule].exitFlow -= deltaEnterExitNewModule;
 
+	updateModulePlogpTerms(oldModule);
+	updateModulePlogpTerms(newModule);
+
 	Super::enterFlow += \
 			moduleFlowData[oldModule].enterFlow + \
 			moduleFlowData[newModule].enterFlow;
 	Super::enter_log_enter += \
-			plogp(moduleFlowData[oldModule].enterFlow) + \
-			plogp(moduleFlowData[newModule].enterFlow);
+			m_modulePlogpTerms[oldModule].enter_log_enter + \
+			m_modulePlogpTerms[newModule].enter_log_enter;
 	Super::exit_log_exit += \
-			plogp(moduleFlowData[oldModule].exitFlow) + \
-			plogp(moduleFlowData[newModule].exitFlow);
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
 	Super::flow_log_flow += \
-			plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow) + \
-			plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow);
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
 
 	Super::enterFlow_log_enterFlow = plogp(Super::enterFlow);
 
@@ -391,11 +641,11 @@ void InfomapGreedySpecialized<FlowUndirected>::updateCodelengthOnMovingNode(Node
 			moduleFlowData[oldModule].enterFlow + \
 			moduleFlowData[newModule].enterFlow;
 	exit_log_exit -= \
-			plogp(moduleFlowData[oldModule].exitFlow) + \
-			plogp(moduleFlowData[newModule].exitFlow);
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
 	flow_log_flow -= \
-			plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow) + \
-			plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow);
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
 
 
 	moduleFlowData[oldModule] -= current.data;
@@ -404,15 +654,18 @@ void InfomapGreedySpecialized<FlowUndirected>::updateCodelengthOnMovingNode(Node
 	moduleFlowData[oldModule].exitFlow += deltaEnterExitOldModule;
 	moduleFlowData[newModule].exitFlow -= deltaEnterExitNewModule;
 
+	updateModulePlogpTerms(oldModule);
+	updateModulePlogpTerms(newModule);
+
 	enterFlow += \
 			moduleFlowData[oldModule].enterFlow + \
 			moduleFlowData[newModule].enterFlow;
 	exit_log_exit += \
-			plogp(moduleFlowData[oldModule].exitFlow) + \
-			plogp(moduleFlowData[newModule].exitFlow);
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
 	flow_log_flow += \
-			plogp(moduleFlowData[oldModule].exitFlow + moduleFlowData[oldModule].flow) + \
-			plogp(moduleFlowData[newModule].exitFlow + moduleFlowData[newModule].flow);
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
 
 	enterFlow_log_enterFlow = plogp(enterFlow);
 
@@ -437,6 +690,9 @@ void InfomapGreedySpecialized<FlowType>::updateFlowOnMovingNode(NodeType& curren
 
 	moduleFlowData[oldModule].exitFlow += deltaEnterExitOldModule;
 	moduleFlowData[newModule].exitFlow -= deltaEnterExitNewModule;
+
+	updateModulePlogpTerms(oldModule);
+	updateModulePlogpTerms(newModule);
 }
 
 template<>
@@ -459,6 +715,144 @@ void InfomapGreedySpecialized<FlowUndirected>::updateFlowOnMovingNode(NodeType&
 
 	moduleFlowData[oldModule].exitFlow += deltaEnterExitOldModule;
 	moduleFlowData[newModule].exitFlow -= deltaEnterExitNewModule;
+
+	updateModulePlogpTerms(oldModule);
+	updateModulePlogpTerms(newModule);
+}
+
+/**
+ * Update the flow of the old and new module on moving node current, but only
+ * accumulate the resulting change of the codelength terms in termsDelta.
+ * Only touches the data of the two modules involved, so moves between disjoint
+ * pairs of modules can be performed concurrently.
+ */
+template<typename FlowType>
+inline
+void InfomapGreedySpecialized<FlowType>::updateModuleFlowOnMovingNode(NodeType& current,
+		DeltaFlow& oldModuleDelta, DeltaFlow& newModuleDelta, CodelengthTermsDelta& termsDelta)
+{
+	using infomath::plogp;
+	std::vector<FlowType>& moduleFlowData = Super::m_moduleFlowData;
+	unsigned int oldModule = oldModuleDelta.module;
+	unsigned int newModule = newModuleDelta.module;
+	double deltaEnterExitOldModule = oldModuleDelta.deltaEnter + oldModuleDelta.deltaExit;
+	double deltaEnterExitNewModule = newModuleDelta.deltaEnter + newModuleDelta.deltaExit;
+
+	termsDelta.enterFlow -= \
+			moduleFlowData[oldModule].enterFlow + \
+			moduleFlowData[newModule].enterFlow;
+	termsDelta.enter_log_enter -= \
+			m_modulePlogpTerms[oldModule].enter_log_enter + \
+			m_modulePlogpTerms[newModule].enter_log_enter;
+	termsDelta.exit_log_exit -= \
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
+	termsDelta.flow_log_flow -= \
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
+
+	moduleFlowData[oldModule] -= current.data;
+	moduleFlowData[newModule] += current.data;
+
+	moduleFlowData[oldModule].enterFlow += deltaEnterExitOldModule;
+	moduleFlowData[oldModule].exitFlow += deltaEnterExitOldModule;
+	moduleFlowData[newModule].enterFlow -= deltaEnterExitNewModule;
+	moduleFlowData[newModule].exitFlow -= deltaEnterExitNewModule;
+
+	updateModulePlogpTerms(oldModule);
+	updateModulePlogpTerms(newModule);
+
+	termsDelta.enterFlow += \
+			moduleFlowData[oldModule].enterFlow + \
+			moduleFlowData[newModule].enterFlow;
+	termsDelta.enter_log_enter += \
+			m_modulePlogpTerms[oldModule].enter_log_enter + \
+			m_modulePlogpTerms[newModule].enter_log_enter;
+	termsDelta.exit_log_exit += \
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
+	termsDelta.flow_log_flow += \
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
+}
+
+template<>
+inline
+void InfomapGreedySpecialized<FlowUndirected>::updateModuleFlowOnMovingNode(NodeType& current,
+		DeltaFlow& oldModuleDelta, DeltaFlow& newModuleDelta, CodelengthTermsDelta& termsDelta)
+{
+	using infomath::plogp;
+	std::vector<FlowType>& moduleFlowData = Super::m_moduleFlowData;
+	unsigned int oldModule = oldModuleDelta.module;
+	unsigned int newModule = newModuleDelta.module;
+	double deltaEnterExitOldModule = oldModuleDelta.deltaEnter + oldModuleDelta.deltaExit;
+	double deltaEnterExitNewModule = newModuleDelta.deltaEnter + newModuleDelta.deltaExit;
+
+	// Double the effect as each link works in both directions
+	deltaEnterExitOldModule *= 2;
+	deltaEnterExitNewModule *= 2;
+
+	termsDelta.enterFlow -= \
+			moduleFlowData[oldModule].enterFlow + \
+			moduleFlowData[newModule].enterFlow;
+	termsDelta.exit_log_exit -= \
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
+	termsDelta.flow_log_flow -= \
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
+
+	moduleFlowData[oldModule] -= current.data;
+	moduleFlowData[newModule] += current.data;
+
+	moduleFlowData[oldModule].exitFlow += deltaEnterExitOldModule;
+	moduleFlowData[newModule].exitFlow -= deltaEnterExitNewModule;
+
+	updateModulePlogpTerms(oldModule);
+	updateModulePlogpTerms(newModule);
+
+	termsDelta.enterFlow += \
+			moduleFlowData[oldModule].enterFlow + \
+			moduleFlowData[newModule].enterFlow;
+	termsDelta.exit_log_exit += \
+			m_modulePlogpTerms[oldModule].exit_log_exit + \
+			m_modulePlogpTerms[newModule].exit_log_exit;
+	termsDelta.flow_log_flow += \
+			m_modulePlogpTerms[oldModule].flow_log_flow + \
+			m_modulePlogpTerms[newModule].flow_log_flow;
+}
+
+template<typename FlowType>
+inline
+void InfomapGreedySpecialized<FlowType>::applyCodelengthTermsDelta(const CodelengthTermsDelta& termsDelta)
+{
+	using infomath::plogp;
+	Super::enterFlow += termsDelta.enterFlow;
+	Super::enter_log_enter += termsDelta.enter_log_enter;
+	Super::exit_log_exit += termsDelta.exit_log_exit;
+	Super::flow_log_flow += termsDelta.flow_log_flow;
+
+	Super::enterFlow_log_enterFlow = plogp(Super::enterFlow);
+
+	Super::indexCodelength = Super::enterFlow_log_enterFlow - Super::enter_log_enter - Super::exitNetworkFlow_log_exitNetworkFlow;
+	Super::moduleCodelength = -Super::exit_log_exit + Super::flow_log_flow - Super::nodeFlow_log_nodeFlow;
+	Super::codelength = Super::indexCodelength + Super::moduleCodelength;
+}
+
+template<>
+inline
+void InfomapGreedySpecialized<FlowUndirected>::applyCodelengthTermsDelta(const CodelengthTermsDelta& termsDelta)
+{
+	using infomath::plogp;
+	enterFlow += termsDelta.enterFlow;
+	exit_log_exit += termsDelta.exit_log_exit;
+	flow_log_flow += termsDelta.flow_log_flow;
+
+	enterFlow_log_enterFlow = plogp(enterFlow);
+
+	indexCodelength = enterFlow_log_enterFlow - exit_log_exit - exitNetworkFlow_log_exitNetworkFlow;
+	moduleCodelength = -exit_log_exit + flow_log_flow - nodeFlow_log_nodeFlow;
+	codelength = indexCodelength + moduleCodelength;
 }
 
 #ifdef NS_INFOMAP
@@ -29,6 +29,7 @@
 #define INFOMAPGREEDYTYPESPECIALIZED_H_
 
 #include "InfomapGreedyCommon.h"
+#include "../utils/SmallFlatMap.h"
 #include <ostream>
 
 #ifdef NS_INFOMAP
@@ -83,6 +84,8 @@ protected:
 
 	void generateNetworkFromChildren(NodeBase& parent);
 
+	void generateSubNetworkView(const TreeData& parentTree, NodeBase& parent);
+
 	using Super::calculateCodelengthFromActiveNetwork;
 
 	virtual std::vector<PhysData>& getPhysicalMembers(NodeBase& node) { return m_dummyPhysData; }
@@ -102,11 +105,21 @@ protected:
 
 struct MemNodeSet
 {
+	MemNodeSet() : numMemNodes(0), sumFlow(0.0) {}
 	MemNodeSet(unsigned int numMemNodes, double sumFlow) : numMemNodes(numMemNodes), sumFlow(sumFlow) {}
 	unsigned int numMemNodes; // use counter to check for zero to avoid round-off errors in sumFlow
 	double sumFlow;
 };
 
+/**
+ * Order key-value pairs on key, for sorted vectors used in place of maps.
+ */
+struct KeyLess
+{
+	template<typename Pair>
+	bool operator()(const Pair& a, const Pair& b) const { return a.first < b.first; }
+};
+
 template<typename FlowType>
 class InfomapGreedyTypeSpecialized<FlowType, WithMemory> : public InfomapGreedyCommon<InfomapGreedyTypeSpecialized<FlowType, WithMemory> >
 {
@@ -118,7 +131,7 @@ class InfomapGreedyTypeSpecialized<FlowType, WithMemory> : public InfomapGreedyC
 	typedef MemNode<FlowType>																NodeType;
 	typedef Edge<NodeBase>																	EdgeType;
 	typedef MemDeltaFlow																	DeltaFlowType;
-	typedef std::map<unsigned int, MemNodeSet>												ModuleToMemNodes;
+	typedef SmallFlatMap<unsigned int, MemNodeSet, 2>										ModuleToMemNodes; // Mostly 1-4 modules per physical node
 
 	struct IndexedFlow {
 		IndexedFlow() : index(0) {}
@@ -134,6 +147,19 @@ class InfomapGreedyTypeSpecialized<FlowType, WithMemory> : public InfomapGreedyC
 		unsigned int index;
 		FlowType flowData;
 	};
+	typedef std::vector<std::pair<unsigned int, IndexedFlow> >								CondensedNodes; // Sorted on physical node
+
+	struct CondensedNodeFlowGreater
+	{
+		CondensedNodeFlowGreater(const CondensedNodes& nodes) : nodes(nodes) {}
+		bool operator()(unsigned int i, unsigned int j) const { return nodes[i].second.flowData.flow > nodes[j].second.flowData.flow; }
+		const CondensedNodes& nodes;
+	};
+
+	static IndexedFlow& findCondensedNode(CondensedNodes& nodes, unsigned int physIndex)
+	{
+		return std::lower_bound(nodes.begin(), nodes.end(), std::make_pair(physIndex, IndexedFlow()), KeyLess())->second;
+	}
 
 public:
 	typedef FlowType																		flow_type;
@@ -180,6 +206,9 @@ protected:
 
 	void generateNetworkFromChildren(NodeBase& parent);
 
+	// The physical node structure is re-indexed on the cloned nodes, so memory networks clone the edges
+	void generateSubNetworkView(const TreeData& parentTree, NodeBase& parent) { generateNetworkFromChildren(parent); }
+
 	virtual void saveHierarchicalNetwork(HierarchicalNetwork& output, std::string rootName, bool includeLinks);
 
 	virtual void printClusterNumbers(std::ostream& out);
@@ -340,7 +369,7 @@ inline bool InfomapGreedyTypeSpecialized<FlowType, WithMemory>::preClusterMultip
 	for (unsigned int i = 0; i < modules.size(); ++i) {
 		unsigned int moduleIndex = modules[i];
 		if (moduleNodes[moduleIndex] == 0)
-			moduleNodes[moduleIndex] = Super::m_treeData.nodeFactory().createNode("", 0.0, 0.0);
+			moduleNodes[moduleIndex] = Super::m_treeData.createNode("", 0.0, 0.0);
 		// Set child pointers from the module nodes to all leaf nodes
 		moduleNodes[moduleIndex]->addChild(&Super::m_treeData.getLeafNode(i));
 	}
@@ -455,6 +484,9 @@ void InfomapGreedyTypeSpecialized<FlowType, NetworkType>::initModuleOptimization
 		node.dirty = true;
 	}
 
+	Super::initModulePlogpTerms();
+	Super::initActiveAdjacency();
+
 	// Initiate codelength terms for the initial state of one module per node
 	Super::calculateCodelengthFromActiveNetwork();
 }
@@ -501,11 +533,12 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::initModuleOptimization(
 		for(unsigned int j = 0; j < numPhysicalMembers; ++j)
 		{
 			PhysData& physData = node.physicalNodes[j];
-			m_physToModuleToMemNodes[physData.physNodeIndex].insert(m_physToModuleToMemNodes[physData.physNodeIndex].end(),
-					std::make_pair(i, MemNodeSet(1, physData.sumFlowFromStateNode)));
+			m_physToModuleToMemNodes[physData.physNodeIndex].insert(std::make_pair(i, MemNodeSet(1, physData.sumFlowFromStateNode)));
 		}
 	}
 
+	Super::initModulePlogpTerms();
+	Super::initActiveAdjacency();
 
 	// Initiate codelength terms for the initial state of one module per node
 	Super::calculateCodelengthFromActiveNetwork();
@@ -740,7 +773,7 @@ void InfomapGreedyTypeSpecialized<FlowType, NetworkType>::generateNetworkFromChi
 			childIt != endIt; ++childIt, ++i)
 	{
 		NodeType& otherNode = Super::getNode(*childIt);
-		NodeBase* node = new NodeType(otherNode);
+		NodeBase* node = Super::m_treeData.createNode(otherNode);
 		node->originalIndex = childIt->originalIndex;
 		Super::m_treeData.addClonedNode(node);
 		childIt->index = i; // Set index to its place in this subnetwork to be able to find edge target below
@@ -772,17 +805,85 @@ void InfomapGreedyTypeSpecialized<FlowType, NetworkType>::generateNetworkFromChi
 	Super::exitNetworkFlow_log_exitNetworkFlow = infomath::plogp(Super::exitNetworkFlow);
 }
 
+template<typename FlowType, typename NetworkType>
+void InfomapGreedyTypeSpecialized<FlowType, NetworkType>::generateSubNetworkView(const TreeData& parentTree, NodeBase& parent)
+{
+	// Clone all nodes
+	unsigned int numNodes = parent.childDegree();
+	Super::m_treeData.reserveNodeCount(numNodes);
+	const bool parentIsView = parentTree.isLeafLinkView();
+	unsigned int maxNumLinks = 0;
+	unsigned int i = 0;
+	for (NodeBase::sibling_iterator childIt(parent.begin_child()), endIt(parent.end_child());
+			childIt != endIt; ++childIt, ++i)
+	{
+		NodeType& otherNode = Super::getNode(*childIt);
+		NodeBase* node = Super::m_treeData.createNode(otherNode);
+		node->originalIndex = childIt->originalIndex;
+		Super::m_treeData.addClonedNode(node);
+		childIt->index = i; // Set index to its place in this subnetwork to be able to find link target below
+		node->index = i;
+		if (parentIsView && childIt->isLeaf())
+		{
+			const Adjacency& parentLinks = parentTree.leafLinkView();
+			maxNumLinks += parentLinks.endOut(childIt->leafIndex) - parentLinks.beginOut(childIt->leafIndex);
+		}
+		else
+			maxNumLinks += childIt->outDegree();
+	}
+	Super::root()->setChildDegree(Super::numLeafNodes());
+
+	// Add the links within the module in the same order as the edges would have been cloned
+	const NodeBase* parentPtr = &parent;
+	Super::m_treeData.beginLeafLinkView(maxNumLinks);
+	for (NodeBase::sibling_iterator childIt(parent.begin_child()), endIt(parent.end_child());
+			childIt != endIt; ++childIt)
+	{
+		NodeBase& node = *childIt;
+		if (parentIsView && node.isLeaf())
+		{
+			// The links of the leaf nodes in a view are only stored in its adjacency
+			const Adjacency& parentLinks = parentTree.leafLinkView();
+			unsigned int leafIndex = node.leafIndex;
+			if (parentLinks.hasSelfLink(leafIndex))
+				Super::m_treeData.addLeafLink(node.index, node.index, parentLinks.selfLinkFlow(leafIndex));
+			for (unsigned int link = parentLinks.beginOut(leafIndex), endLink = parentLinks.endOut(leafIndex); link != endLink; ++link)
+			{
+				const NodeBase& target = parentTree.getLeafNode(parentLinks.outNeighbour(link));
+				if (target.parent == parentPtr)
+					Super::m_treeData.addLeafLink(node.index, target.index, parentLinks.outFlow(link));
+			}
+		}
+		else
+		{
+			for (NodeBase::edge_iterator outEdgeIt(node.begin_outEdge()), endIt(node.end_outEdge());
+					outEdgeIt != endIt; ++outEdgeIt)
+			{
+				const EdgeType& edge = **outEdgeIt;
+				// If neighbour node is within the same module, add the link to this subnetwork.
+				if (edge.target.parent == parentPtr)
+					Super::m_treeData.addLeafLink(node.index, edge.target.index, edge.data.flow);
+			}
+		}
+	}
+	Super::m_treeData.endLeafLinkView();
+
+	double parentExit = Super::getNode(parent).data.exitFlow;
+
+	Super::exitNetworkFlow = parentExit;
+	Super::exitNetworkFlow_log_exitNetworkFlow = infomath::plogp(Super::exitNetworkFlow);
+}
+
 template<typename FlowType>
 void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::consolidatePhysicalNodes(std::vector<NodeBase*>& modules)
 {
-	std::map<unsigned int, std::map<unsigned int, unsigned int> > validate;
-
 	for(unsigned int i = 0; i < m_numPhysicalNodes; ++i)
 	{
 		ModuleToMemNodes& modToMemNodes = m_physToModuleToMemNodes[i];
 		for(ModuleToMemNodes::iterator overlapIt = modToMemNodes.begin(); overlapIt != modToMemNodes.end(); ++overlapIt)
 		{
-			if(++validate[overlapIt->first][i] > 1)
+			// The modules of each physical node are unique if kept in strictly increasing order
+			if (overlapIt != modToMemNodes.begin() && (overlapIt - 1)->first >= overlapIt->first)
 				throw std::domain_error("[InfomapGreedy::consolidateModules] Error updating physical nodes: duplication error");
 
 			getNode(*modules[overlapIt->first]).physicalNodes.push_back(PhysData(i, overlapIt->second.sumFlow));
@@ -793,7 +894,7 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::consolidatePhysicalNode
 template<typename FlowType>
 void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::generateNetworkFromChildren(NodeBase& parent)
 {
-	std::set<unsigned int> setOfPhysicalNodes;
+	std::vector<unsigned int> physicalNodes;
 
 	// Clone all nodes
 	unsigned int numNodes = parent.childDegree();
@@ -803,7 +904,7 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::generateNetworkFromChil
 			childIt != endIt; ++childIt, ++i)
 	{
 		NodeType& otherNode = getNode(*childIt);
-		NodeBase* node = new NodeType(otherNode);
+		NodeBase* node = Super::m_treeData.createNode(otherNode);
 		node->originalIndex = childIt->originalIndex;
 		Super::m_treeData.addClonedNode(node);
 		childIt->index = i; // Set index to its place in this subnetwork to be able to find edge target below
@@ -812,18 +913,14 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::generateNetworkFromChil
 		for (unsigned int j = 0; j < otherNode.physicalNodes.size(); ++j)
 		{
 			PhysData& physData = otherNode.physicalNodes[j];
-			setOfPhysicalNodes.insert(physData.physNodeIndex);
+			physicalNodes.push_back(physData.physNodeIndex);
 		}
 	}
 	Super::root()->setChildDegree(Super::numLeafNodes());
 
-	// Re-index physical nodes
-	std::map<unsigned int, unsigned int> subPhysIndexMap;
-	unsigned int subPhysIndex = 0;
-	for (std::set<unsigned int>::iterator it(setOfPhysicalNodes.begin()); it != setOfPhysicalNodes.end(); ++it, ++subPhysIndex)
-	{
-		subPhysIndexMap.insert(std::make_pair(*it, subPhysIndex));
-	}
+	// Re-index physical nodes to their position among the sorted unique physical nodes
+	std::sort(physicalNodes.begin(), physicalNodes.end());
+	physicalNodes.erase(std::unique(physicalNodes.begin(), physicalNodes.end()), physicalNodes.end());
 
 	for (typename TreeData::leafIterator leafIt(Super::m_treeData.begin_leaf()); leafIt != Super::m_treeData.end_leaf(); ++leafIt, ++i)
 	{
@@ -831,11 +928,12 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::generateNetworkFromChil
 		for (unsigned int j = 0; j < node.physicalNodes.size(); ++j)
 		{
 			PhysData& physData = node.physicalNodes[j];
-			physData.physNodeIndex = subPhysIndexMap[physData.physNodeIndex];
+			physData.physNodeIndex = std::lower_bound(physicalNodes.begin(), physicalNodes.end(),
+					physData.physNodeIndex) - physicalNodes.begin();
 		}
 	}
 
-	m_numPhysicalNodes = setOfPhysicalNodes.size();
+	m_numPhysicalNodes = physicalNodes.size();
 
 	NodeBase* parentPtr = &parent;
 	// Clone edges
@@ -912,7 +1010,7 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::saveHierarchicalNetwork
 
 	Super::buildHierarchicalNetworkHelper(ioNetwork, ioNetwork.getRootNode(), leafModules);
 
-	std::vector<std::map<unsigned int, IndexedFlow> > physicalNodes(leafModules.size());
+	std::vector<CondensedNodes> physicalNodes(leafModules.size());
 	// Need a global map for links as the source network may be in different Infomap instance from the leaf modules
 	std::vector<unsigned int> memNodeIndexToLeafModuleIndex(Super::m_treeData.numLeafNodes());
 	unsigned int numCondensedNodes = 0;
@@ -924,43 +1022,49 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::saveHierarchicalNetwork
 	for (unsigned int i = 0; i < leafModules.size(); ++i)
 	{
 		NodeBase* leafModule = leafModules[i].first;
-		std::map<unsigned int, IndexedFlow>& condensedNodes = physicalNodes[i];
+		CondensedNodes& condensedNodes = physicalNodes[i];
+		condensedNodes.reserve(leafModule->childDegree());
 		for (NodeBase::sibling_iterator childIt(leafModule->begin_child()), endIt(leafModule->end_child());
 				childIt != endIt; ++childIt)
 		{
 			const NodeType& node = getNode(*childIt);
-			std::pair<typename std::map<unsigned int, IndexedFlow>::iterator, bool> ret = condensedNodes.insert(std::make_pair(node.stateNode.physIndex, IndexedFlow(node.stateNode.physIndex, node.data)));
-			if (!ret.second) // Add flow if physical node already exist
-				ret.first->second.flowData += node.data; //TODO: If exitFlow should be correct, flow between memory nodes within same physical node should be subtracted.
-			else // A new insertion was made
-				++numCondensedNodes;
+			condensedNodes.push_back(std::make_pair(node.stateNode.physIndex, IndexedFlow(node.stateNode.physIndex, node.data)));
 			memNodeIndexToLeafModuleIndex[node.originalIndex] = i;
 		}
+		// Stable to add the flow of the memory nodes in the same order as they were found
+		std::stable_sort(condensedNodes.begin(), condensedNodes.end(), KeyLess());
+		unsigned int numUnique = 0;
+		for (unsigned int j = 0; j < condensedNodes.size(); ++j)
+		{
+			if (numUnique != 0 && condensedNodes[numUnique - 1].first == condensedNodes[j].first)
+				condensedNodes[numUnique - 1].second.flowData += condensedNodes[j].second.flowData; //TODO: If exitFlow should be correct, flow between memory nodes within same physical node should be subtracted.
+			else
+				condensedNodes[numUnique++] = condensedNodes[j];
+		}
+		condensedNodes.resize(numUnique);
+		numCondensedNodes += numUnique;
 	}
 
 	Log() << " to " << numCondensedNodes << " nodes... " << std::flush;
 	ioNetwork.prepareAddLeafNodes(numCondensedNodes);
 
 	unsigned int sortedNodeIndex = 0;
+	std::vector<unsigned int> sortedNodes;
 	for (unsigned int i = 0; i < leafModules.size(); ++i)
 	{
 		// Sort the nodes on flow
-		std::map<unsigned int, IndexedFlow>& condensedNodes = physicalNodes[i];
-		typedef typename std::map<unsigned int, IndexedFlow>::iterator CondensedIterator;
-		std::multimap<double, CondensedIterator, std::greater<double> > sortedNodes;
-		for (CondensedIterator it(condensedNodes.begin()); it != condensedNodes.end(); ++it)
-		{
-			// Store the iterator to keep the reference to the mapped IndexedFlow item;
-			sortedNodes.insert(std::make_pair(it->second.flowData.flow, it));
-		}
+		CondensedNodes& condensedNodes = physicalNodes[i];
+		sortedNodes.resize(condensedNodes.size());
+		for (unsigned int j = 0; j < sortedNodes.size(); ++j)
+			sortedNodes[j] = j;
+		std::stable_sort(sortedNodes.begin(), sortedNodes.end(), CondensedNodeFlowGreater(condensedNodes));
 
 		// Add the condensed leaf nodes to the hierarchical network
 		HierarchicalNetwork::node_type* parent = leafModules[i].second;
-		for (typename std::multimap<double, CondensedIterator, std::greater<double> >::iterator it(sortedNodes.begin()); it != sortedNodes.end(); ++it)
+		for (unsigned int j = 0; j < sortedNodes.size(); ++j)
 		{
-			CondensedIterator& condensedIt(it->second);
-			IndexedFlow& nodeData = condensedIt->second;
-			unsigned int physIndex = condensedIt->first;
+			IndexedFlow& nodeData = condensedNodes[sortedNodes[j]].second;
+			unsigned int physIndex = condensedNodes[sortedNodes[j]].first;
 			ioNetwork.addLeafNode(*parent, nodeData.flowData.flow, nodeData.flowData.exitFlow, Super::m_nodeNames[nodeData.index], sortedNodeIndex, nodeData.index, false, 0, physIndex);
 			// Remap to sorted indices to help link creation
 			nodeData.index = sortedNodeIndex;
@@ -974,16 +1078,14 @@ void InfomapGreedyTypeSpecialized<FlowType, WithMemory>::saveHierarchicalNetwork
 		{
 			NodeBase& node = **leafIt;
 			unsigned int leafModuleIndex = memNodeIndexToLeafModuleIndex[node.originalIndex];
-			std::map<unsigned int, IndexedFlow>& condensedNodes = physicalNodes[leafModuleIndex];
-			unsigned int sourceNodeIndex = condensedNodes.find(getNode(node).stateNode.physIndex)->second.index;
+			unsigned int sourceNodeIndex = findCondensedNode(physicalNodes[leafModuleIndex], getNode(node).stateNode.physIndex).index;
 
 			for (NodeBase::edge_iterator outEdgeIt(node.begin_outEdge()), endIt(node.end_outEdge());
 					outEdgeIt != endIt; ++outEdgeIt)
 			{
 				EdgeType& edge = **outEdgeIt;
 				unsigned int targetLeafModuleIndex = memNodeIndexToLeafModuleIndex[edge.target.originalIndex];
-				std::map<unsigned int, IndexedFlow>& targetCondensedNodes = physicalNodes[targetLeafModuleIndex];
-				unsigned int targetNodeIndex = targetCondensedNodes.find(getNode(edge.target).stateNode.physIndex)->second.index;
+				unsigned int targetNodeIndex = findCondensedNode(physicalNodes[targetLeafModuleIndex], getNode(edge.target).stateNode.physIndex).index;
 				ioNetwork.addLeafEdge(sourceNodeIndex, targetNodeIndex, edge.data.flow);
 			}
 		}
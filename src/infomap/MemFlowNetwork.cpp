@@ -27,6 +27,7 @@
 
 #include "MemFlowNetwork.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <iterator>
@@ -43,6 +44,29 @@ namespace infomap
 {
 #endif
 
+namespace
+{
+	struct LessWeight
+	{
+		bool operator()(const std::pair<double, unsigned int>& a, const std::pair<double, unsigned int>& b) const
+		{
+			return a.first < b.first;
+		}
+	};
+
+	/**
+	 * Find the index of a state node in the sorted state nodes, from the given position.
+	 * @return the index, or the number of state nodes if not found
+	 */
+	unsigned int findStateNode(const std::vector<StateNode>& stateNodes, unsigned int begin, const StateNode& stateNode)
+	{
+		std::vector<StateNode>::const_iterator it = std::lower_bound(stateNodes.begin() + begin, stateNodes.end(), stateNode);
+		if (it == stateNodes.end() || stateNode < *it)
+			return stateNodes.size();
+		return it - stateNodes.begin();
+	}
+}
+
 void MemFlowNetwork::calculateFlow(const Network& net, const Config& config)
 {
 	if (!config.isMemoryNetwork())
@@ -66,67 +90,154 @@ void MemFlowNetwork::calculateFlow(const Network& net, const Config& config)
 	m_flowLinks.resize(numLinks);
 	double totalStateLinkWeight = network.totalStateLinkWeight();
 	double sumUndirLinkWeight = 2 * totalStateLinkWeight - network.totalMemorySelfLinkWeight();
-	unsigned int linkIndex = 0;
 	const MemNetwork::StateNodeMap& nodeMap = network.stateNodeMap();
 
-	for (MemNetwork::StateLinkMap::const_iterator linkIt(linkMap.begin()); linkIt != linkMap.end(); ++linkIt)
+	// The state nodes are indexed in sorted order, so the index of a state node is found by
+	// binary search in the contiguous array of state nodes instead of in the node map
+	m_statenodes.resize(numStateNodes);
+	for (MemNetwork::StateNodeMap::const_iterator statenodeIt(nodeMap.begin()); statenodeIt != nodeMap.end(); ++statenodeIt)
 	{
-		const StateNode& statesource = linkIt->first;
-		const std::map<StateNode, double>& subLinks = linkIt->second;
-		for (std::map<StateNode, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt, ++linkIndex)
-		{
-			const StateNode& statetarget = subIt->first;
-			double linkWeight = subIt->second;
-
-			// Get the indices for the state nodes
-			MemNetwork::StateNodeMap::const_iterator nodeMapIt = nodeMap.find(statesource);
-			if (nodeMapIt == nodeMap.end())
-				throw InputDomainError(io::Str() << "Couldn't find mapped index for source State node " << statesource);
-			unsigned int sourceIndex = nodeMapIt->second;
-			nodeMapIt = nodeMap.find(statetarget);
-			if (nodeMapIt == nodeMap.end())
-				throw InputDomainError(io::Str() << "Couldn't find mapped index for target State node " << statetarget);
-			unsigned int targetIndex = nodeMapIt->second;
+		m_statenodes[statenodeIt->second] = statenodeIt->first;
+	}
 
-			m_nodeFlow[sourceIndex] += linkWeight;// / sumUndirLinkWeight;
-			m_flowLinks[linkIndex] = Link(sourceIndex, targetIndex, linkWeight);
+	// Index the source state nodes with the offset of their links, to look up the
+	// state node indices of the links in parallel. The sources come in sorted order,
+	// so their indices are found by merging with the state nodes.
+	std::vector<MemNetwork::StateLinkMap::const_iterator> sourceIts;
+	std::vector<unsigned int> sourceIndices;
+	std::vector<unsigned int> linkOffsets;
+	sourceIts.reserve(linkMap.size());
+	sourceIndices.reserve(linkMap.size());
+	linkOffsets.reserve(linkMap.size());
+	unsigned int linkIndex = 0;
+	unsigned int stateNodeIndex = 0;
+	for (MemNetwork::StateLinkMap::const_iterator linkIt(linkMap.begin()); linkIt != linkMap.end(); ++linkIt)
+	{
+		while (stateNodeIndex < numStateNodes && m_statenodes[stateNodeIndex] < linkIt->first)
+			++stateNodeIndex;
+		bool found = stateNodeIndex < numStateNodes && m_statenodes[stateNodeIndex] == linkIt->first;
+		sourceIts.push_back(linkIt);
+		sourceIndices.push_back(found ? stateNodeIndex : numStateNodes);
+		linkOffsets.push_back(linkIndex);
+		linkIndex += linkIt->second.size();
+	}
 
-			if (sourceIndex != targetIndex && !config.outdirdir)
-				m_nodeFlow[targetIndex] += linkWeight;// / sumUndirLinkWeight;
+	// The first link, in link order, to a state node that isn't indexed
+	unsigned int missingLinkIndex = numLinks;
+	StateNode missingStateNode;
+	bool missingSource = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+	for (int sourceIndex = 0; sourceIndex < static_cast<int>(sourceIts.size()); ++sourceIndex)
+	{
+		const StateNode& statesource = sourceIts[sourceIndex]->first;
+		const std::map<StateNode, double>& subLinks = sourceIts[sourceIndex]->second;
+		unsigned int stateLinkIndex = linkOffsets[sourceIndex];
 
+		// Get the indices for the state nodes
+		unsigned int sourceStateIndex = sourceIndices[sourceIndex];
+		if (sourceStateIndex == numStateNodes)
+		{
+#ifdef _OPENMP
+#pragma omp critical (missingStateNode)
+#endif
+			if (stateLinkIndex < missingLinkIndex)
+			{
+				missingLinkIndex = stateLinkIndex;
+				missingStateNode = statesource;
+				missingSource = true;
+			}
+			continue;
+		}
+		// The targets are sorted too, so each search starts from the previous target
+		unsigned int targetStateIndex = 0;
+		for (std::map<StateNode, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt, ++stateLinkIndex)
+		{
+			const StateNode& statetarget = subIt->first;
+			targetStateIndex = findStateNode(m_statenodes, targetStateIndex, statetarget);
+			if (targetStateIndex == numStateNodes)
+			{
+#ifdef _OPENMP
+#pragma omp critical (missingStateNode)
+#endif
+				if (stateLinkIndex < missingLinkIndex)
+				{
+					missingLinkIndex = stateLinkIndex;
+					missingStateNode = statetarget;
+					missingSource = false;
+				}
+				break;
+			}
+			m_flowLinks[stateLinkIndex] = Link(sourceStateIndex, targetStateIndex, subIt->second);
 		}
 	}
+	if (missingLinkIndex != numLinks)
+		throw InputDomainError(io::Str() << "Couldn't find mapped index for " << (missingSource ? "source" : "target") <<
+				" State node " << missingStateNode);
 
-	m_statenodes.resize(numStateNodes);
-	for (MemNetwork::StateNodeMap::const_iterator statenodeIt(nodeMap.begin()); statenodeIt != nodeMap.end(); ++statenodeIt)
+	for (LinkVec::const_iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
 	{
-		m_statenodes[statenodeIt->second] = statenodeIt->first;
+		const Link& link = *linkIt;
+		m_nodeFlow[link.source] += link.weight;// / sumUndirLinkWeight;
+		if (link.source != link.target && !config.outdirdir)
+			m_nodeFlow[link.target] += link.weight;// / sumUndirLinkWeight;
 	}
 
 	if (!config.isStateNetwork() && config.completeDanglingMemoryNodes)
 	{
 		unsigned int numM1Nodes = network.numNodes();
-		typedef std::multimap<double, unsigned int> PhysToMemWeightMap;
-		std::vector<PhysToMemWeightMap> netPhysToMem(numM1Nodes);
+		// The weight and state node index of the m1 links from each physical node, ordered on weight
+		typedef std::vector<std::pair<double, unsigned int> > PhysToMemWeights;
+		std::vector<PhysToMemWeights> netPhysToMem(numM1Nodes);
+
+		// The m1 links are sorted on source, collect where the links of each source start
+		const Network::LinkVec& m1Links = network.links();
+		unsigned int numM1Links = m1Links.size();
+		std::vector<unsigned int> m1SourceStarts;
+		for (unsigned int i = 0; i < numM1Links; ++i)
+		{
+			if (i == 0 || m1Links[i].n1 != m1Links[i - 1].n1)
+				m1SourceStarts.push_back(i);
+		}
+		m1SourceStarts.push_back(numM1Links);
 
-		const LinkMap& m1LinkMap = network.linkMap();
 		// Map middle column in trigrams to target state nodes (source to link for m1 links)
-		for (LinkMap::const_iterator linkIt(m1LinkMap.begin()); linkIt != m1LinkMap.end(); ++linkIt)
+		bool missingMemoryNode = false;
+		StateNode missingNode;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+		for (int sourceIndex = 0; sourceIndex < static_cast<int>(m1SourceStarts.size()) - 1; ++sourceIndex)
 		{
-			unsigned int linkEnd1 = linkIt->first;
-			const std::map<unsigned int, double>& subLinks = linkIt->second;
-			for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
+			unsigned int linkBegin = m1SourceStarts[sourceIndex];
+			unsigned int linkEnd = m1SourceStarts[sourceIndex + 1];
+			unsigned int linkEnd1 = m1Links[linkBegin].n1;
+			PhysToMemWeights& physToMem = netPhysToMem[linkEnd1];
+			physToMem.reserve(linkEnd - linkBegin);
+			for (unsigned int linkIndex = linkBegin; linkIndex < linkEnd; ++linkIndex)
 			{
-				unsigned int linkEnd2 = subIt->first;
-				double linkWeight = subIt->second;
-				MemNetwork::StateNodeMap::const_iterator stateit = nodeMap.find(StateNode(linkEnd1, linkEnd2));
-				if (stateit == nodeMap.end())
-					throw InputDomainError(io::Str() << "Memory node (" << linkEnd1 << ", " << linkEnd2 << ") not indexed!");
-				unsigned int statenodeIndex = stateit->second;
-				PhysToMemWeightMap& physMap = netPhysToMem[linkEnd1];
-				physMap.insert(std::make_pair(linkWeight, statenodeIndex));
+				unsigned int linkEnd2 = m1Links[linkIndex].n2;
+				double linkWeight = m1Links[linkIndex].weight;
+				unsigned int stateIndex = findStateNode(m_statenodes, 0, StateNode(linkEnd1, linkEnd2));
+				if (stateIndex == numStateNodes)
+				{
+#ifdef _OPENMP
+#pragma omp critical (missingStateNode)
+#endif
+					{
+						missingMemoryNode = true;
+						missingNode = StateNode(linkEnd1, linkEnd2);
+					}
+					break;
+				}
+				physToMem.push_back(std::make_pair(linkWeight, stateIndex));
 			}
+			// Stable to keep the links with equal weight in link order
+			std::stable_sort(physToMem.begin(), physToMem.end(), LessWeight());
 		}
+		if (missingMemoryNode)
+			throw InputDomainError(io::Str() << "Memory node (" << missingNode.stateIndex << ", " << missingNode.physIndex << ") not indexed!");
 
 	// Other ways to complete dangling nodes...
 		// for (unsigned int i = 0; i < numStateNodes; ++i)
@@ -165,8 +276,8 @@ void MemFlowNetwork::calculateFlow(const Network& net, const Config& config)
 				++numDanglingStateNodes;
 				// We are in physIndex, lookup all mem nodes in that physical node
 				// and add a link to the target node of those mem nodes (pre-mapped above)
-				const PhysToMemWeightMap& physToMem = netPhysToMem[m_statenodes[i].physIndex];
-				for(PhysToMemWeightMap::const_iterator it = physToMem.begin(); it != physToMem.end(); it++)
+				const PhysToMemWeights& physToMem = netPhysToMem[m_statenodes[i].physIndex];
+				for(PhysToMemWeights::const_iterator it = physToMem.begin(); it != physToMem.end(); it++)
 				{
 					unsigned int from = i;
 					unsigned int to = it->second;
@@ -310,10 +421,14 @@ void MemFlowNetwork::calculateFlow(const Network& net, const Config& config)
 	}
 
 	// Normalize link weights with respect to its source nodes total out-link weight;
-	for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < static_cast<int>(m_flowLinks.size()); ++i)
 	{
-		if (sumLinkOutWeight[linkIt->source] > 0)
-			linkIt->flow /= sumLinkOutWeight[linkIt->source];
+		Link& link = m_flowLinks[i];
+		if (sumLinkOutWeight[link.source] > 0)
+			link.flow /= sumLinkOutWeight[link.source];
 	}
 
 	// Collect dangling nodes
@@ -325,89 +440,17 @@ void MemFlowNetwork::calculateFlow(const Network& net, const Config& config)
 	}
 
 	// Calculate PageRank
+	TransposedLinks inLinks(numStateNodes, m_flowLinks);
 	std::vector<double> nodeFlowTmp(numStateNodes, 0.0);
-	unsigned int numIterations = 0;
 	double alpha = config.teleportationProbability;
-	double beta = 1.0 - alpha;
-	double sqdiff = 1.0;
 	double danglingRank = 0.0;
-	do
-	{
-		// Calculate dangling rank
-		danglingRank = 0.0;
-		for (std::vector<unsigned int>::iterator danglingIt(danglings.begin()); danglingIt != danglings.end(); ++danglingIt)
-		{
-			danglingRank += m_nodeFlow[*danglingIt];
-		}
-
-		// Flow from teleportation
-		for (unsigned int i = 0; i < numStateNodes; ++i)
-		{
-			nodeFlowTmp[i] = (alpha + beta*danglingRank) * m_nodeTeleportRates[i];
-		}
-
-		// Flow from links
-		for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
-		{
-			Link& link = *linkIt;
-			nodeFlowTmp[link.target] += beta * link.flow * m_nodeFlow[link.source];
-		}
-
-		// Update node flow from the power iteration above and check if converged
-		double sum = 0.0;
-		double sqdiff_old = sqdiff;
-		sqdiff = 0.0;
-		for (unsigned int i = 0; i < numStateNodes; ++i)
-		{
-			sum += nodeFlowTmp[i];
-			sqdiff += std::abs(nodeFlowTmp[i] - m_nodeFlow[i]);
-			m_nodeFlow[i] = nodeFlowTmp[i];
-		}
-
-		// Normalize if needed
-		if (std::abs(sum - 1.0) > 1.0e-10)
-		{
-			Log() << "(Normalizing ranks after " <<	numIterations << " power iterations with error " << (sum-1.0) << ") ";
-			for (unsigned int i = 0; i < numStateNodes; ++i)
-			{
-				m_nodeFlow[i] /= sum;
-			}
-			std::cerr << "DEBUG BREAK!!" << std::endl;
-			break;
-		}
-
-		// Perturb the system if equilibrium
-		if(sqdiff == sqdiff_old)
-		{
-			alpha += 1.0e-10;
-			beta = 1.0 - alpha;
-		}
-
-		numIterations++;
-	}  while((numIterations < 300) && (sqdiff > 1.0e-15 || numIterations < 50));
-
-	double sumNodeRank = 1.0;
-
-	if (!config.recordedTeleportation)
-	{
-		//Take one last power iteration excluding the teleportation (and normalize node flow to sum 1.0)
-		sumNodeRank = 1.0 - danglingRank;
-		m_nodeFlow.assign(numStateNodes, 0.0);
-		for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
-		{
-			Link& link = *linkIt;
-			m_nodeFlow[link.target] += link.flow * nodeFlowTmp[link.source] / sumNodeRank;
-		}
-		beta = 1.0;
-	}
-
-	// Update the links with their global flow from the PageRank values. (Note: beta is set to 1 if unrec)
-	for (LinkVec::iterator linkIt(m_flowLinks.begin()); linkIt != m_flowLinks.end(); ++linkIt)
-	{
-		linkIt->flow *= beta * nodeFlowTmp[linkIt->source] / sumNodeRank;
-	}
+	double residual = 0.0;
+	unsigned int numIterations = solvePageRank(inLinks, danglings, config, m_nodeFlow, nodeFlowTmp,
+			danglingRank, alpha, residual);
+	updateFlowFromPageRank(inLinks, nodeFlowTmp, danglingRank, alpha, config);
 
-	Log() << "\n  -> PageRank calculation done in " << numIterations << " iterations." << std::endl;
+	Log() << "\n  -> PageRank calculation done in " << numIterations << " " << config.flowSolver <<
+			" iterations with residual " << residual << "." << std::endl;
 }
 
 #ifdef NS_INFOMAP
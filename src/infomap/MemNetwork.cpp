@@ -263,58 +263,49 @@ void MemNetwork::simulateMemoryFromOrdinaryNetwork()
 	if (m_config.originallyUndirected)
 	{
 		Log() << "(inflating undirected network... " << std::flush;
-		LinkMap oldNetwork;
+		LinkVec oldNetwork;
 		oldNetwork.swap(m_links);
-		for (LinkMap::const_iterator linkIt(oldNetwork.begin()); linkIt != oldNetwork.end(); ++linkIt)
+		m_links.reserve(2 * oldNetwork.size());
+		for (LinkVec::const_iterator linkIt(oldNetwork.begin()); linkIt != oldNetwork.end(); ++linkIt)
 		{
-			unsigned int linkEnd1 = linkIt->first;
-			const std::map<unsigned int, double>& subLinks = linkIt->second;
-			for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
-			{
-				unsigned int linkEnd2 = subIt->first;
-				double linkWeight = subIt->second;
-				// Add link to both directions
-				insertLink(linkEnd1, linkEnd2, linkWeight);
-				insertLink(linkEnd2, linkEnd1, linkWeight);
-			}
+			// Add link to both directions
+			insertLink(linkIt->n1, linkIt->n2, linkIt->weight);
+			insertLink(linkIt->n2, linkIt->n1, linkIt->weight);
 		}
 
 		// Dispose old network from memory
-		LinkMap().swap(oldNetwork);
+		LinkVec().swap(oldNetwork);
+		sortLinks();
 		Log() << ") " << std::flush;
 	}
 
-	for (LinkMap::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+	for (LinkVec::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
 	{
-		unsigned int n1 = linkIt->first;
-		const std::map<unsigned int, double>& subLinks = linkIt->second;
-		for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
-		{
-			unsigned int n2 = subIt->first;
-			double firstLinkWeight = subIt->second;
+		unsigned int n1 = linkIt->n1;
+		unsigned int n2 = linkIt->n2;
+		double firstLinkWeight = linkIt->weight;
 
-			// Create trigrams with all links that start with the end node of current link
-			LinkMap::iterator secondLinkIt = m_links.find(n2);
-			if (secondLinkIt != m_links.end())
+		// Create trigrams with all links that start with the end node of current link
+		std::pair<LinkVec::const_iterator, LinkVec::const_iterator> secondLinks = outLinkRange(n2);
+		if (secondLinks.first != secondLinks.second)
+		{
+			unsigned int numSecondLinks = secondLinks.second - secondLinks.first;
+			for (LinkVec::const_iterator secondLinkIt(secondLinks.first); secondLinkIt != secondLinks.second; ++secondLinkIt)
 			{
-				std::map<unsigned int, double>& secondLinkSubMap = secondLinkIt->second;
-				for (std::map<unsigned int, double>::const_iterator secondSubIt(secondLinkSubMap.begin()); secondSubIt != secondLinkSubMap.end(); ++secondSubIt)
-				{
-					unsigned int n3 = secondSubIt->first;
-					double linkWeight = secondSubIt->second;
+				unsigned int n3 = secondLinkIt->n2;
+				double linkWeight = secondLinkIt->weight;
 
-					if(!m_config.nonBacktracking || (n1 != n3))
-						addStateLink(n1, n2, n2, n3, linkWeight, firstLinkWeight / secondLinkSubMap.size(), 0.0);
+				if(!m_config.nonBacktracking || (n1 != n3))
+					addStateLink(n1, n2, n2, n3, linkWeight, firstLinkWeight / numSecondLinks, 0.0);
 
-				}
-			}
-			else
-			{
-				// No chainable link found, create a dangling memory node (or remove need for existence in MemFlowNetwork?)
-//				addStateNode(n1, n2, firstLinkWeight);
-				addStateLink(n1, n1, n1, n2, firstLinkWeight);
 			}
 		}
+		else
+		{
+			// No chainable link found, create a dangling memory node (or remove need for existence in MemFlowNetwork?)
+//			addStateNode(n1, n2, firstLinkWeight);
+			addStateLink(n1, n1, n1, n2, firstLinkWeight);
+		}
 	}
 
 	Log() << "done!" << std::endl;
@@ -742,6 +733,7 @@ void MemNetwork::finalizeAndCheckNetwork(bool printSummary)
 		return Network::finalizeAndCheckNetwork(printSummary);
 	}
 	m_isFinalized = true;
+	sortLinks();
 	
 	simulateMemoryToIncompleteData();
 
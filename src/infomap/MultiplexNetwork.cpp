@@ -304,25 +304,26 @@ void MultiplexNetwork::generateMemoryNetworkWithInterLayerLinksFromData()
 		}
 	}
 
+	// Index the intra-layer links on source node for lookup
+	std::vector<LinkMap> linkMaps(m_networks.size());
+	for (unsigned int i = 0; i < m_networks.size(); ++i)
+		m_networks[i].generateLinkMap(linkMaps[i]);
+
 	for (unsigned int layerIndex = 0; layerIndex < m_networks.size(); ++layerIndex)
 	{
 		sumOutWeights[layerIndex].assign(m_numNodes, 0.0);
-		const LinkMap& linkMap = m_networks[layerIndex].linkMap();
-		for (LinkMap::const_iterator linkIt(linkMap.begin()); linkIt != linkMap.end(); ++linkIt)
+		const LinkVec& links = m_networks[layerIndex].links();
+		for (LinkVec::const_iterator linkIt(links.begin()); linkIt != links.end(); ++linkIt)
 		{
-			unsigned int n1 = linkIt->first;
-			const std::map<unsigned int, double>& subLinks = linkIt->second;
-			for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
-			{
-				unsigned int n2 = subIt->first;
-				double linkWeight = subIt->second;
+			unsigned int n1 = linkIt->n1;
+			unsigned int n2 = linkIt->n2;
+			double linkWeight = linkIt->weight;
 
-				sumOutWeights[layerIndex][n1] += linkWeight;
-				if (oldUndirected) {
-					sumOutWeights[layerIndex][n2] += linkWeight;
-				}
-				addStateLink(layerIndex, n1, layerIndex, n2, linkWeight);
+			sumOutWeights[layerIndex][n1] += linkWeight;
+			if (oldUndirected) {
+				sumOutWeights[layerIndex][n2] += linkWeight;
 			}
+			addStateLink(layerIndex, n1, layerIndex, n2, linkWeight);
 		}
 	}
 
@@ -391,14 +392,14 @@ void MultiplexNetwork::generateMemoryNetworkWithInterLayerLinksFromData()
 					double weightNormalizationFactor = scaledInterLinkWeight / sumOutWeights[layer2][nodeIndex];
 					if (oldUndirected) {
 						// Distribute inter-links to outgoing intra-links in the target layer
-						bool add1 = createIntraLinksToNeighbouringNodesInTargetLayer(stateSourceIt, nodeIndex, layer2, m_networks[layer2].linkMap(), weightNormalizationFactor, weightNormalizationFactor);
+						bool add1 = createIntraLinksToNeighbouringNodesInTargetLayer(stateSourceIt, nodeIndex, layer2, linkMaps[layer2], weightNormalizationFactor, weightNormalizationFactor);
 						
 						// Distribute inter-link to incoming intra-links in the target layer
 						bool add2 = createIntraLinksToNeighbouringNodesInTargetLayer(stateSourceIt, nodeIndex, layer2, oppositeLinkMaps[layer2], weightNormalizationFactor, weightNormalizationFactor);
 
 						// Distribute inter-links to outgoing intra-links in the source layer
 						double oppositeWeightNormalizationFactor = scaledOppositeInterLinkWeight / sumOutWeights[layer1][nodeIndex];
-						createIntraLinksToNeighbouringNodesInTargetLayer(layer2, nodeIndex, layer1, m_networks[layer1].linkMap(), oppositeWeightNormalizationFactor, oppositeWeightNormalizationFactor);
+						createIntraLinksToNeighbouringNodesInTargetLayer(layer2, nodeIndex, layer1, linkMaps[layer1], oppositeWeightNormalizationFactor, oppositeWeightNormalizationFactor);
 						
 						// Distribute inter-link to incoming intra-links in the source layer
 						createIntraLinksToNeighbouringNodesInTargetLayer(layer2, nodeIndex, layer1, oppositeLinkMaps[layer1], oppositeWeightNormalizationFactor, oppositeWeightNormalizationFactor);
@@ -407,11 +408,11 @@ void MultiplexNetwork::generateMemoryNetworkWithInterLayerLinksFromData()
 					}
 					else {
 						// Distribute inter-link to the outgoing intra-links in the target layer
-						stateSourceNodeAdded = createIntraLinksToNeighbouringNodesInTargetLayer(stateSourceIt, nodeIndex, layer2, m_networks[layer2].linkMap(), weightNormalizationFactor, weightNormalizationFactor);
+						stateSourceNodeAdded = createIntraLinksToNeighbouringNodesInTargetLayer(stateSourceIt, nodeIndex, layer2, linkMaps[layer2], weightNormalizationFactor, weightNormalizationFactor);
 						if (m_config.parseAsUndirected()) {
 							// Treat inter-link as undirected and distribute to outgoing intra-links in the source layer too
 							double oppositeWeightNormalizationFactor = scaledOppositeInterLinkWeight / sumOutWeights[layer1][nodeIndex];
-							createIntraLinksToNeighbouringNodesInTargetLayer(layer2, nodeIndex, layer1, m_networks[layer1].linkMap(), oppositeWeightNormalizationFactor, oppositeWeightNormalizationFactor);
+							createIntraLinksToNeighbouringNodesInTargetLayer(layer2, nodeIndex, layer1, linkMaps[layer1], oppositeWeightNormalizationFactor, oppositeWeightNormalizationFactor);
 						}
 					}
 				}
@@ -452,6 +453,11 @@ void MultiplexNetwork::generateMemoryNetworkWithSimulatedInterLayerLinks()
 		}
 	}
 
+	// Index the intra-layer links on source node for lookup
+	std::vector<LinkMap> linkMaps(m_networks.size());
+	for (unsigned int i = 0; i < m_networks.size(); ++i)
+		m_networks[i].generateLinkMap(linkMaps[i]);
+
 	for (unsigned int nodeIndex = 0; nodeIndex < m_numNodes; ++nodeIndex)
 	{
 		unsigned int layer2from = 0;
@@ -509,7 +515,7 @@ void MultiplexNetwork::generateMemoryNetworkWithSimulatedInterLayerLinks()
 
 				// Log() << "    -> Layer " << layer2 << ", linkWeightNormalizationFactor: " << linkWeightNormalizationFactor << "\n";
 				
-				createIntraLinksToNeighbouringNodesInTargetLayer(layer1, nodeIndex, layer2, m_networks[layer2].linkMap(), linkWeightNormalizationFactor, stateNodeWeightNormalizationFactor);
+				createIntraLinksToNeighbouringNodesInTargetLayer(layer1, nodeIndex, layer2, linkMaps[layer2], linkWeightNormalizationFactor, stateNodeWeightNormalizationFactor);
 					
 				if (oldUndirected) {
 					// Create inter-links to the incoming nodes in the target layer too					
@@ -537,6 +543,11 @@ void MultiplexNetwork::generateMemoryNetworkWithJensenShannonSimulatedInterLayer
 		}
 	}
 
+	// Index the intra-layer links on source node for lookup
+	std::vector<LinkMap> linkMaps(m_networks.size());
+	for (unsigned int i = 0; i < m_networks.size(); ++i)
+		m_networks[i].generateLinkMap(linkMaps[i]);
+
 	for (unsigned int nodeIndex = 0; nodeIndex < m_numNodes; ++nodeIndex)
 	{
 
@@ -555,7 +566,7 @@ void MultiplexNetwork::generateMemoryNetworkWithJensenShannonSimulatedInterLayer
 			if(m_config.multiplexRelaxLimit >= 0){
 				layer2from = ((int)layer1-m_config.multiplexRelaxLimit) < 0 ? 0 : layer1-m_config.multiplexRelaxLimit;			}
 
-			const LinkMap& layer1LinkMap = m_networks[layer1].linkMap();
+			const LinkMap& layer1LinkMap = linkMaps[layer1];
 			LinkMap::const_iterator layer1OutLinksIt = layer1LinkMap.find(nodeIndex);
 			double sumOutLinkWeightLayer1 = m_networks[layer1].sumLinkOutWeight()[nodeIndex];
 
@@ -577,7 +588,7 @@ void MultiplexNetwork::generateMemoryNetworkWithJensenShannonSimulatedInterLayer
 
 				for (unsigned int layer2 = layer2from; layer2 < layer2to; ++layer2){
 
-					const LinkMap& layer2LinkMap = m_networks[layer2].linkMap();
+					const LinkMap& layer2LinkMap = linkMaps[layer2];
 					LinkMap::const_iterator layer2OutLinksIt = layer2LinkMap.find(nodeIndex);						
 					const LinkMap& layer2OppositeLinkMap = oppositeLinkMaps[layer2];
 					LinkMap::const_iterator layer2OppositeOutLinksIt = layer2OppositeLinkMap.find(nodeIndex);
@@ -616,7 +627,7 @@ void MultiplexNetwork::generateMemoryNetworkWithJensenShannonSimulatedInterLayer
  					continue;
 
 				for (unsigned int layer2 = layer2from; layer2 < layer2to; ++layer2){
-					const LinkMap& layer2LinkMap = m_networks[layer2].linkMap();
+					const LinkMap& layer2LinkMap = linkMaps[layer2];
 					LinkMap::const_iterator layer2OutLinksIt = layer2LinkMap.find(nodeIndex);
 					if (layer2OutLinksIt == layer2LinkMap.end())
 						continue;
@@ -672,7 +683,7 @@ void MultiplexNetwork::generateMemoryNetworkWithJensenShannonSimulatedInterLayer
 						
 						double stateNodeWeightNormalizationFactor = 1.0;
 						
-						createIntraLinksToNeighbouringNodesInTargetLayer(layer1, nodeIndex, layer2, m_networks[layer2].linkMap(), linkWeightNormalizationFactor, stateNodeWeightNormalizationFactor);
+						createIntraLinksToNeighbouringNodesInTargetLayer(layer1, nodeIndex, layer2, linkMaps[layer2], linkWeightNormalizationFactor, stateNodeWeightNormalizationFactor);
 						
 						if (oldUndirected) {
 							// Create inter-links to the incoming nodes in the target layer too					
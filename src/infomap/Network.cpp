@@ -32,7 +32,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <deque>
+#include <algorithm>
 
 #include "../io/convert.h"
 #include "../io/SafeFile.h"
@@ -46,6 +46,117 @@ namespace infomap
 
 using std::make_pair;
 
+namespace
+{
+	// Bipartite links are sorted on one byte of an index at a time, with the links counted
+	// and scattered in fixed blocks in parallel, so the sort doesn't depend on the number of threads.
+	const unsigned int RADIX_BITS = 8;
+	const unsigned int NUM_BUCKETS = 1u << RADIX_BITS;
+	const unsigned int RADIX_BLOCK_SIZE = 1u << 16;
+
+	struct NodeKey
+	{
+		unsigned int operator()(const BipartiteLink& link) const { return link.node; }
+	};
+
+	struct FeatureNodeKey
+	{
+		unsigned int operator()(const BipartiteLink& link) const { return link.featureNode; }
+	};
+
+	struct SwapOrderKey
+	{
+		unsigned int operator()(const BipartiteLink& link) const { return link.swapOrder ? 1 : 0; }
+	};
+
+	/**
+	 * Stable sort of the links on the key, one radix digit at a time from the least significant.
+	 * @param buffer Scratch space of the same size as links
+	 */
+	template<typename Key>
+	void radixSortOnKey(std::vector<BipartiteLink>& links, std::vector<BipartiteLink>& buffer, Key key)
+	{
+		unsigned int numLinks = links.size();
+		int numLinksInt = static_cast<int>(numLinks);
+		unsigned int maxKey = 0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(max:maxKey)
+#endif
+		for (int i = 0; i < numLinksInt; ++i)
+			maxKey = std::max(maxKey, key(links[i]));
+
+		int numBlocks = static_cast<int>((numLinks + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE);
+		std::vector<unsigned int> offsets(numBlocks * NUM_BUCKETS);
+		for (unsigned int shift = 0; shift < 32 && (maxKey >> shift) != 0; shift += RADIX_BITS)
+		{
+			// Count each digit in each block
+			offsets.assign(offsets.size(), 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+			for (int b = 0; b < numBlocks; ++b)
+			{
+				unsigned int* blockCount = &offsets[b * NUM_BUCKETS];
+				unsigned int end = std::min(numLinks, (b + 1) * RADIX_BLOCK_SIZE);
+				for (unsigned int i = b * RADIX_BLOCK_SIZE; i < end; ++i)
+					++blockCount[(key(links[i]) >> shift) & (NUM_BUCKETS - 1)];
+			}
+
+			// Start each block in each bucket after the earlier buckets and the earlier blocks in the same bucket
+			unsigned int sum = 0;
+			for (unsigned int d = 0; d < NUM_BUCKETS; ++d)
+			{
+				for (int b = 0; b < numBlocks; ++b)
+				{
+					unsigned int count = offsets[b * NUM_BUCKETS + d];
+					offsets[b * NUM_BUCKETS + d] = sum;
+					sum += count;
+				}
+			}
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+			for (int b = 0; b < numBlocks; ++b)
+			{
+				unsigned int* blockOffset = &offsets[b * NUM_BUCKETS];
+				unsigned int end = std::min(numLinks, (b + 1) * RADIX_BLOCK_SIZE);
+				for (unsigned int i = b * RADIX_BLOCK_SIZE; i < end; ++i)
+					buffer[blockOffset[(key(links[i]) >> shift) & (NUM_BUCKETS - 1)]++] = links[i];
+			}
+			links.swap(buffer);
+		}
+	}
+
+	/**
+	 * Sort the links on swap order, feature node and node, keeping duplicates in parsed order.
+	 */
+	void sortBipartiteLinks(std::vector<BipartiteLink>& links)
+	{
+		std::vector<BipartiteLink> buffer(links.size());
+		radixSortOnKey(links, buffer, NodeKey());
+		radixSortOnKey(links, buffer, FeatureNodeKey());
+		radixSortOnKey(links, buffer, SwapOrderKey());
+	}
+
+	struct LessSource
+	{
+		bool operator()(const Link& a, const Link& b) const { return a.n1 < b.n1; }
+	};
+
+	/**
+	 * Order links from the same source on target, and duplicates on weight to aggregate them
+	 * independently of the parsed order.
+	 */
+	struct LessTargetWeight
+	{
+		bool operator()(const Link& a, const Link& b) const
+		{
+			return a.n2 == b.n2 ? a.weight < b.weight : a.n2 < b.n2;
+		}
+	};
+}
+
 void Network::readInputData(std::string filename)
 {
 	if (filename.empty())
@@ -701,7 +812,7 @@ bool Network::addBipartiteLink(unsigned int featureNode, unsigned int node, bool
 	m_minNodeIndex = std::min(m_minNodeIndex, node);
 	m_minFeatureIndex = std::min(m_minFeatureIndex, featureNode);
 
-	m_bipartiteLinks[BipartiteLink(featureNode, node, swapOrder)] += weight;
+	m_bipartiteLinks.push_back(BipartiteLink(featureNode, node, swapOrder, weight));
 
 	return true;
 }
@@ -713,37 +824,90 @@ bool Network::addNode(unsigned int nodeIndex)
 	return insertNode(nodeIndex);
 }
 
-bool Network::insertLink(unsigned int n1, unsigned int n2, double weight)
+void Network::insertLink(unsigned int n1, unsigned int n2, double weight)
 {
 	++m_numLinks;
 	m_totalLinkWeight += weight;
 	insertNode(n1);
 	insertNode(n2);
 
-	// Aggregate link weights if they are definied more than once
-	LinkMap::iterator firstIt = m_links.lower_bound(n1);
-	if (firstIt != m_links.end() && firstIt->first == n1) // First linkEnd already exists, check second linkEnd
+	m_links.push_back(Link(n1, n2, weight));
+	m_linksSorted = false;
+}
+
+bool Network::insertNode(unsigned int nodeIndex)
+{
+	// A node number of zero without zero-based numbering wraps around, check it before indexing on it
+	if (nodeIndex == std::numeric_limits<unsigned int>::max())
+		throw InputDomainError(io::Str() << "Integer overflow, be sure to use zero-based node numbering if the node numbers start from zero.");
+	if (nodeIndex >= m_nodes.size())
+		m_nodes.resize(nodeIndex + 1, false);
+	if (m_nodes[nodeIndex])
+		return false;
+	m_nodes[nodeIndex] = true;
+	return true;
+}
+
+void Network::sortLinks()
+{
+	if (m_linksSorted)
+		return;
+	m_linksSorted = true;
+
+	unsigned int numLinks = m_links.size();
+	unsigned int numSources = 0;
+	for (unsigned int i = 0; i < numLinks; ++i)
+		numSources = std::max(numSources, m_links[i].n1 + 1);
+
+	// Bucket the links on source in place, swapping each link into the next free slot of its bucket
+	std::vector<unsigned int> sourceOffsets(numSources + 1, 0);
+	for (unsigned int i = 0; i < numLinks; ++i)
+		++sourceOffsets[m_links[i].n1 + 1];
+	for (unsigned int source = 0; source < numSources; ++source)
+		sourceOffsets[source + 1] += sourceOffsets[source];
+	std::vector<unsigned int> nextInBucket(sourceOffsets.begin(), sourceOffsets.end() - 1);
+	for (unsigned int source = 0; source < numSources; ++source)
 	{
-		std::pair<std::map<unsigned int, double>::iterator, bool> ret2 = firstIt->second.insert(std::make_pair(n2, weight));
-		if (!ret2.second)
+		unsigned int bucketEnd = sourceOffsets[source + 1];
+		while (nextInBucket[source] < bucketEnd)
 		{
-			ret2.first->second += weight;
-			++m_numAggregatedLinks;
-			--m_numLinks;
-			return false;
+			Link link = m_links[nextInBucket[source]];
+			while (link.n1 != source)
+				std::swap(link, m_links[nextInBucket[link.n1]++]);
+			m_links[nextInBucket[source]++] = link;
 		}
 	}
-	else
+	std::vector<unsigned int>().swap(nextInBucket);
+
+	// Sort the links within each bucket on target
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+	for (int source = 0; source < static_cast<int>(numSources); ++source)
 	{
-		m_links.insert(firstIt, std::make_pair(n1, std::map<unsigned int, double>()))->second.insert(std::make_pair(n2, weight));
+		std::sort(m_links.begin() + sourceOffsets[source], m_links.begin() + sourceOffsets[source + 1], LessTargetWeight());
 	}
+	std::vector<unsigned int>().swap(sourceOffsets);
 
-	return true;
+	// Aggregate link weights if they are definied more than once
+	unsigned int numUniqueLinks = 0;
+	for (unsigned int i = 0; i < numLinks; ++i)
+	{
+		const Link& link = m_links[i];
+		if (numUniqueLinks > 0 && m_links[numUniqueLinks - 1].n1 == link.n1 && m_links[numUniqueLinks - 1].n2 == link.n2)
+			m_links[numUniqueLinks - 1].weight += link.weight;
+		else
+			m_links[numUniqueLinks++] = link;
+	}
+	unsigned int numAggregatedLinks = numLinks - numUniqueLinks;
+	m_links.resize(numUniqueLinks);
+	m_numAggregatedLinks += numAggregatedLinks;
+	m_numLinks -= numAggregatedLinks;
 }
 
-bool Network::insertNode(unsigned int nodeIndex)
+std::pair<Network::LinkVec::const_iterator, Network::LinkVec::const_iterator> Network::outLinkRange(unsigned int source) const
 {
-	return m_nodes.insert(nodeIndex).second;
+	return std::equal_range(m_links.begin(), m_links.end(), Link(source, 0, 0.0), LessSource());
 }
 
 void Network::finalizeAndCheckNetwork(bool printSummary, unsigned int desiredNumberOfNodes)
@@ -784,21 +948,30 @@ void Network::finalizeAndCheckNetwork(bool printSummary, unsigned int desiredNum
 		if (m_minFeatureIndex < m_bipartiteStartIndex) {
 			featureIndexOffset = m_bipartiteStartIndex;
 		}
-		for (std::map<BipartiteLink, Weight>::iterator it(m_bipartiteLinks.begin()); it != m_bipartiteLinks.end(); ++it)
+		// Sort the links to aggregate duplicates, summing the weights in parsed order
+		sortBipartiteLinks(m_bipartiteLinks);
+		unsigned int numBipartiteLinks = m_bipartiteLinks.size();
+		for (unsigned int i = 0; i < numBipartiteLinks; ++i)
 		{
-			const BipartiteLink& link = it->first;
+			const BipartiteLink& link = m_bipartiteLinks[i];
+			double weight = link.weight;
+			while (i + 1 < numBipartiteLinks && m_bipartiteLinks[i + 1].sameLink(link))
+				weight += m_bipartiteLinks[++i].weight;
 			// Offset feature nodes by the number of ordinary nodes to make them unique
 			unsigned int featureNodeIndex = link.featureNode + featureIndexOffset;
 			m_maxNodeIndex = std::max(m_maxNodeIndex, featureNodeIndex);
 			if (link.swapOrder)
-				insertLink(link.node, featureNodeIndex, it->second.weight);
+				insertLink(link.node, featureNodeIndex, weight);
 			else
-				insertLink(featureNodeIndex, link.node, it->second.weight);
+				insertLink(featureNodeIndex, link.node, weight);
 		}
+		std::vector<BipartiteLink>().swap(m_bipartiteLinks);
 		m_numBipartiteNodes = m_maxNodeIndex + 1 - m_numNodes;
 		m_numNodes += m_numBipartiteNodes;
 	}
 
+	sortLinks();
+
 	if (m_links.empty())
 		throw InputDomainError("No links added!");
 
@@ -816,36 +989,34 @@ void Network::zoom()
 	unsigned int numNodes = m_numNodes;
 	std::vector<unsigned int> nodeOutDegree(numNodes, 0);
 	std::vector<double> sumLinkOutWeight(numNodes, 0.0);
-	std::map<unsigned int, double> dummy;
-	std::vector<std::map<unsigned int, double>::iterator> existingSelfLinks(numNodes, dummy.end());
+	unsigned int noSelfLink = std::numeric_limits<unsigned int>::max();
+	std::vector<unsigned int> existingSelfLinks(numNodes, noSelfLink);
 
-	for (LinkMap::iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+	unsigned int numLinks = m_links.size();
+	for (unsigned int i = 0; i < numLinks; ++i)
 	{
-		unsigned int linkEnd1 = linkIt->first;
-		std::map<unsigned int, double>& subLinks = linkIt->second;
-		for (std::map<unsigned int, double>::iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
+		const Link& link = m_links[i];
+		unsigned int linkEnd1 = link.n1;
+		unsigned int linkEnd2 = link.n2;
+		double linkWeight = link.weight;
+		++nodeOutDegree[linkEnd1];
+		if (linkEnd1 == linkEnd2)
 		{
-			unsigned int linkEnd2 = subIt->first;
-			double linkWeight = subIt->second;
-			++nodeOutDegree[linkEnd1];
-			if (linkEnd1 == linkEnd2)
+			// Store existing self-link to aggregate additional weight
+			existingSelfLinks[linkEnd1] = i;
+//			sumLinkOutWeight[linkEnd1] += linkWeight;
+		}
+		else
+		{
+			if (m_config.isUndirected())
 			{
-				// Store existing self-link to aggregate additional weight
-				existingSelfLinks[linkEnd1] = subIt;
-//				sumLinkOutWeight[linkEnd1] += linkWeight;
+				sumLinkOutWeight[linkEnd1] += linkWeight * 0.5; // Why half?
+				sumLinkOutWeight[linkEnd2] += linkWeight * 0.5;
+				++nodeOutDegree[linkEnd2];
 			}
 			else
 			{
-				if (m_config.isUndirected())
-				{
-					sumLinkOutWeight[linkEnd1] += linkWeight * 0.5; // Why half?
-					sumLinkOutWeight[linkEnd2] += linkWeight * 0.5;
-					++nodeOutDegree[linkEnd2];
-				}
-				else
-				{
-					sumLinkOutWeight[linkEnd1] += linkWeight;
-				}
+				sumLinkOutWeight[linkEnd1] += linkWeight;
 			}
 		}
 	}
@@ -859,16 +1030,20 @@ void Network::zoom()
 
 		double selfLinkWeight = sumLinkOutWeight[i] * selfProb / (1.0 - selfProb);
 
-		if (existingSelfLinks[i] != dummy.end()) {
-			existingSelfLinks[i]->second += selfLinkWeight;
+		if (existingSelfLinks[i] != noSelfLink) {
+			m_links[existingSelfLinks[i]].weight += selfLinkWeight;
 		}
 		else {
-			m_links[i].insert(std::make_pair(i, selfLinkWeight));
+			m_links.push_back(Link(i, i, selfLinkWeight));
+			m_linksSorted = false;
 			++m_numAdditionalLinks;
 		}
 		m_sumAdditionalLinkWeight += selfLinkWeight;
 	}
 
+	// Merge the new self-links into the sorted links
+	sortLinks();
+
 	m_numLinks += m_numAdditionalLinks;
 	m_numSelfLinks += m_numAdditionalLinks;
 	m_totalLinkWeight += m_sumAdditionalLinkWeight;
@@ -880,25 +1055,21 @@ void Network::initNodeDegrees()
 	m_outDegree.assign(m_numNodes, 0.0);
 	m_sumLinkOutWeight.assign(m_numNodes, 0.0);
 	m_numDanglingNodes = m_numNodes;
-	for (LinkMap::iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+	for (LinkVec::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
 	{
-		unsigned int n1 = linkIt->first;
-		std::map<unsigned int, double>& subLinks = linkIt->second;
-		for (std::map<unsigned int, double>::iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
+		unsigned int n1 = linkIt->n1;
+		unsigned int n2 = linkIt->n2;
+		double linkWeight = linkIt->weight;
+		if (m_outDegree[n1] == 0)
+			--m_numDanglingNodes;
+		++m_outDegree[n1];
+		m_sumLinkOutWeight[n1] += linkWeight;
+		if (n1 != n2 && m_config.parseAsUndirected())
 		{
-			unsigned int n2 = subIt->first;
-			double linkWeight = subIt->second;
-			if (m_outDegree[n1] == 0)
+			if (m_outDegree[n2] == 0)
 				--m_numDanglingNodes;
-			++m_outDegree[n1];
-			m_sumLinkOutWeight[n1] += linkWeight;
-			if (n1 != n2 && m_config.parseAsUndirected())
-			{
-				if (m_outDegree[n2] == 0)
-					--m_numDanglingNodes;
-				++m_outDegree[n2];
-				m_sumLinkOutWeight[n2] += linkWeight;
-			}
+			++m_outDegree[n2];
+			m_sumLinkOutWeight[n2] += linkWeight;
 		}
 	}
 }
@@ -933,52 +1104,51 @@ void Network::initNodeNames()
 
 void Network::generateOppositeLinks()
 {
-	// First collect all links to not insert while iterating, which may lead to duplication of existing links
-	std::deque<Link> links;
-	for (LinkMap::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+	// Only iterate the existing links, as the opposite links are appended
+	unsigned int numLinks = m_links.size();
+	for (unsigned int i = 0; i < numLinks; ++i)
 	{
-		unsigned int sourceIndex = linkIt->first;
-		const std::map<unsigned int, double>& outLinks = linkIt->second;
-		for (std::map<unsigned int, double>::const_iterator outLinkIt(outLinks.begin()); outLinkIt != outLinks.end(); ++outLinkIt)
-		{
-			unsigned int targetIndex = outLinkIt->first;
-			double weight = outLinkIt->second;
-			links.push_back(Link(sourceIndex, targetIndex, weight));
-		}
-	}
-	for (std::deque<Link>::const_iterator it(links.begin()); it != links.end(); ++it) {
-		const Link& link = *it;
+		Link link = m_links[i];
 		// Create link in opposite direction
 		addLink(link.n2, link.n1, link.weight);
 	}
 }
 
-void Network::generateOppositeLinkMap(LinkMap& oppositeLinks)
+void Network::generateLinkMap(LinkMap& links) const
 {
+	LinkMap::iterator sourceIt = links.end();
+	for (LinkVec::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+	{
+		if (sourceIt == links.end() || sourceIt->first != linkIt->n1)
+			sourceIt = links.insert(links.end(), std::make_pair(linkIt->n1, std::map<unsigned int, double>()));
+		// Insert link, aggregate link weights if they are definied more than once
+		std::pair<std::map<unsigned int, double>::iterator, bool> ret = sourceIt->second.insert(std::make_pair(linkIt->n2, linkIt->weight));
+		if (!ret.second)
+			ret.first->second += linkIt->weight;
+	}
+}
 
-	for (LinkMap::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+void Network::generateOppositeLinkMap(LinkMap& oppositeLinks) const
+{
+	for (LinkVec::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
 	{
-		unsigned int sourceIndex = linkIt->first;
-		const std::map<unsigned int, double>& outLinks = linkIt->second;
-		for (std::map<unsigned int, double>::const_iterator outLinkIt(outLinks.begin()); outLinkIt != outLinks.end(); ++outLinkIt)
+		unsigned int sourceIndex = linkIt->n1;
+		unsigned int targetIndex = linkIt->n2;
+		double weight = linkIt->weight;
+		// Insert opposite link, aggregate link weights if they are definied more than once
+		LinkMap::iterator firstIt = oppositeLinks.lower_bound(targetIndex);
+		if (firstIt != oppositeLinks.end() && firstIt->first == targetIndex) // First linkEnd already exists, check second linkEnd
 		{
-			unsigned int targetIndex = outLinkIt->first;
-			double weight = outLinkIt->second;
-			// Insert opposite link, aggregate link weights if they are definied more than once
-			LinkMap::iterator firstIt = oppositeLinks.lower_bound(targetIndex);
-			if (firstIt != oppositeLinks.end() && firstIt->first == targetIndex) // First linkEnd already exists, check second linkEnd
-			{
-				std::pair<std::map<unsigned int, double>::iterator, bool> ret2 = firstIt->second.insert(std::make_pair(sourceIndex, weight));
-				if (!ret2.second)
-				{
-					ret2.first->second += weight;
-				}
-			}
-			else
+			std::pair<std::map<unsigned int, double>::iterator, bool> ret2 = firstIt->second.insert(std::make_pair(sourceIndex, weight));
+			if (!ret2.second)
 			{
-				oppositeLinks.insert(firstIt, std::make_pair(targetIndex, std::map<unsigned int, double>()))->second.insert(std::make_pair(sourceIndex, weight));
+				ret2.first->second += weight;
 			}
 		}
+		else
+		{
+			oppositeLinks.insert(firstIt, std::make_pair(targetIndex, std::map<unsigned int, double>()))->second.insert(std::make_pair(sourceIndex, weight));
+		}
 	}
 }
 
@@ -1058,17 +1228,8 @@ void Network::printNetworkAsPajek(std::string filename) const
 	}
 
 	out << (m_config.isUndirected() ? "*Edges " : "*Arcs ") << m_links.size() << "\n";
-	for (LinkMap::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
-	{
-		unsigned int linkEnd1 = linkIt->first;
-		const std::map<unsigned int, double>& subLinks = linkIt->second;
-		for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
-		{
-			unsigned int linkEnd2 = subIt->first;
-			double linkWeight = subIt->second;
-			out << (linkEnd1 + 1) << " " << (linkEnd2 + 1) << " " << linkWeight << "\n";
-		}
-	}
+	for (LinkVec::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+		out << (linkIt->n1 + 1) << " " << (linkIt->n2 + 1) << " " << linkIt->weight << "\n";
 }
 
 void Network::printStateNetwork(std::string filename) const
@@ -1086,17 +1247,8 @@ void Network::printStateNetwork(std::string filename) const
 	}
 
 	out << (m_config.isUndirected() ? "*Edges " : "*Arcs ") << m_links.size() << "\n";
-	for (LinkMap::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
-	{
-		unsigned int linkEnd1 = linkIt->first;
-		const std::map<unsigned int, double>& subLinks = linkIt->second;
-		for (std::map<unsigned int, double>::const_iterator subIt(subLinks.begin()); subIt != subLinks.end(); ++subIt)
-		{
-			unsigned int linkEnd2 = subIt->first;
-			double linkWeight = subIt->second;
-			out << (linkEnd1 + 1) << " " << (linkEnd2 + 1) << " " << linkWeight << "\n";
-		}
-	}
+	for (LinkVec::const_iterator linkIt(m_links.begin()); linkIt != m_links.end(); ++linkIt)
+		out << (linkIt->n1 + 1) << " " << (linkIt->n2 + 1) << " " << linkIt->weight << "\n";
 }
 
 #ifdef NS_INFOMAP
@@ -42,13 +42,40 @@ namespace infomap
 #endif
 
 struct Bigram;
-struct Weight;
-struct BipartiteLink;
+
+/**
+ * A bipartite link as parsed, with swapOrder set if the ordinary node came first.
+ * Duplicates are aggregated when the network is finalized.
+ */
+struct BipartiteLink
+{
+	unsigned int featureNode, node;
+	bool swapOrder;
+	double weight;
+	BipartiteLink(unsigned int featureNode = 0, unsigned int node = 0, bool swapOrder = false, double weight = 0.0)
+	: featureNode(featureNode), node(node), swapOrder(swapOrder), weight(weight) {}
+
+	bool sameLink(const BipartiteLink& other) const
+	{
+		return featureNode == other.featureNode && node == other.node && swapOrder == other.swapOrder;
+	}
+};
+
+struct Link
+{
+	Link() : n1(0), n2(0), weight(0.0) {}
+	Link(unsigned int n1, unsigned int n2, double weight) : n1(n1), n2(n2), weight(weight) {}
+
+	unsigned int n1;
+	unsigned int n2;
+	double weight;
+};
 
 class Network
 {
 public:
 	typedef std::map<unsigned int, std::map<unsigned int, double> >	LinkMap;
+	typedef std::vector<Link>	LinkVec;
 
 	Network()
 	:	m_config(Config()),
@@ -75,7 +102,8 @@ public:
 	 	m_indexOffset(m_config.zeroBasedNodeNumbers ? 0 : 1),
 		m_numBipartiteNodes(0),
 		m_gotDirected(false),
-		m_isFinalized(false)
+		m_isFinalized(false),
+		m_linksSorted(true)
 	{}
 	Network(const Config& config)
 	:	m_config(config),
@@ -102,7 +130,8 @@ public:
 	 	m_indexOffset(m_config.zeroBasedNodeNumbers ? 0 : 1),
 		m_numBipartiteNodes(0),
 		m_gotDirected(false),
-		m_isFinalized(false)
+		m_isFinalized(false),
+		m_linksSorted(true)
 	{}
 	Network(const Network& other)
 	:	m_config(other.m_config),
@@ -129,7 +158,8 @@ public:
 	 	m_indexOffset(other.m_indexOffset),
 		m_numBipartiteNodes(other.m_numBipartiteNodes),
 		m_gotDirected(other.m_gotDirected),
-		m_isFinalized(other.m_isFinalized)
+		m_isFinalized(other.m_isFinalized),
+		m_linksSorted(true)
 	{}
 	Network& operator=(const Network& other)
 	{
@@ -210,9 +240,16 @@ public:
 	double sumNodeWeights() const { return m_sumNodeWeights; }
 	const std::vector<double>& outDegree() const { return m_outDegree; }
 	const std::vector<double>& sumLinkOutWeight() const { return m_sumLinkOutWeight; }
-	bool haveNode(unsigned int nodeIndex) const { return m_nodes.count(nodeIndex) != 0; }
+	bool haveNode(unsigned int nodeIndex) const { return nodeIndex < m_nodes.size() && m_nodes[nodeIndex]; }
 
-	const LinkMap& linkMap() const { return m_links; }
+	/**
+	 * The links sorted on source and target, with duplicates aggregated, after the network is finalized.
+	 */
+	const LinkVec& links() const { return m_links; }
+	/**
+	 * The range of links from the source node in the sorted links.
+	 */
+	std::pair<LinkVec::const_iterator, LinkVec::const_iterator> outLinkRange(unsigned int source) const;
 	unsigned int numLinks() const { return m_numLinks; }
 	double totalLinkWeight() const { return m_totalLinkWeight; }
 	double totalSelfLinkWeight() const { return m_totalSelfLinkWeight; }
@@ -225,9 +262,10 @@ public:
 	void swapNodeNames(std::vector<std::string>& target) { target.swap(m_nodeNames); }
 
 	void generateOppositeLinks();
-	void generateOppositeLinkMap(LinkMap& oppositeLinks);
+	void generateLinkMap(LinkMap& links) const;
+	void generateOppositeLinkMap(LinkMap& oppositeLinks) const;
 
-	virtual void disposeLinks() { m_links.clear(); }
+	virtual void disposeLinks() { LinkVec().swap(m_links); }
 
 	const Config& config() { return m_config; }
 
@@ -272,11 +310,15 @@ protected:
 	bool parseBipartiteLink(const std::string& line, unsigned int& featureNode, unsigned int& node, double& weight);
 
 	/**
-	 * Insert ordinary link, indexed on first node and aggregated if exist
+	 * Append ordinary link, aggregated with existing links when the links are sorted
 	 * @note Called by addLink
-	 * @return true if a new link was inserted, false if aggregated
 	 */
-	bool insertLink(unsigned int n1, unsigned int n2, double weight);
+	void insertLink(unsigned int n1, unsigned int n2, double weight);
+
+	/**
+	 * Sort the links on source and target and aggregate duplicates, if not already sorted
+	 */
+	void sortLinks();
 
 	/**
 	* Insert node if not exist
@@ -314,9 +356,9 @@ protected:
 	std::vector<double> m_outDegree;
 	std::vector<double> m_sumLinkOutWeight;
 	unsigned int m_numDanglingNodes;
-	std::set<unsigned int> m_nodes;
+	std::vector<bool> m_nodes; // Nodes defined on links or added
 
-	LinkMap m_links;
+	LinkVec m_links; // Unsorted until finalized
 	unsigned int m_numLinksFound;
 	unsigned int m_numLinks;
 	double m_totalLinkWeight; // On whole network
@@ -343,12 +385,13 @@ protected:
 	unsigned int m_indexOffset;
 
 	// Bipartite
-	std::map<BipartiteLink, Weight> m_bipartiteLinks;
+	std::vector<BipartiteLink> m_bipartiteLinks; // Unsorted until finalized
 	unsigned int m_numBipartiteNodes;
 
 	// Other
 	bool m_gotDirected;
 	bool m_isFinalized;
+	bool m_linksSorted;
 
 };
 
@@ -363,35 +406,6 @@ struct Bigram
 	}
 };
 
-struct BipartiteLink
-{
-	unsigned int featureNode, node;
-	bool swapOrder;
-	BipartiteLink(unsigned int featureNode = 0, unsigned int node = 0, bool swapOrder = false)
-	: featureNode(featureNode), node(node), swapOrder(swapOrder) {}
-
-	bool operator<(const BipartiteLink other) const
-	{
-		if (swapOrder != other.swapOrder)
-			return other.swapOrder;
-		
-		return featureNode == other.featureNode ? node < other.node : featureNode < other.featureNode;
-	}
-};
-
-// Struct to make the weight initialized to zero by default in a map
-struct Weight
-{
-	double weight;
-	Weight(double weight = 0) : weight(weight) {}
-
-	Weight& operator+=(double w)
-	{
-		weight += w;
-		return *this;
-	}
-};
-
 template<typename key_t, typename subkey_t, typename value_t>
 class MapMap
 {
@@ -485,16 +499,6 @@ struct Triple
 	unsigned int n3;
 };
 
-struct Link
-{
-	Link() : n1(0), n2(0), weight(0.0) {}
-	Link(unsigned int n1, unsigned int n2, double weight) : n1(n1), n2(n2), weight(weight) {}
-
-	unsigned int n1;
-	unsigned int n2;
-	double weight;
-};
-
 #ifdef NS_INFOMAP
 }
 #endif
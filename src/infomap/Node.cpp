@@ -46,6 +46,7 @@ NodeBase::NodeBase()
  	name(),
  	index(0),
  	originalIndex(0),
+ 	leafIndex(0),
 	parent(0),
 	previous(0),
 	next(0),
@@ -67,6 +68,7 @@ NodeBase::NodeBase(std::string name)
  	name(name),
  	index(0),
  	originalIndex(0),
+ 	leafIndex(0),
 	parent(0),
 	previous(0),
 	next(0),
@@ -88,6 +90,7 @@ NodeBase::NodeBase(const NodeBase& other)
  	name(other.name),
  	index(0),
  	originalIndex(0),
+ 	leafIndex(0),
 	parent(0),
 	previous(0),
 	next(0),
@@ -120,12 +123,12 @@ NodeBase::~NodeBase()
 			parent->lastChild = previous;
 	}
 
-	// Delete outgoing edges.
+	// Delete outgoing edges, allocated from the pool of this node.
 	// TODO: Renders ingoing edges invalid. Assume or assert that all nodes on the same level are deleted?
 	for (NodeBase::edge_iterator outEdgeIt(begin_outEdge());
 			outEdgeIt != end_outEdge(); ++outEdgeIt)
 	{
-		delete *outEdgeIt;
+		EdgeType::destroy(*outEdgeIt, SlabPool::poolOf(this));
 	}
 
 	--s_nodeCount;
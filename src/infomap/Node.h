@@ -328,9 +328,18 @@ public:
 
 	void deleteChildren();
 
+	void reserveOutEdges(unsigned int numEdges)
+	{ m_outEdges.reserve(numEdges); }
+
+	void reserveInEdges(unsigned int numEdges)
+	{ m_inEdges.reserve(numEdges); }
+
+	/**
+	 * Add an edge allocated from the pool of this node, which deletes it with the node.
+	 */
 	EdgeType* addOutEdge(NodeBase& target, double weight, double flow = 0.0)
 	{
-		EdgeType* edge = new EdgeType(*this, target, weight, flow);
+		EdgeType* edge = new (SlabPool::poolOf(this)) EdgeType(*this, target, weight, flow);
 		m_outEdges.push_back(edge);
 		target.m_inEdges.push_back(edge);
 		return edge;
@@ -364,6 +373,7 @@ public:
 	std::string name;
 	unsigned int index; // Temporary index used in finding best module
 	unsigned int originalIndex; // Index in the original network (for leaf nodes)
+	unsigned int leafIndex; // Position in the leaf network of its tree (for leaf nodes)
 
 	NodeBase* parent;
 	NodeBase* previous; // sibling
@@ -642,6 +652,8 @@ public:
 	virtual ~Node()
 	{}
 
+	SLABPOOL_ALLOCATION_OPERATORS
+
 	friend std::ostream& operator<<(std::ostream& out, const node_type& node)
 	{
 //		return out << "n" << node.id << " (" << node.data << ")";
@@ -689,6 +701,8 @@ public:
 	virtual ~MemNode()
 	{}
 
+	SLABPOOL_ALLOCATION_OPERATORS
+
 	friend std::ostream& operator<<(std::ostream& out, const node_type& node)
 	{
 		return out << "(name: " << node.name << ", flow: " << node.data.flow << ", phys: " << node.stateNode << ")";
@@ -41,8 +41,8 @@ class NodeFactoryBase
 public:
 	virtual ~NodeFactoryBase() {}
 
-	virtual NodeBase* createNode(std::string, double flow, double teleWeight = 1.0) const = 0;
-	virtual NodeBase* createNode(const NodeBase&) const = 0;
+	virtual NodeBase* createNode(SlabPool& pool, std::string, double flow, double teleWeight = 1.0) const = 0;
+	virtual NodeBase* createNode(SlabPool& pool, const NodeBase&) const = 0;
 };
 
 
@@ -52,13 +52,13 @@ class NodeFactory : public NodeFactoryBase
 	typedef Node<FlowType> 			node_type;
 	typedef const Node<FlowType>	const_node_type;
 public:
-	NodeBase* createNode(std::string name, double flow, double teleWeight) const
+	NodeBase* createNode(SlabPool& pool, std::string name, double flow, double teleWeight) const
 	{
-		return new node_type(name, flow, teleWeight);
+		return new (pool) node_type(name, flow, teleWeight);
 	}
-	NodeBase* createNode(const NodeBase& node) const
+	NodeBase* createNode(SlabPool& pool, const NodeBase& node) const
 	{
-		return new node_type(static_cast<const_node_type&>(node));
+		return new (pool) node_type(static_cast<const_node_type&>(node));
 	}
 };
 
@@ -68,13 +68,13 @@ class MemNodeFactory : public NodeFactoryBase
 	typedef MemNode<FlowType> 			node_type;
 	typedef const MemNode<FlowType>		const_node_type;
 public:
-	NodeBase* createNode(std::string name, double flow, double teleWeight) const
+	NodeBase* createNode(SlabPool& pool, std::string name, double flow, double teleWeight) const
 	{
-		return new node_type(name, flow, teleWeight);
+		return new (pool) node_type(name, flow, teleWeight);
 	}
-	NodeBase* createNode(const NodeBase& node) const
+	NodeBase* createNode(SlabPool& pool, const NodeBase& node) const
 	{
-		return new node_type(static_cast<const_node_type&>(node));
+		return new (pool) node_type(static_cast<const_node_type&>(node));
 	}
 };
 
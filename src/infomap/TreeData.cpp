@@ -34,9 +34,10 @@ namespace infomap
 
 TreeData::TreeData(NodeFactoryBase* nodeFactory)
 :	m_nodeFactory(nodeFactory),
-	m_numLeafEdges(0)
+	m_numLeafEdges(0),
+	m_isLeafLinkView(false)
 {
-	m_root = m_nodeFactory->createNode("root", 1.0);
+	m_root = createNode("root", 1.0, 1.0);
 }
 
 TreeData::~TreeData()
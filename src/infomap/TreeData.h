@@ -32,6 +32,7 @@
 //#include "Edge.h"
 #include "Node.h"
 #include "NodeFactory.h"
+#include "Adjacency.h"
 #include <memory>
 
 #ifdef NS_INFOMAP
@@ -52,7 +53,16 @@ public:
 
 	void readFromSubNetwork(NodeBase* parent);
 
-	const NodeFactoryBase& nodeFactory() const { return *m_nodeFactory; }
+	/**
+	 * Create a node in the pool of this tree, to be added to the tree or deleted before the tree.
+	 */
+	NodeBase* createNode(std::string name, double flow, double teleportWeight)
+	{ return m_nodeFactory->createNode(m_pool, name, flow, teleportWeight); }
+
+	NodeBase* createNode(const NodeBase& other)
+	{ return m_nodeFactory->createNode(m_pool, other); }
+
+	SlabPool& pool() { return m_pool; }
 
 	// ---------------------------- Iterators and element access ----------------------------
 	leafIterator begin_leaf()
@@ -95,33 +105,61 @@ public:
 
 	unsigned int calcSize();
 
+	/**
+	 * Get the adjacency of the leaf network, built on first use after the leaf network has changed.
+	 * @note The index of each leaf node must hold its position in the leaf network.
+	 */
+	const Adjacency& leafAdjacency()
+	{
+		if (m_leafAdjacency.empty())
+			m_leafAdjacency.build(m_leafNodes);
+		return m_leafAdjacency;
+	}
+
+	/**
+	 * True if the leaf nodes don't own any edges, but the links of the leaf network
+	 * are stored only in the leaf adjacency, referenced by leafIndex on the leaf nodes.
+	 * Sub-network views are built this way, and so is the full network of first-order flow,
+	 * see InfomapBase::initFlowNetwork.
+	 */
+	bool isLeafLinkView() const
+	{ return m_isLeafLinkView; }
+
+	const Adjacency& leafLinkView() const
+	{ return m_leafAdjacency; }
+
 	// ---------------------------- Manipulation: ----------------------------
 
 	void reserveNodeCount(unsigned int nodeCount)
 	{
 		m_leafNodes.reserve(nodeCount);
+		m_pool.reserve(nodeCount);
 	}
 
 	void addNewNode(const NodeBase& other)
 	{
-		NodeBase* node = m_nodeFactory->createNode(other);
+		NodeBase* node = createNode(other);
 		m_root->addChild(node);
-		node->originalIndex = m_leafNodes.size();
+		node->originalIndex = node->leafIndex = m_leafNodes.size();
 		m_leafNodes.push_back(node);
+		invalidateLeafAdjacency();
 	}
 
 	void addNewNode(std::string name, double flow, double teleportWeight)
 	{
-		NodeBase* node = m_nodeFactory->createNode(name, flow, teleportWeight);
+		NodeBase* node = createNode(name, flow, teleportWeight);
 		m_root->addChild(node);
-		node->originalIndex = m_leafNodes.size();
+		node->originalIndex = node->leafIndex = m_leafNodes.size();
 		m_leafNodes.push_back(node);
+		invalidateLeafAdjacency();
 	}
 
 	void addClonedNode(NodeBase* node)
 	{
 		m_root->addChild(node);
+		node->leafIndex = m_leafNodes.size();
 		m_leafNodes.push_back(node);
+		invalidateLeafAdjacency();
 	}
 
 	void addEdge(unsigned int sourceIndex, unsigned int targetIndex, double weight, double flow)
@@ -130,17 +168,49 @@ public:
 		NodeBase* target = m_leafNodes[targetIndex];
 		source->addOutEdge(*target, weight, flow);
 		++m_numLeafEdges;
+		invalidateLeafAdjacency();
 //		EdgeType* edge = source->addOutEdge(*target, weight);
 //		m_leafEdges.push_back(edge);
 	}
 
+	/**
+	 * Store the links of the leaf network as an adjacency instead of edges on the leaf nodes.
+	 * Add the links in order of source and finish with endLeafLinkView().
+	 */
+	void beginLeafLinkView(unsigned int maxNumLinks)
+	{
+		m_leafAdjacency.beginLinks(m_leafNodes.size(), maxNumLinks);
+		m_numLeafEdges = 0;
+		m_isLeafLinkView = true;
+	}
+
+	void addLeafLink(unsigned int sourceIndex, unsigned int targetIndex, double flow)
+	{
+		m_leafAdjacency.addLink(sourceIndex, targetIndex, flow);
+		++m_numLeafEdges;
+	}
+
+	void endLeafLinkView()
+	{
+		m_leafAdjacency.endLinks();
+	}
+
 
 
 private:
+	void invalidateLeafAdjacency()
+	{
+		if (!m_leafAdjacency.empty())
+			m_leafAdjacency.clear();
+	}
+
+	SlabPool m_pool; // Declared first to be destroyed after all nodes and edges
 	std::auto_ptr<NodeFactoryBase> m_nodeFactory;
 	NodeBase* m_root;
 	std::vector<NodeBase*> m_leafNodes;
 	unsigned int m_numLeafEdges;
+	Adjacency m_leafAdjacency;
+	bool m_isLeafLinkView;
 //	std::vector<EdgeType*> m_leafEdges;
 
 };
@@ -0,0 +1,109 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#include "Workspace.h"
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+namespace
+{
+	Workspace* s_workspace = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(s_workspace)
+#endif
+	// The workspaces of all threads, to release their buffers when the last run ends
+	std::vector<Workspace*> s_workspaces;
+	unsigned int s_numActiveRuns = 0;
+}
+
+Workspace& Workspace::forCurrentThread()
+{
+	if (s_workspace == 0)
+	{
+		s_workspace = new Workspace();
+#ifdef _OPENMP
+#pragma omp critical (workspaces)
+#endif
+		s_workspaces.push_back(s_workspace);
+	}
+	return *s_workspace;
+}
+
+void Workspace::beginRun()
+{
+#ifdef _OPENMP
+#pragma omp critical (workspaces)
+#endif
+	++s_numActiveRuns;
+}
+
+void Workspace::endRun()
+{
+#ifdef _OPENMP
+#pragma omp critical (workspaces)
+#endif
+	{
+		if (--s_numActiveRuns == 0)
+		{
+			for (std::vector<Workspace*>::iterator it(s_workspaces.begin()); it != s_workspaces.end(); ++it)
+				(*it)->release();
+		}
+	}
+}
+
+template<typename T>
+static void releaseBuffer(std::vector<T>& buffer)
+{
+	std::vector<T>().swap(buffer);
+}
+
+void Workspace::release()
+{
+	releaseBuffer(nodeOrder);
+	releaseBuffer(redirect);
+	redirectOffset = 1;
+	releaseBuffer(plogpTerms);
+	releaseBuffer(dirtyQueue);
+	releaseBuffer(nextDirtyQueue);
+	releaseBuffer(modules);
+	releaseBuffer(linkOffsets);
+	releaseBuffer(moduleCount);
+	releaseBuffer(outDegree);
+	releaseBuffer(inDegree);
+	releaseBuffer(links);
+	releaseBuffer(sortedLinks);
+	releaseBuffer(m_deltaFlow);
+	releaseBuffer(m_memDeltaFlow);
+	releaseBuffer(m_deltaCodelengths);
+}
+
+#ifdef NS_INFOMAP
+}
+#endif
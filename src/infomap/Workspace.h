@@ -0,0 +1,160 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#ifndef WORKSPACE_H_
+#define WORKSPACE_H_
+
+#include <vector>
+#include <limits>
+#include "flowData.h"
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+class NodeBase;
+
+struct ModuleLink
+{
+	ModuleLink() : source(0), target(0), flow(0.0) {}
+	ModuleLink(NodeBase* source, NodeBase* target, double flow) : source(source), target(target), flow(flow) {}
+	NodeBase* source;
+	NodeBase* target;
+	double flow;
+};
+
+/**
+ * Scratch buffers for the core loop and the consolidation of modules.
+ *
+ * One workspace is kept per thread, and the buffers are only grown during a run, so
+ * the many short-lived sub-Infomap instances of the recursive partitioning run without
+ * allocations once the buffers are large enough. The buffers of all threads are
+ * released when the last run ends, see RunScope.
+ * The buffers hold no state between uses, except for redirect, which is valid
+ * together with redirectOffset: entries below the offset are unused.
+ * Partitioning tasks are only scheduled outside the core loop and the consolidation,
+ * so a thread never interleaves two uses of its workspace.
+ */
+struct Workspace
+{
+	/**
+	 * Marks a run that uses the workspaces. When the last active run ends, the buffers
+	 * of the workspaces of all threads are released, so a finished run doesn't keep
+	 * buffers sized to its network.
+	 */
+	struct RunScope
+	{
+		RunScope() { beginRun(); }
+		~RunScope() { endRun(); }
+	};
+
+	Workspace() : redirectOffset(1) {}
+
+	/**
+	 * Get the workspace of the calling thread.
+	 */
+	static Workspace& forCurrentThread();
+
+	static void beginRun();
+	static void endRun();
+
+	/**
+	 * Free the memory of all buffers.
+	 */
+	void release();
+
+	template<typename DeltaFlowType>
+	std::vector<DeltaFlowType>& moduleDeltas(unsigned int minSize);
+
+	std::vector<double>& deltaCodelengths(unsigned int minSize)
+	{
+		if (m_deltaCodelengths.size() < minSize)
+			m_deltaCodelengths.resize(minSize);
+		return m_deltaCodelengths;
+	}
+
+	/**
+	 * Grow the module redirect to cover numNodes modules and reset it before the
+	 * offset can overflow with another numNodes steps per node.
+	 */
+	void prepareRedirect(unsigned int numNodes)
+	{
+		if (redirect.size() < numNodes)
+			redirect.resize(numNodes, 0);
+		if (redirectOffset > std::numeric_limits<unsigned int>::max() - 1 - numNodes)
+		{
+			redirect.assign(redirect.size(), 0);
+			redirectOffset = 1;
+		}
+	}
+
+	std::vector<unsigned int> nodeOrder;
+	std::vector<unsigned int> redirect;
+	unsigned int redirectOffset;
+	std::vector<double> plogpTerms;
+	std::vector<unsigned int> dirtyQueue;
+	std::vector<unsigned int> nextDirtyQueue;
+
+	// For consolidateModules
+	std::vector<NodeBase*> modules;
+	std::vector<unsigned int> linkOffsets;
+	std::vector<unsigned int> moduleCount;
+	std::vector<unsigned int> outDegree;
+	std::vector<unsigned int> inDegree;
+	std::vector<ModuleLink> links;
+	std::vector<ModuleLink> sortedLinks;
+
+private:
+	std::vector<DeltaFlow> m_deltaFlow;
+	std::vector<MemDeltaFlow> m_memDeltaFlow;
+	std::vector<double> m_deltaCodelengths;
+};
+
+template<>
+inline
+std::vector<DeltaFlow>& Workspace::moduleDeltas<DeltaFlow>(unsigned int minSize)
+{
+	if (m_deltaFlow.size() < minSize)
+		m_deltaFlow.resize(minSize);
+	return m_deltaFlow;
+}
+
+template<>
+inline
+std::vector<MemDeltaFlow>& Workspace::moduleDeltas<MemDeltaFlow>(unsigned int minSize)
+{
+	if (m_memDeltaFlow.size() < minSize)
+		m_memDeltaFlow.resize(minSize);
+	return m_memDeltaFlow;
+}
+
+#ifdef NS_INFOMAP
+}
+#endif
+
+#endif /* WORKSPACE_H_ */
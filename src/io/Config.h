@@ -34,6 +34,7 @@
 #include <vector>
 
 #include "../utils/Date.h"
+#include "../utils/Stopwatch.h"
 #include "version.h"
 
 #ifdef NS_INFOMAP
@@ -50,6 +51,8 @@ struct Config
 	 	withMemory(false),
 		bipartite(false),
 		skipAdjustBipartiteFlow(false),
+		bipartiteHyperedges(false),
+		bipartiteTwoPhase(false),
 		multiplexAddMissingNodes(false),
 		hardPartitions(false),
 	 	nonBacktracking(false),
@@ -74,6 +77,10 @@ struct Config
 		teleportToNodes(false),
 		teleportationProbability(0.15),
 		selfTeleportationProbability(-1),
+		flowTolerance(1.0e-15),
+		maxFlowIterations(0),
+		flowSolver("power"),
+		flowCacheDirectory(""),
 		markovTime(1.0),
 		variableMarkovTime(false),
 		preferredNumberOfModules(0),
@@ -83,6 +90,7 @@ struct Config
 		multiplexRelaxLimit(-1),
 		seedToRandomNumberGenerator(123),
 		numTrials(1),
+		maxSeconds(0.0),
 		minimumCodelengthImprovement(1.0e-10),
 		minimumSingleNodeCodelengthImprovement(1.0e-16),
 		randomizeCoreLoopLimit(true),
@@ -97,6 +105,10 @@ struct Config
 		fastFirstIteration(false),
 		lowMemoryPriority(0),
 		innerParallelization(false),
+		dirtyNodeQueue(false),
+		graftSubModules(false),
+		deterministicInnerParallelization(false),
+		parallelTrials(false),
 		resetConfigBeforeRecursion(false),
 		outDirectory("."),
 		outName(""),
@@ -122,6 +134,7 @@ struct Config
 		showBiNodes(false),
 		hideBipartiteNodes(false),
 		minBipartiteNodeIndex(0),
+		runTimer(true),
 		version(INFOMAP_VERSION)
 	{
 	}
@@ -134,6 +147,8 @@ struct Config
 	 	withMemory(other.withMemory),
 		bipartite(other.bipartite),
 		skipAdjustBipartiteFlow(other.skipAdjustBipartiteFlow),
+		bipartiteHyperedges(other.bipartiteHyperedges),
+		bipartiteTwoPhase(other.bipartiteTwoPhase),
 		multiplexAddMissingNodes(other.multiplexAddMissingNodes),
 		hardPartitions(other.hardPartitions),
 	 	nonBacktracking(other.nonBacktracking),
@@ -158,6 +173,10 @@ struct Config
 		teleportToNodes(other.teleportToNodes),
 		teleportationProbability(other.teleportationProbability),
 		selfTeleportationProbability(other.selfTeleportationProbability),
+		flowTolerance(other.flowTolerance),
+		maxFlowIterations(other.maxFlowIterations),
+		flowSolver(other.flowSolver),
+		flowCacheDirectory(other.flowCacheDirectory),
 		markovTime(other.markovTime),
 		variableMarkovTime(other.variableMarkovTime),
 		preferredNumberOfModules(other.preferredNumberOfModules),
@@ -167,6 +186,7 @@ struct Config
 		multiplexRelaxLimit(other.multiplexRelaxLimit),
 		seedToRandomNumberGenerator(other.seedToRandomNumberGenerator),
 		numTrials(other.numTrials),
+		maxSeconds(other.maxSeconds),
 		minimumCodelengthImprovement(other.minimumCodelengthImprovement),
 		minimumSingleNodeCodelengthImprovement(other.minimumSingleNodeCodelengthImprovement),
 		randomizeCoreLoopLimit(other.randomizeCoreLoopLimit),
@@ -181,6 +201,10 @@ struct Config
 		fastFirstIteration(other.fastFirstIteration),
 		lowMemoryPriority(other.lowMemoryPriority),
 		innerParallelization(other.innerParallelization),
+		dirtyNodeQueue(other.dirtyNodeQueue),
+		graftSubModules(other.graftSubModules),
+		deterministicInnerParallelization(other.deterministicInnerParallelization),
+		parallelTrials(other.parallelTrials),
 		resetConfigBeforeRecursion(other.resetConfigBeforeRecursion),
 		outDirectory(other.outDirectory),
 		outName(other.outName),
@@ -207,6 +231,7 @@ struct Config
 		hideBipartiteNodes(other.hideBipartiteNodes),
 		minBipartiteNodeIndex(other.minBipartiteNodeIndex),
 		startDate(other.startDate),
+		runTimer(other.runTimer),
 		version(other.version)
 	{
 	}
@@ -220,6 +245,8 @@ struct Config
 	 	withMemory = other.withMemory;
 	 	bipartite = other.bipartite;
 	 	skipAdjustBipartiteFlow = other.skipAdjustBipartiteFlow;
+	 	bipartiteHyperedges = other.bipartiteHyperedges;
+	 	bipartiteTwoPhase = other.bipartiteTwoPhase;
 	 	multiplexAddMissingNodes = other.multiplexAddMissingNodes;
 	 	hardPartitions = other.hardPartitions;
 	 	nonBacktracking = other.nonBacktracking;
@@ -244,6 +271,10 @@ struct Config
 		teleportToNodes = other.teleportToNodes;
 		teleportationProbability = other.teleportationProbability;
 		selfTeleportationProbability = other.selfTeleportationProbability;
+		flowTolerance = other.flowTolerance;
+		maxFlowIterations = other.maxFlowIterations;
+		flowSolver = other.flowSolver;
+		flowCacheDirectory = other.flowCacheDirectory;
 	 	markovTime = other.markovTime;
 	 	variableMarkovTime = other.variableMarkovTime;
 	 	preferredNumberOfModules = other.preferredNumberOfModules;
@@ -253,6 +284,7 @@ struct Config
 		multiplexRelaxLimit = other.multiplexRelaxLimit;
 		seedToRandomNumberGenerator = other.seedToRandomNumberGenerator;
 		numTrials = other.numTrials;
+		maxSeconds = other.maxSeconds;
 		minimumCodelengthImprovement = other.minimumCodelengthImprovement;
 		minimumSingleNodeCodelengthImprovement = other.minimumSingleNodeCodelengthImprovement;
 		randomizeCoreLoopLimit = other.randomizeCoreLoopLimit;
@@ -267,6 +299,10 @@ struct Config
 		fastFirstIteration = other.fastFirstIteration;
 		lowMemoryPriority = other.lowMemoryPriority;
 		innerParallelization = other.innerParallelization;
+		dirtyNodeQueue = other.dirtyNodeQueue;
+		graftSubModules = other.graftSubModules;
+		deterministicInnerParallelization = other.deterministicInnerParallelization;
+		parallelTrials = other.parallelTrials;
 		resetConfigBeforeRecursion = other.resetConfigBeforeRecursion;
 		outDirectory = other.outDirectory;
 		outName = other.outName;
@@ -293,6 +329,7 @@ struct Config
 	 	hideBipartiteNodes = other.hideBipartiteNodes;
 	 	minBipartiteNodeIndex = other.minBipartiteNodeIndex;
 		startDate = other.startDate;
+		runTimer = other.runTimer;
 		version = other.version;
 		return *this;
 	}
@@ -392,6 +429,8 @@ struct Config
 		fastFirstIteration = false;
 		lowMemoryPriority = 0;
 		innerParallelization = false;
+		deterministicInnerParallelization = false;
+		dirtyNodeQueue = false;
 	}
 
 	bool isOriginallyUndirected() const { return originallyUndirected; }
@@ -417,6 +456,16 @@ struct Config
 
 	bool isMemoryNetwork() const { return withMemory || nonBacktracking || isMemoryInput(); }
 
+	/**
+	 * The iteration limit of the flow solver, 300 for memory networks and 200 otherwise by default.
+	 */
+	unsigned int getMaxFlowIterations() const
+	{
+		if (maxFlowIterations != 0)
+			return maxFlowIterations;
+		return isMemoryNetwork() ? 300 : 200;
+	}
+
 	bool isSimulatedMemoryNetwork() const { return (withMemory || nonBacktracking) && !isMemoryInput(); }
 
 	bool haveOutput() const
@@ -436,6 +485,8 @@ struct Config
 
 	ElapsedTime elapsedTime() const { return Date() - startDate; }
 
+	bool isTimeBudgetExceeded() const { return maxSeconds > 0.0 && runTimer.getElapsedTimeInSec() >= maxSeconds; }
+
 
 	// Input
 	std::string parsedArgs;
@@ -445,6 +496,8 @@ struct Config
 	bool withMemory;
 	bool bipartite;
 	bool skipAdjustBipartiteFlow;
+	bool bipartiteHyperedges; // Optimize on the ordinary nodes with the feature nodes as hyperedges between them
+	bool bipartiteTwoPhase; // Leave the feature nodes out of the core loop and place them in their strongest connected module after it
 	bool multiplexAddMissingNodes;
 	bool hardPartitions;
 	bool nonBacktracking;
@@ -471,6 +524,10 @@ struct Config
 	bool teleportToNodes;
 	double teleportationProbability;
 	double selfTeleportationProbability;
+	double flowTolerance; // Convergence threshold on the sum of absolute rank changes in the power iteration
+	unsigned int maxFlowIterations; // Zero for the default of the network type, see getMaxFlowIterations()
+	std::string flowSolver; // 'power', 'gauss-seidel' or 'aitken'
+	std::string flowCacheDirectory; // Cache the flow network here, keyed by the input and the flow options, if non-empty
 	double markovTime;
 	bool variableMarkovTime;
 	unsigned int preferredNumberOfModules;
@@ -482,6 +539,7 @@ struct Config
 
 	// Performance and accuracy
 	unsigned int numTrials;
+	double maxSeconds;
 	double minimumCodelengthImprovement;
 	double minimumSingleNodeCodelengthImprovement;
 	bool randomizeCoreLoopLimit;
@@ -496,6 +554,10 @@ struct Config
 	bool fastFirstIteration;
 	unsigned int lowMemoryPriority; // Prioritize memory efficient algorithms before fast if > 0
 	bool innerParallelization;
+	bool dirtyNodeQueue;
+	bool graftSubModules; // Graft sub-modules into the main tree in the recursive search
+	bool deterministicInnerParallelization;
+	bool parallelTrials;
 	bool resetConfigBeforeRecursion; // If true, flags only affect building up super modules.
 
 	// Output
@@ -527,6 +589,7 @@ struct Config
 
 	// Other
 	Date startDate;
+	Stopwatch runTimer; // Measures the --max-seconds budget
 	std::string version;
 };
 
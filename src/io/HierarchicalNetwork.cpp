@@ -47,6 +47,8 @@ void HierarchicalNetwork::init(std::string networkName, double codelength, doubl
 	m_maxDepth = 0;
 	m_codelength = codelength;
 	m_oneLevelCodelength = oneLevelCodelength;
+	m_timeBudgetExceeded = false;
+	m_projectedBipartiteFlow = false;
 }
 
 void HierarchicalNetwork::clear()
@@ -271,6 +273,10 @@ void HierarchicalNetwork::writeClu(const std::string& fileName, int moduleIndexD
 	out << "partitioned in " << m_config.elapsedTime() << " from codelength " <<
 		io::toPrecision(m_oneLevelCodelength, 9, true) << " in one level to codelength " <<
 		io::toPrecision(m_codelength, 9, true) << " in " << m_maxDepth << " levels.\n";
+	if (m_timeBudgetExceeded)
+		out << "# Budget-limited: stopped after --max-seconds " << m_config.maxSeconds << " with the best solution found so far.\n";
+	if (m_projectedBipartiteFlow)
+		out << "# Projected bipartite codelength: the feature nodes are coded as hyperedges between the ordinary nodes (--bipartite-hyperedges), not comparable with the codelength of the bipartite network.\n";
 	if (m_config.printExpanded) {
 		if (m_config.isMultiplexNetwork())
 			out << "# layer node cluster flow:\n";
@@ -380,6 +386,10 @@ void HierarchicalNetwork::writeHumanReadableTree(const std::string& fileName, bo
 	out << "partitioned in " << m_config.elapsedTime() << " from codelength " <<
 		io::toPrecision(m_oneLevelCodelength, 9, true) << " in one level to codelength " <<
 		io::toPrecision(m_codelength, 9, true) << " in " << m_maxDepth << " levels.\n";
+	if (m_timeBudgetExceeded)
+		out << "# Budget-limited: stopped after --max-seconds " << m_config.maxSeconds << " with the best solution found so far.\n";
+	if (m_projectedBipartiteFlow)
+		out << "# Projected bipartite codelength: the feature nodes are coded as hyperedges between the ordinary nodes (--bipartite-hyperedges), not comparable with the codelength of the bipartite network.\n";
 
 	if (m_config.printExpanded) {
 		if (m_config.isMultiplexNetwork())
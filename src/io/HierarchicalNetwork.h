@@ -814,6 +814,8 @@ public:
 		m_maxDepth(0),
 		m_codelength(0.0),
 		m_oneLevelCodelength(0.0),
+		m_timeBudgetExceeded(false),
+		m_projectedBipartiteFlow(false),
 		m_infomapVersion(conf.version),
 		m_infomapOptions(conf.parsedArgs)
 		{}
@@ -843,6 +845,8 @@ public:
 
 	void prepareAddLeafNodes(unsigned int numLeafNodes);
 
+	SNode& getLeafNode(unsigned int leafIndex) { return *m_leafNodes[leafIndex]; }
+
 	/**
 	 * Add flow-edges to the tree. This method can aggregate the edges between the leaf-nodes
 	 * up in the tree based on the edge aggregation policy.
@@ -917,6 +921,10 @@ public:
 	unsigned int maxDepth() { return m_maxDepth; }
 	double codelength() { return m_codelength; }
 	double onelevelCodelength() { return m_oneLevelCodelength; }
+	bool timeBudgetExceeded() { return m_timeBudgetExceeded; }
+	void setTimeBudgetExceeded(bool value) { m_timeBudgetExceeded = value; }
+	bool projectedBipartiteFlow() { return m_projectedBipartiteFlow; }
+	void setProjectedBipartiteFlow(bool value) { m_projectedBipartiteFlow = value; }
 
 private:
 
@@ -945,6 +953,8 @@ private:
 	unsigned int m_maxDepth;
 	double m_codelength;
 	double m_oneLevelCodelength;
+	bool m_timeBudgetExceeded; // Optimization stopped by --max-seconds
+	bool m_projectedBipartiteFlow; // Codelength of the ordinary nodes only, see Config::bipartiteHyperedges
 	std::string m_infomapVersion;
 	std::string m_infomapOptions;
 
@@ -0,0 +1,122 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+#ifndef SHAREDCONFIG_H_
+#define SHAREDCONFIG_H_
+
+#include "Config.h"
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+/**
+ * A reference-counted configuration, shared by an Infomap instance and all the
+ * sub-Infomap instances created from it, so that creating a sub-instance doesn't
+ * copy the Config with all its strings.
+ *
+ * The count is updated atomically as sub-instances are created and released
+ * from parallel tasks. The configuration itself is only to be changed by the
+ * instance that created it, while no sub-instance sharing it is running.
+ */
+class SharedConfig
+{
+public:
+	explicit SharedConfig(const Config& conf) : m_data(new Data(conf)) {}
+
+	SharedConfig(const SharedConfig& other) : m_data(other.m_data)
+	{
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+		++m_data->refCount;
+	}
+
+	~SharedConfig()
+	{
+		unsigned int refCount;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+		refCount = --m_data->refCount;
+		if (refCount == 0)
+			delete m_data;
+	}
+
+	const Config& get() const { return m_data->config; }
+	Config& get() { return m_data->config; }
+
+	/**
+	 * Check the --max-seconds budget, and record if it is exceeded, so that the output
+	 * can tell if the optimization was cut short.
+	 */
+	bool stopOnTimeBudget()
+	{
+		if (!m_data->config.isTimeBudgetExceeded())
+			return false;
+		setStoppedOnTimeBudget();
+		return true;
+	}
+
+	void setStoppedOnTimeBudget()
+	{
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+		m_data->stoppedOnTimeBudget = true;
+	}
+
+	bool stoppedOnTimeBudget() const
+	{
+		bool stopped;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+		stopped = m_data->stoppedOnTimeBudget;
+		return stopped;
+	}
+
+private:
+	SharedConfig& operator=(const SharedConfig&);
+
+	struct Data
+	{
+		Data(const Config& conf) : config(conf), refCount(1), stoppedOnTimeBudget(false) {}
+		Config config;
+		unsigned int refCount;
+		bool stoppedOnTimeBudget;
+	};
+
+	Data* m_data;
+};
+
+#ifdef NS_INFOMAP
+}
+#endif
+
+#endif /* SHAREDCONFIG_H_ */
@@ -26,6 +26,7 @@
 
 
 #include "Logger.h"
+#include <sys/resource.h>
 
 #ifdef NS_INFOMAP
 namespace infomap
@@ -41,6 +42,17 @@ std::string Logger::s_indentString = "";
 unsigned int Logger::MAX_INDENT_LEVEL = 10;
 std::string Logger::s_benchmarkFilename = "benchmark.tsv";
 
+double Logger::getPeakMemoryUsageInMB()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0); // In bytes
+#else
+	return usage.ru_maxrss / 1024.0; // In kilobytes
+#endif
+}
 
 //void Logger::logToFile(std::string row, std::string filename)
 //{
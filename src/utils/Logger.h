@@ -164,6 +164,17 @@ struct hideIf
 	bool hide;
 };
 
+/**
+ * Silence the log in a scope, and restore the previous state when leaving it.
+ */
+struct SilentLogScope
+{
+	SilentLogScope() : wasSilent(Log::isSilent()) { Log::setSilent(true); }
+	~SilentLogScope() { Log::setSilent(wasSilent); }
+
+	bool wasSilent;
+};
+
 class Logger
 {
 public:
@@ -214,10 +225,25 @@ public:
 			else
 				logFile << Stopwatch::getElapsedTimeSinceProgramStartInSec() << "\t" << tag << "\t" <<
 					codelength << "\t" << numTopModules << "\t" << numNonTrivialTopModules << "\t" <<
-					numLevels << "\n";
+					numLevels << "\t" << getPeakMemoryUsageInMB() << "\n";
 		}
 	}
 
+	/**
+	 * Write a row for a step that the codelength and module columns don't describe, with
+	 * the elapsed time and the tag followed by its own tab-separated name=value fields.
+	 */
+	static void benchmarkFields(std::string tag, std::string fields)
+	{
+		benchmark(io::Str() << Stopwatch::getElapsedTimeSinceProgramStartInSec() << "\t" << tag << "\t" << fields,
+				0, 0, 0, 0, true);
+	}
+
+
+	/**
+	 * Get the peak resident memory of the process so far, or 0 if not available.
+	 */
+	static double getPeakMemoryUsageInMB();
 
 private:
 	static unsigned int s_indentLevel;
@@ -0,0 +1,207 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+#ifndef SLABPOOL_H_
+#define SLABPOOL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+/**
+ * Arena for the nodes and edges of one tree, owned by its TreeData.
+ *
+ * Blocks are cut from slabs that grow with the tree, and the blocks of deleted nodes
+ * and edges are recycled through a free list per block size. All slabs are released
+ * at once when the pool is destroyed with its tree, so the many short-lived sub-Infomap
+ * trees free their memory in bulk instead of object by object on the global heap.
+ *
+ * Objects created with allocate() start with a pointer to their pool, so that they can
+ * be deleted with ordinary delete expressions. Blocks from allocateBlock() have no such
+ * header and are returned by their owner, which is how the edges are kept as small as on
+ * the global heap. A pool is not thread-safe, so a tree must only be changed by one thread
+ * at a time.
+ */
+class SlabPool
+{
+	struct Header
+	{
+		SlabPool* pool;
+	};
+
+	struct FreeList
+	{
+		FreeList(std::size_t blockSize) : blockSize(blockSize), head(0) {}
+		std::size_t blockSize;
+		char* head;
+	};
+
+public:
+	static const std::size_t minSlabSize = 1 << 10;
+	static const std::size_t maxSlabSize = 1 << 20;
+
+	SlabPool() : m_current(0), m_end(0), m_nextSlabSize(minSlabSize), m_numReservedBlocks(0) {}
+
+	~SlabPool()
+	{
+		for (std::vector<char*>::iterator slabIt(m_slabs.begin()); slabIt != m_slabs.end(); ++slabIt)
+			::operator delete(*slabIt);
+	}
+
+	/**
+	 * Allocate an object that can be returned with the static deallocate.
+	 */
+	void* allocate(std::size_t size)
+	{
+		char* block = static_cast<char*>(allocateBlock(sizeof(Header) + size));
+		reinterpret_cast<Header*>(block)->pool = this;
+		return block + sizeof(Header);
+	}
+
+	/**
+	 * Return an object of the given size to the pool it was allocated from.
+	 */
+	static void deallocate(void* pointer, std::size_t size)
+	{
+		if (pointer == 0)
+			return;
+		poolOf(pointer).deallocateBlock(static_cast<char*>(pointer) - sizeof(Header), sizeof(Header) + size);
+	}
+
+	/**
+	 * Get the pool of an object created with allocate().
+	 */
+	static SlabPool& poolOf(const void* pointer)
+	{
+		return *reinterpret_cast<const Header*>(static_cast<const char*>(pointer) - sizeof(Header))->pool;
+	}
+
+	void* allocateBlock(std::size_t size)
+	{
+		FreeList& freeList = getFreeList(blockSize(size));
+		char* block = freeList.head;
+		if (block != 0)
+			freeList.head = *reinterpret_cast<char**>(block);
+		else
+			block = allocateFromSlab(freeList.blockSize);
+		return block;
+	}
+
+	void deallocateBlock(void* pointer, std::size_t size)
+	{
+		FreeList& freeList = getFreeList(blockSize(size));
+		*static_cast<char**>(pointer) = freeList.head;
+		freeList.head = static_cast<char*>(pointer);
+	}
+
+	/**
+	 * Make room for the given number of blocks of the next allocated size in one slab, to
+	 * not leave a partly used slab behind when the number of objects is known up front.
+	 */
+	void reserve(std::size_t numBlocks)
+	{
+		m_numReservedBlocks = numBlocks;
+	}
+
+private:
+	SlabPool(const SlabPool&);
+	SlabPool& operator=(const SlabPool&);
+
+	/**
+	 * The size rounded up to keep the blocks aligned for doubles and pointers.
+	 */
+	static std::size_t blockSize(std::size_t size)
+	{
+		std::size_t alignment = sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*);
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	// A tree only allocates a few object types, so a linear search is enough
+	FreeList& getFreeList(std::size_t blockSize)
+	{
+		for (std::vector<FreeList>::iterator it(m_freeLists.begin()); it != m_freeLists.end(); ++it)
+		{
+			if (it->blockSize == blockSize)
+				return *it;
+		}
+		m_freeLists.push_back(FreeList(blockSize));
+		return m_freeLists.back();
+	}
+
+	char* allocateFromSlab(std::size_t blockSize)
+	{
+		if (static_cast<std::size_t>(m_end - m_current) < blockSize)
+		{
+			std::size_t slabSize = std::max(m_nextSlabSize, blockSize * std::max<std::size_t>(m_numReservedBlocks, 1));
+			m_slabs.push_back(static_cast<char*>(::operator new(slabSize)));
+			m_current = m_slabs.back();
+			m_end = m_current + slabSize;
+			if (m_nextSlabSize < maxSlabSize)
+				m_nextSlabSize *= 2;
+		}
+		m_numReservedBlocks = 0;
+		char* block = m_current;
+		m_current += blockSize;
+		return block;
+	}
+
+	std::vector<char*> m_slabs;
+	char* m_current; // Start of the unused part of the last slab
+	char* m_end;
+	std::size_t m_nextSlabSize;
+	std::size_t m_numReservedBlocks;
+	std::vector<FreeList> m_freeLists;
+};
+
+/**
+ * Class-level allocation operators that allocate the objects from a SlabPool, created with
+ * new (pool) Type(...). Deleting the object returns its block to the pool it came from.
+ */
+#define SLABPOOL_ALLOCATION_OPERATORS \
+	static void* operator new(std::size_t size, SlabPool& pool) \
+	{ \
+		return pool.allocate(size); \
+	} \
+	static void operator delete(void* pointer, SlabPool&) \
+	{ \
+		/* Only called if the constructor throws, the block is released with the pool */ \
+	} \
+	static void operator delete(void* pointer, std::size_t size) \
+	{ \
+		SlabPool::deallocate(pointer, size); \
+	}
+
+#ifdef NS_INFOMAP
+}
+#endif
+
+#endif /* SLABPOOL_H_ */
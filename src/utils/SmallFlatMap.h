@@ -0,0 +1,153 @@
+/**********************************************************************************
+
+ Infomap software package for multi-level network clustering
+
+ Copyright (c) 2013, 2014 Daniel Edler, Martin Rosvall
+ 
+ For more information, see <http://www.mapequation.org>
+ 
+
+ This file is part of Infomap software package.
+
+ Infomap software package is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Infomap software package is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with Infomap software package.  If not, see <http://www.gnu.org/licenses/>.
+
+**********************************************************************************/
+
+
+
+#ifndef SMALLFLATMAP_H_
+#define SMALLFLATMAP_H_
+
+#include <utility>
+#include <algorithm>
+
+#ifdef NS_INFOMAP
+namespace infomap
+{
+#endif
+
+/**
+ * A map stored as an array of key-value pairs sorted on key, with room for N pairs
+ * inside the object before it allocates. Meant for the many tiny maps where a
+ * std::map would spend most of its memory and time on tree nodes.
+ *
+ * Iterates in key order as std::map, but insertion and erasure are linear in the size
+ * and invalidate iterators to the following pairs.
+ */
+template<typename Key, typename T, unsigned int N>
+class SmallFlatMap
+{
+public:
+	typedef std::pair<Key, T>		value_type;
+	typedef value_type*				iterator;
+	typedef const value_type*		const_iterator;
+
+	SmallFlatMap() : m_data(m_local), m_size(0), m_capacity(N) {}
+
+	SmallFlatMap(const SmallFlatMap& other) : m_data(m_local), m_size(0), m_capacity(N)
+	{
+		*this = other;
+	}
+
+	SmallFlatMap& operator=(const SmallFlatMap& other)
+	{
+		if (this != &other)
+		{
+			m_size = 0;
+			reserve(other.m_size);
+			std::copy(other.begin(), other.end(), m_data);
+			m_size = other.m_size;
+		}
+		return *this;
+	}
+
+	~SmallFlatMap()
+	{
+		if (m_data != m_local)
+			delete [] m_data;
+	}
+
+	iterator begin() { return m_data; }
+	iterator end() { return m_data + m_size; }
+	const_iterator begin() const { return m_data; }
+	const_iterator end() const { return m_data + m_size; }
+
+	unsigned int size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	void clear() { m_size = 0; }
+
+	iterator find(const Key& key)
+	{
+		iterator it = lower_bound(key);
+		return it != end() && it->first == key ? it : end();
+	}
+
+	iterator lower_bound(const Key& key)
+	{
+		iterator it = begin();
+		while (it != end() && it->first < key)
+			++it;
+		return it;
+	}
+
+	std::pair<iterator, bool> insert(const value_type& value)
+	{
+		iterator it = lower_bound(value.first);
+		if (it != end() && it->first == value.first)
+			return std::make_pair(it, false);
+		unsigned int pos = it - begin();
+		reserve(m_size + 1);
+		it = begin() + pos;
+		std::copy_backward(it, end(), end() + 1);
+		*it = value;
+		++m_size;
+		return std::make_pair(it, true);
+	}
+
+	T& operator[](const Key& key)
+	{
+		return insert(value_type(key, T())).first->second;
+	}
+
+	void erase(iterator it)
+	{
+		std::copy(it + 1, end(), it);
+		--m_size;
+	}
+
+private:
+	void reserve(unsigned int size)
+	{
+		if (size <= m_capacity)
+			return;
+		unsigned int capacity = std::max(size, 2 * m_capacity);
+		value_type* data = new value_type[capacity];
+		std::copy(begin(), end(), data);
+		if (m_data != m_local)
+			delete [] m_data;
+		m_data = data;
+		m_capacity = capacity;
+	}
+
+	value_type m_local[N];
+	value_type* m_data;
+	unsigned int m_size;
+	unsigned int m_capacity;
+};
+
+#ifdef NS_INFOMAP
+}
+#endif
+
+#endif /* SMALLFLATMAP_H_ */
@@ -28,6 +28,9 @@
 #define STOPWATCH_H_
 
 #include <ctime>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef NS_INFOMAP
 namespace infomap
@@ -48,35 +51,33 @@ public:
 
     void start()
     {
-    	m_start = std::clock();
+    	m_start = now();
     	m_running = true;
     }
 
     void reset()
     {
     	if (m_running)
-    		m_start = std::clock();
+    		m_start = now();
     }
 
     void stop()
     {
         if (m_running)
         {
-            m_stop = std::clock();
+            m_stop = now();
             m_running = false;
         }
     }
 
     double getElapsedTimeInSec() const
     {
-    	clock_t ticks = (m_running ? std::clock() : m_stop) - m_start;
-    	return (double)ticks / CLOCKS_PER_SEC;
+    	return (m_running ? now() : m_stop) - m_start;
     }
 
     double getElapsedTimeInMilliSec() const
     {
-    	clock_t ticks = (m_running ? std::clock() : m_stop) - m_start;
-    	return ticks * 1000.0 / CLOCKS_PER_SEC;
+    	return getElapsedTimeInSec() * 1000.0;
     }
 
     static double getElapsedTimeSinceProgramStartInSec()
@@ -90,7 +91,20 @@ public:
     }
 
 private:
-    std::clock_t m_start, m_stop;
+    /**
+     * The current time in seconds. With OpenMP the processor time of std::clock() is summed over
+     * all threads, so the wall time is used instead.
+     */
+    static double now()
+    {
+#ifdef _OPENMP
+    	return omp_get_wtime();
+#else
+    	return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+    }
+
+    double m_start, m_stop;
     bool m_running;
 };
 
@@ -46,6 +46,16 @@ namespace infomath
 		return p > 0.0 ? p * log2(p) : 0.0;
 	}
 
+	/**
+	 * Replace each value p in the buffer with plogp(p).
+	 */
+	inline
+	void plogpInPlace(double* values, unsigned int size)
+	{
+		for (unsigned int i = 0; i < size; ++i)
+			values[i] = plogp(values[i]);
+	}
+
 
 	/**
 	 * Get a random permutation of indices of the size of the input vector